@@ -32,6 +32,7 @@
 # include "stream.h"
 # include "frame.h"
 # include "timer.h"
+# include "layer12.h"
 # include "layer3.h"
 
 static
@@ -56,8 +57,8 @@ unsigned int const samplerate_table[3] PROGMEM = { 44100, 48000, 32000 };
 
 static
 int (*const decoder_table[3])(struct mad_stream *, struct mad_frame *) = {
-  NULL, //mad_layer_I,
-  NULL, //mad_layer_II,
+  mad_layer_I,
+  mad_layer_II,
   mad_layer_III
 };
 
@@ -446,11 +447,6 @@ int mad_frame_decode(struct mad_frame *frame, struct mad_stream *stream)
 
   frame->header.flags &= ~MAD_FLAG_INCOMPLETE;
 
-  // EFP3 - On non-MP3 frames, abort instead of crash..we removed MP-II/MP-I decoders
-  if (!decoder_table[frame->header.layer - 1]) {
-    goto fail;
-  }
-
   if (decoder_table[frame->header.layer - 1](stream, frame) == -1) {
     if (!MAD_RECOVERABLE(stream->error))
       stream->next_frame = stream->this_frame;
@@ -1,6 +1,19 @@
 #ifndef HAL_STUB_H
 #define HAL_STUB_H
 
+#include <stdint.h>
+
 extern "C" unsigned long millis();
 
+// Does nothing, the host does not scale its clock
+bool setCpuFrequencyMhz(uint32_t frequency);
+
+// Only the cycle counter of the ESP32 class, the host counts its time stamp counter or nanoseconds
+class EspClass {
+   public:
+    uint32_t getCycleCount();
+};
+
+extern EspClass ESP;
+
 #endif
@@ -0,0 +1,94 @@
+#include <FS.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include "FaultProfile.h"
+#include "FaultyFS.h"
+#include "PosixFS.h"
+
+// Binaries that are linked with -Wl,--wrap=fopen open files for reading through FaultyFS if SD_PROFILE names
+// a FaultProfile, so the decoders and everything else that reads with stdio see the timing of that SD card.
+
+extern "C" FILE* __real_fopen(const char* path, const char* mode);
+
+namespace {
+
+thread_local bool opening = false;
+
+FaultProfile profile;
+
+fs::FSImplPtr faultyFS() {
+    static fs::FSImplPtr fs = []() -> fs::FSImplPtr {
+        const char* path = getenv("SD_PROFILE");
+
+        if (!path) return nullptr;
+
+        if (!profile.load(path)) {
+            fprintf(stderr, "unable to load the SD profile %s\n", path);
+            exit(1);
+        }
+
+        fprintf(stderr, "SD profile %s: %u bytes/s, %u latencies, %u ms stalls every %u ms\n", path,
+                profile.getBandwidth(), static_cast<uint32_t>(profile.getLatencies().size()),
+                profile.getStallDuration(), profile.getStallInterval());
+
+        return std::make_shared<FaultyFS>(std::make_shared<PosixFS>(), profile);
+    }();
+
+    return fs;
+}
+
+ssize_t readStream(void* cookie, char* buffer, size_t size) {
+    return (*static_cast<fs::FileImplPtr*>(cookie))->read(reinterpret_cast<uint8_t*>(buffer), size);
+}
+
+// The file implementations take unsigned offsets
+int seekStream(void* cookie, off64_t* offset, int whence) {
+    fs::FileImpl& file = **static_cast<fs::FileImplPtr*>(cookie);
+
+    int64_t position = *offset;
+
+    if (whence == SEEK_CUR) position += file.position();
+    if (whence == SEEK_END) position += file.size();
+
+    if (position < 0 || !file.seek(position, fs::SeekSet)) return -1;
+
+    *offset = position;
+
+    return 0;
+}
+
+int closeStream(void* cookie) {
+    delete static_cast<fs::FileImplPtr*>(cookie);
+
+    return 0;
+}
+
+}  // namespace
+
+extern "C" FILE* __wrap_fopen(const char* path, const char* mode) {
+    // Files that are written and the files that FaultyFS opens itself are not delayed
+    if (opening || strpbrk(mode, "wa+")) return __real_fopen(path, mode);
+
+    opening = true;
+
+    fs::FSImplPtr fs = faultyFS();
+    fs::FileImplPtr file = fs ? fs->open(path, mode) : nullptr;
+
+    opening = false;
+
+    if (!fs || (file && file->isDirectory())) return __real_fopen(path, mode);
+
+    if (!file) {
+        errno = ENOENT;
+        return nullptr;
+    }
+
+    cookie_io_functions_t functions = {.read = readStream, .write = nullptr, .seek = seekStream, .close = closeStream};
+
+    return fopencookie(new fs::FileImplPtr(file), mode, functions);
+}
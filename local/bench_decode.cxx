@@ -0,0 +1,110 @@
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "Decoder.hxx"
+#include "FlacDecoder.hxx"
+#include "MadDecoder.hxx"
+#include "WavDecoder.hxx"
+
+using namespace std;
+
+namespace {
+
+constexpr uint32_t CHUNK_SAMPLES = 1024;
+constexpr uint32_t SAMPLES_PER_SECOND = 44100;
+constexpr uint32_t SEEKS = 64;
+
+int16_t buffer[2 * CHUNK_SAMPLES];
+
+MadDecoder madDecoder;
+WavDecoder wavDecoder;
+FlacDecoder flacDecoder;
+
+Decoder& decoderFor(const char* path) {
+    if (Decoder::hasExtension(path, "flac")) return flacDecoder;
+    if (Decoder::hasExtension(path, "wav") || Decoder::hasExtension(path, "pcm")) return wavDecoder;
+
+    return madDecoder;
+}
+
+// FLAC and WAV seek to the exact sample, compared against the samples of the full decode at SEEKS positions spread
+// over the stream. Returns the number of seeks that landed elsewhere or decoded different samples.
+uint32_t checkSeeks(Decoder& decoder, const char* path, const vector<int16_t>& reference) {
+    uint32_t sampleCount = reference.size() / 2;
+    uint32_t failed = 0;
+
+    for (uint32_t i = 0; i < SEEKS; i++) {
+        uint32_t target = static_cast<uint64_t>(sampleCount - 1) * (2 * i + 1) / (2 * SEEKS) + i;
+        if (target >= sampleCount) target = sampleCount - 1;
+
+        decoder.open(path);
+        decoder.seekToSample(target);
+
+        uint32_t landed = decoder.getStreamPosition();
+        uint32_t decoded = decoder.decode(buffer, CHUNK_SAMPLES);
+
+        decoder.close();
+
+        if (landed != target || decoded != min(CHUNK_SAMPLES, sampleCount - target) ||
+            memcmp(buffer, &reference[2 * target], 4 * decoded) != 0) {
+            cerr << path << ": seek to sample " << target << " landed at " << landed << endl;
+            failed++;
+        }
+    }
+
+    return failed;
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+    if (argc < 2) {
+        cerr << "usage: bench_decode <file.mp3|file.mp2|file.flac|file.wav> ..." << endl;
+
+        return 0;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        Decoder& decoder = decoderFor(argv[i]);
+        struct stat fstat;
+
+        if (stat(argv[i], &fstat) != 0 || !decoder.open(argv[i])) {
+            cerr << "ERROR: unable to open " << argv[i] << endl;
+
+            return 1;
+        }
+
+        auto start = chrono::steady_clock::now();
+
+        uint64_t sampleCount = 0;
+        bool exactSeek = &decoder != &madDecoder;
+        vector<int16_t> reference;
+
+        for (uint32_t decoded; (decoded = decoder.decode(buffer, CHUNK_SAMPLES)) > 0;) {
+            sampleCount += decoded;
+
+            if (exactSeek) reference.insert(reference.end(), buffer, buffer + 2 * decoded);
+        }
+
+        auto usec = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+        decoder.close();
+
+        if (sampleCount == 0) {
+            cerr << "ERROR: no samples decoded from " << argv[i] << endl;
+
+            return 1;
+        }
+
+        double seconds = static_cast<double>(sampleCount) / SAMPLES_PER_SECOND;
+
+        cout << argv[i] << ": " << (usec / seconds) << " usec decode time and " << (fstat.st_size / seconds / 1024)
+             << " KiB read per second of audio" << endl;
+
+        if (exactSeek && checkSeeks(decoder, argv[i], reference) > 0) return 1;
+    }
+}
@@ -0,0 +1,98 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "Equalizer.hxx"
+
+using namespace std;
+
+namespace {
+
+constexpr uint32_t CHUNK_SAMPLES = 256;
+constexpr uint32_t CHUNKS = 20000;
+constexpr uint32_t SAMPLES_PER_SECOND = 44100;
+constexpr int32_t FULL_VOLUME = 100;
+
+// 5% of the time a chunk plays at 240 MHz
+constexpr double CYCLE_BUDGET = 0.05 * CHUNK_SAMPLES / SAMPLES_PER_SECOND * 240e6;
+
+int16_t buffer[2 * CHUNK_SAMPLES];
+
+uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+double cyclesPerChunk(Equalizer& equalizer, int32_t volume) {
+    uint64_t elapsed = 0;
+
+    for (uint32_t chunk = 0; chunk < CHUNKS; chunk++) {
+        for (uint32_t i = 0; i < 2 * CHUNK_SAMPLES; i++) buffer[i] = (rand() & 0x3fff) - 0x2000;
+
+        uint64_t start = cycles();
+        equalizer.process(buffer, CHUNK_SAMPLES, volume);
+        elapsed += cycles() - start;
+    }
+
+    return static_cast<double>(elapsed) / CHUNKS;
+}
+
+// Gain in dB of a sine after it settled
+double response(Equalizer& equalizer, float frequency, int32_t volume) {
+    double phase = 0, in = 0, out = 0;
+
+    for (uint32_t chunk = 0; chunk < 200; chunk++) {
+        for (uint32_t i = 0; i < CHUNK_SAMPLES; i++) {
+            buffer[2 * i] = buffer[2 * i + 1] = lround(8000 * sin(phase));
+            phase += 2 * M_PI * frequency / SAMPLES_PER_SECOND;
+
+            if (chunk >= 100) in += static_cast<double>(buffer[2 * i]) * buffer[2 * i];
+        }
+
+        equalizer.process(buffer, CHUNK_SAMPLES, volume);
+
+        for (uint32_t i = 0; chunk >= 100 && i < CHUNK_SAMPLES; i++)
+            out += static_cast<double>(buffer[2 * i]) * buffer[2 * i];
+    }
+
+    return 10 * log10(out / in);
+}
+
+}  // namespace
+
+// Worst case cost per chunk of the speaker EQ with all bands and the loudness shelf, against the budget
+int main(int argc, const char** argv) {
+    Equalizer equalizer;
+    vector<Equalizer::Band> bands = {{.type = Equalizer::Band::lowShelf, .frequency = 150, .gain = 4, .q = 0.7f},
+                                     {.type = Equalizer::Band::peaking, .frequency = 400, .gain = -3, .q = 1.f},
+                                     {.type = Equalizer::Band::peaking, .frequency = 1500, .gain = 2, .q = 1.4f},
+                                     {.type = Equalizer::Band::peaking, .frequency = 4000, .gain = -2, .q = 2.f},
+                                     {.type = Equalizer::Band::highShelf, .frequency = 8000, .gain = 3, .q = 0.7f}};
+
+    equalizer.initialize(bands, 8);
+
+    double full = cyclesPerChunk(equalizer, 20);
+
+    for (float frequency : {50.f, 150.f, 400.f, 1000.f, 4000.f, 12000.f})
+        cout << frequency << " Hz: " << response(equalizer, frequency, 20) << " dB at volume 20, "
+             << response(equalizer, frequency, FULL_VOLUME) << " dB at full volume" << endl;
+
+    equalizer.initialize({{.type = Equalizer::Band::peaking, .frequency = 1000, .gain = 0, .q = 1.f}}, 0);
+
+    double bypassed = cyclesPerChunk(equalizer, 20);
+
+    cout << "6 biquads: " << full << " cycles per chunk (" << full / CHUNK_SAMPLES << " per sample), flat: " << bypassed
+         << " cycles per chunk, budget " << CYCLE_BUDGET << endl;
+
+    return full <= CYCLE_BUDGET ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "Command.hxx"
+#include "RfidMap.hxx"
+
+using namespace std;
+
+namespace {
+
+constexpr uint32_t CARDS = 10000;
+constexpr uint32_t SCANS = 200000;
+
+// Every tenth scan is a card that is not mapped
+constexpr uint32_t UNMAPPED_EVERY = 10;
+
+struct Card {
+    uint8_t bytes[RfidMap::Uid::MAX_SIZE];
+    uint8_t size;
+};
+
+uint64_t allocations = 0;
+
+uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Mixed 4, 7 and 10 byte UIDs
+Card randomCard(uint32_t i) {
+    static const uint8_t sizes[] = {4, 7, 10};
+    Card card = {.bytes = {}, .size = sizes[i % 3]};
+
+    for (uint8_t j = 0; j < card.size; j++) card.bytes[j] = rand();
+
+    return card;
+}
+
+// 7 byte UIDs with a sequential serial, as one batch of cards is issued and as the simulator issues them
+Card sequentialCard(uint32_t i) {
+    return {.bytes = {0x04, 0x5a, 0x00, static_cast<uint8_t>(i >> 24), static_cast<uint8_t>(i >> 16),
+                      static_cast<uint8_t>(i >> 8), static_cast<uint8_t>(i)},
+            .size = 7};
+}
+
+string format(const Card& card) {
+    char buffer[RfidMap::Uid::FORMATTED_SIZE];
+
+    RfidMap::Uid::fromBytes(card.bytes, card.size).format(buffer);
+
+    return buffer;
+}
+
+// The mapping as it was before: the UID formatted through a stream and looked up twice by string
+struct StringMap {
+    unordered_map<string, string> albums;
+
+    const string* scan(const Card& card) {
+        stringstream sstream;
+
+        for (uint8_t i = 0; i < card.size; i++) {
+            sstream << setw(2) << setfill('0') << hex << (int)card.bytes[i];
+            if (i != card.size - 1) sstream << ":";
+        }
+
+        string uid = sstream.str();
+
+        return albums.find(uid) != albums.end() ? &albums.at(uid) : nullptr;
+    }
+};
+
+template <typename Scan>
+void measure(const char* uids, const char* name, const vector<Card>& scans, Scan scan) {
+    uint32_t hits = 0;
+    uint64_t allocationsBefore = allocations;
+    uint64_t start = cycles();
+
+    for (const Card& card : scans)
+        if (scan(card)) hits++;
+
+    uint64_t elapsed = cycles() - start;
+
+    cout << uids << ", " << name << ": " << static_cast<double>(elapsed) / scans.size() << " cycles, "
+         << static_cast<double>(allocations - allocationsBefore) / scans.size() << " allocations per scan, " << hits
+         << " hits" << endl;
+}
+
+// CARDS mapped cards from makeCard, scanned along with cards that makeCard makes for higher numbers
+bool benchmark(const char* uids, Card (*makeCard)(uint32_t)) {
+    vector<Card> cards;
+    vector<string> albums;
+    size_t arenaSize = 0;
+
+    srand(1);
+
+    for (uint32_t i = 0; i < CARDS; i++) {
+        char album[32];
+        snprintf(album, sizeof(album), "Album %u", i);
+
+        cards.push_back(makeCard(i));
+        albums.emplace_back(album);
+        arenaSize += albums.back().size() + 1;
+    }
+
+    RfidMap rfidMap;
+    StringMap stringMap;
+
+    rfidMap.reset(CARDS, arenaSize);
+
+    // From the UIDs as they are written in config.json
+    for (uint32_t i = 0; i < CARDS; i++) {
+        string uid = format(cards[i]);
+        RfidMap::Uid parsed;
+
+        if (!(RfidMap::Uid::parse(uid.c_str(), parsed) &&
+              rfidMap.insert(parsed, Command::Command::play(albums[i].c_str())))) {
+            cerr << "ERROR: failed to map card " << uid << endl;
+            return false;
+        }
+
+        stringMap.albums.emplace(uid, albums[i]);
+    }
+
+    vector<Card> scans;
+
+    for (uint32_t i = 0; i < SCANS; i++)
+        scans.push_back(i % UNMAPPED_EVERY == 0 ? makeCard(CARDS + i) : cards[rand() % CARDS]);
+
+    measure(uids, "string map", scans, [&](const Card& card) { return stringMap.scan(card) != nullptr; });
+
+    measure(uids, "packed table", scans, [&](const Card& card) {
+        return rfidMap.find(RfidMap::Uid::fromBytes(card.bytes, card.size)) != nullptr;
+    });
+
+    return true;
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+    allocations++;
+
+    void* p = malloc(size);
+    if (!p) throw bad_alloc();
+
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// Scan to command lookup with CARDS mapped cards, the packed table against the former string map, for random UIDs
+// and for UIDs that differ only in their last bytes
+int main(int argc, const char** argv) {
+    if (!benchmark("random UIDs", randomCard)) return 1;
+    if (!benchmark("sequential UIDs", sequentialCard)) return 1;
+
+    return 0;
+}
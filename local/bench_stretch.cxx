@@ -0,0 +1,102 @@
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "Decoder.hxx"
+#include "FlacDecoder.hxx"
+#include "MadDecoder.hxx"
+#include "TimeStretch.hxx"
+#include "WavDecoder.hxx"
+
+using namespace std;
+
+namespace {
+
+constexpr uint32_t CHUNK_SAMPLES = 256;
+constexpr uint32_t SAMPLES_PER_SECOND = 44100;
+constexpr uint32_t SPEEDS[] = {80, 90, 125, 150};
+
+int16_t buffer[2 * CHUNK_SAMPLES];
+
+MadDecoder madDecoder;
+WavDecoder wavDecoder;
+FlacDecoder flacDecoder;
+
+Decoder& decoderFor(const char* path) {
+    if (Decoder::hasExtension(path, "flac")) return flacDecoder;
+    if (Decoder::hasExtension(path, "wav") || Decoder::hasExtension(path, "pcm")) return wavDecoder;
+
+    return madDecoder;
+}
+
+uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+}  // namespace
+
+// Decodes the file to RAM first, so only the time stretch itself is measured
+int main(int argc, const char** argv) {
+    if (argc < 2) {
+        cerr << "usage: bench_stretch <file.mp3|file.flac|file.wav> ..." << endl;
+
+        return 0;
+    }
+
+    TimeStretch stretch;
+    stretch.initialize();
+
+    for (int i = 1; i < argc; i++) {
+        Decoder& decoder = decoderFor(argv[i]);
+
+        if (!decoder.open(argv[i])) {
+            cerr << "ERROR: unable to open " << argv[i] << endl;
+
+            return 1;
+        }
+
+        vector<int16_t> pcm;
+        for (uint32_t decoded; (decoded = decoder.decode(buffer, CHUNK_SAMPLES)) > 0;)
+            pcm.insert(pcm.end(), buffer, buffer + 2 * decoded);
+
+        decoder.close();
+
+        for (uint32_t speed : SPEEDS) {
+            size_t position = 0;
+
+            auto source = [&](int16_t* target, uint32_t count) {
+                uint32_t n = min(static_cast<size_t>(count), pcm.size() / 2 - position);
+
+                memcpy(target, pcm.data() + 2 * position, 4 * n);
+                position += n;
+
+                return n;
+            };
+
+            stretch.setSpeed(speed);
+            stretch.reset();
+
+            uint64_t outputCount = 0;
+            uint64_t start = cycles();
+
+            for (uint32_t produced; (produced = stretch.process(buffer, CHUNK_SAMPLES, source)) > 0;)
+                outputCount += produced;
+
+            uint64_t elapsed = cycles() - start;
+
+            cout << argv[i] << " at " << speed << "%: " << static_cast<double>(elapsed) / outputCount
+                 << " cycles per output sample, " << static_cast<double>(outputCount) / SAMPLES_PER_SECOND
+                 << " s from " << static_cast<double>(pcm.size() / 2) / SAMPLES_PER_SECOND << " s" << endl;
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+
+#include "MadDecoder.hxx"
+
+using namespace std;
+
+namespace {
+
+constexpr uint32_t FIRST_CHUNK_SAMPLES = 256;
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+    if (argc < 2) {
+        cerr << "usage: bench_track_open [-n iterations] <file.mp3> ..." << endl;
+
+        return 0;
+    }
+
+    int iterations = 100;
+    int firstFile = 1;
+
+    if (argc > 3 && string(argv[1]) == "-n") {
+        iterations = atoi(argv[2]);
+        firstFile = 3;
+    }
+
+    int16_t buffer[2 * FIRST_CHUNK_SAMPLES];
+    MadDecoder decoder;
+
+    for (int i = firstFile; i < argc; i++) {
+        auto start = chrono::steady_clock::now();
+
+        for (int j = 0; j < iterations; j++) {
+            if (!decoder.open(argv[i])) {
+                cerr << "ERROR: unable to open " << argv[i] << endl;
+
+                return 1;
+            }
+
+            if (decoder.decode(buffer, FIRST_CHUNK_SAMPLES) != FIRST_CHUNK_SAMPLES) {
+                cerr << "ERROR: unable to decode first chunk of " << argv[i] << endl;
+
+                return 1;
+            }
+
+            decoder.close();
+        }
+
+        auto usec = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+        cout << argv[i] << ": " << (usec / iterations) << " usec to first chunk" << endl;
+    }
+}
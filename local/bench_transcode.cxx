@@ -0,0 +1,82 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "DirectoryPlayer.hxx"
+#include "MadDecoder.hxx"
+#include "WavDecoder.hxx"
+
+using namespace std;
+
+namespace {
+
+constexpr uint32_t CHUNK_SAMPLES = 1024;
+constexpr uint32_t SAMPLES_PER_SECOND = 44100;
+
+int16_t buffer[2 * CHUNK_SAMPLES];
+
+// Decodes the MP3 and writes the PCM file next to it, returns the sample count
+uint32_t transcode(const string& source, const string& target) {
+    MadDecoder decoder;
+
+    if (!decoder.open(source.c_str())) return 0;
+
+    FILE* out = fopen(target.c_str(), "w");
+    if (!out) return 0;
+
+    uint32_t sampleCount = 0;
+    WavDecoder::writeHeader(out, 0);
+
+    for (uint32_t decoded; (decoded = decoder.decode(buffer, CHUNK_SAMPLES)) > 0; sampleCount += decoded)
+        fwrite(buffer, 4, decoded, out);
+
+    WavDecoder::writeHeader(out, sampleCount);
+    fclose(out);
+
+    return sampleCount;
+}
+
+template <typename T>
+double usecPerSecond(T& decoder, const char* path, uint32_t sampleCount) {
+    auto start = chrono::steady_clock::now();
+
+    if (!decoder.open(path)) return -1;
+    while (decoder.decode(buffer, CHUNK_SAMPLES) > 0)
+        ;
+    decoder.close();
+
+    auto usec = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+    return static_cast<double>(usec) * SAMPLES_PER_SECOND / sampleCount;
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+    if (argc < 2) {
+        cerr << "usage: bench_transcode <file.mp3> ..." << endl;
+
+        return 0;
+    }
+
+    MadDecoder mp3Decoder;
+    WavDecoder wavDecoder;
+
+    for (int i = 1; i < argc; i++) {
+        string target = DirectoryPlayer::transcodedPath(argv[i]);
+        uint32_t sampleCount = transcode(argv[i], target);
+
+        if (sampleCount == 0) {
+            cerr << "ERROR: unable to transcode " << argv[i] << endl;
+
+            return 1;
+        }
+
+        double mp3 = usecPerSecond(mp3Decoder, argv[i], sampleCount);
+        double wav = usecPerSecond(wavDecoder, target.c_str(), sampleCount);
+
+        cout << argv[i] << ": mp3 " << mp3 << " usec, pcm " << wav << " usec per second of audio" << endl;
+    }
+}
@@ -0,0 +1,360 @@
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <pthread.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "probe.h"
+
+struct QueueDefinition {
+    QueueDefinition(UBaseType_t length, UBaseType_t itemSize)
+        : length(length), itemSize(itemSize), storage(length * itemSize) {}
+
+    const uint32_t length;
+    const uint32_t itemSize;
+
+    std::vector<uint8_t> storage;
+    uint32_t head{0};
+    uint32_t count{0};
+
+    uint64_t sent{0};
+    uint64_t received{0};
+
+    std::string name;
+    Probe::QueueCallback onSend;
+    Probe::QueueCallback onReceive;
+
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+};
+
+struct TaskControl {
+    TaskControl(const char* name, UBaseType_t priority) : name(name), priority(priority) {}
+
+    const std::string name;
+    const UBaseType_t priority;
+
+    uint32_t value{0};
+    bool pending{false};
+
+    std::mutex mutex;
+    std::condition_variable notified;
+};
+
+namespace {
+
+const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+std::mutex registryMutex;
+std::vector<QueueHandle_t> registry;
+
+thread_local TaskControl* currentTask = nullptr;
+
+template <typename Predicate>
+bool waitFor(std::condition_variable& condition, std::unique_lock<std::mutex>& lock, TickType_t ticks,
+             Predicate predicate) {
+    if (ticks == portMAX_DELAY) {
+        condition.wait(lock, predicate);
+
+        return true;
+    }
+
+    return condition.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), predicate);
+}
+
+TaskControl* current() {
+    // Threads that were not created as a task, e.g. main, get a control block on first use
+    if (!currentTask) currentTask = new TaskControl("main", 1);
+
+    return currentTask;
+}
+
+}  // namespace
+
+uint64_t Probe::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+int64_t esp_timer_get_time() { return Probe::now(); }
+
+QueueHandle_t Probe::findQueue(const char* name) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    for (QueueHandle_t queue : registry)
+        if (queue->name == name) return queue;
+
+    return nullptr;
+}
+
+Probe::QueueState Probe::queueState(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+
+    return {.waiting = queue->count, .length = queue->length, .sent = queue->sent, .received = queue->received};
+}
+
+void Probe::onQueueSend(QueueHandle_t queue, const QueueCallback& callback) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+
+    queue->onSend = callback;
+}
+
+void Probe::onQueueReceive(QueueHandle_t queue, const QueueCallback& callback) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+
+    queue->onReceive = callback;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) { return new QueueDefinition(length, itemSize); }
+
+void vQueueDelete(QueueHandle_t queue) {
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+
+        for (auto i = registry.begin(); i != registry.end(); i++)
+            if (*i == queue) {
+                registry.erase(i);
+                break;
+            }
+    }
+
+    delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+    uint64_t sequence;
+    Probe::QueueCallback callback;
+
+    {
+        std::unique_lock<std::mutex> lock(queue->mutex);
+
+        if (!waitFor(queue->notFull, lock, ticksToWait, [queue]() { return queue->count < queue->length; }))
+            return pdFALSE;
+
+        if (queue->itemSize > 0)
+            memcpy(&queue->storage[(queue->head + queue->count) % queue->length * queue->itemSize], item,
+                   queue->itemSize);
+
+        queue->count++;
+        sequence = queue->sent++;
+        callback = queue->onSend;
+    }
+
+    queue->notEmpty.notify_one();
+
+    if (callback) callback(sequence);
+
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait) {
+    uint64_t sequence;
+    Probe::QueueCallback callback;
+
+    {
+        std::unique_lock<std::mutex> lock(queue->mutex);
+
+        if (!waitFor(queue->notEmpty, lock, ticksToWait, [queue]() { return queue->count > 0; })) return pdFALSE;
+
+        if (queue->itemSize > 0) memcpy(item, &queue->storage[queue->head * queue->itemSize], queue->itemSize);
+
+        sequence = queue->sent - queue->count;
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        queue->received++;
+        callback = queue->onReceive;
+    }
+
+    queue->notFull.notify_one();
+
+    if (callback) callback(sequence);
+
+    return pdTRUE;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t ticksToWait) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+
+    if (!waitFor(queue->notEmpty, lock, ticksToWait, [queue]() { return queue->count > 0; })) return pdFALSE;
+
+    if (queue->itemSize > 0) memcpy(item, &queue->storage[queue->head * queue->itemSize], queue->itemSize);
+
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+
+        queue->head = queue->count = 0;
+    }
+
+    queue->notFull.notify_all();
+
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+
+    return queue->length - queue->count;
+}
+
+void vQueueAddToRegistry(QueueHandle_t queue, const char* name) {
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+
+        queue->name = name;
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    registry.push_back(queue);
+}
+
+const char* pcQueueGetName(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+
+    return queue->name.empty() ? nullptr : queue->name.c_str();
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() { return xQueueCreate(1, 0); }
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+
+    xSemaphoreGive(mutex);
+
+    return mutex;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameters,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    TaskControl* task = new TaskControl(name, priority);
+
+    if (handle) *handle = task;
+
+    std::thread([function, parameters, task]() {
+        currentTask = task;
+        function(parameters);
+
+        fprintf(stderr, "task %s returned without deleting itself\n", task->name.c_str());
+    }).detach();
+
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stackDepth, parameters, priority, handle, 0);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task && task != currentTask) {
+        fprintf(stderr, "deleting task %s from another task is not supported\n", task->name.c_str());
+        return;
+    }
+
+    // Other tasks may still hold the handle, so the control block is kept
+    pthread_exit(nullptr);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount() { return Probe::now() / 1000 / portTICK_PERIOD_MS; }
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return current(); }
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+
+        switch (action) {
+            case eNoAction:
+                break;
+
+            case eSetBits:
+                task->value |= value;
+                break;
+
+            case eIncrement:
+                task->value++;
+                break;
+
+            case eSetValueWithOverwrite:
+                task->value = value;
+                break;
+
+            case eSetValueWithoutOverwrite:
+                if (task->pending) return pdFAIL;
+
+                task->value = value;
+                break;
+        }
+
+        task->pending = true;
+    }
+
+    task->notified.notify_all();
+
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action,
+                              BaseType_t* higherPriorityWoken) {
+    if (higherPriorityWoken) *higherPriorityWoken = pdFALSE;
+
+    return xTaskNotify(task, value, action);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t* value, TickType_t ticksToWait) {
+    TaskControl* task = current();
+    std::unique_lock<std::mutex> lock(task->mutex);
+
+    if (!task->pending) task->value &= ~clearOnEntry;
+
+    bool received = waitFor(task->notified, lock, ticksToWait, [task]() { return task->pending; });
+
+    if (value) *value = task->value;
+
+    if (!received) return pdFALSE;
+
+    task->value &= ~clearOnExit;
+    task->pending = false;
+
+    return pdTRUE;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) { return xTaskNotify(task, 0, eIncrement); }
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait) {
+    TaskControl* task = current();
+    std::unique_lock<std::mutex> lock(task->mutex);
+
+    waitFor(task->notified, lock, ticksToWait, [task]() { return task->value > 0; });
+
+    uint32_t value = task->value;
+
+    if (value > 0) task->value = clearOnExit ? 0 : value - 1;
+    task->pending = false;
+
+    return value;
+}
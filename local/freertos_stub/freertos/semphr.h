@@ -0,0 +1,16 @@
+#ifndef FREERTOS_SEMPHR_H
+#define FREERTOS_SEMPHR_H
+
+#include "queue.h"
+
+// Like FreeRTOS, semaphores are queues without payload. Mutexes do not inherit priorities.
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateMutex();
+
+#define xSemaphoreTake(semaphore, ticksToWait) xQueueReceive((semaphore), nullptr, (ticksToWait))
+#define xSemaphoreGive(semaphore) xQueueSend((semaphore), nullptr, 0)
+#define vSemaphoreDelete(semaphore) vQueueDelete(semaphore)
+
+#endif  // FREERTOS_SEMPHR_H
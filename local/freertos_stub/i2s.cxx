@@ -0,0 +1,250 @@
+#include <driver/i2s.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "probe.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Only I2S_NUM_0 is implemented
+struct Port {
+    bool installed{false};
+    bool running{false};
+
+    // Incremented by start and stop, so the DMA thread drops the buffer it is waiting for
+    uint32_t generation{0};
+
+    uint32_t rate{0};
+    uint32_t bufferFrames{0};
+
+    // The DMA buffers that are not playing, interleaved stereo
+    std::vector<int16_t> ring;
+    uint32_t capacity{0};
+    uint32_t head{0};
+    uint32_t count{0};
+
+    // The DMA clock counts buffers since the last start
+    Clock::time_point epoch;
+    uint64_t epochTime{0};
+    uint64_t clock{0};
+    uint64_t writtenSinceStart{0};
+
+    uint64_t written{0};
+    uint64_t played{0};
+
+    // Written but zeroed before they were played
+    uint64_t dropped{0};
+    uint32_t underruns{0};
+    uint64_t silence{0};
+
+    Probe::I2sCallback callback;
+
+    std::mutex mutex;
+    std::condition_variable space;
+    std::condition_variable wake;
+};
+
+Port port;
+
+uint64_t framesToMicroseconds(uint64_t frames) { return frames * 1000000ULL / port.rate; }
+
+// Takes the next DMA buffer at the start of its period, which frees the space of the buffer that just finished
+void dmaTask() {
+    std::vector<int16_t> buffer;
+    std::unique_lock<std::mutex> lock(port.mutex);
+
+    while (true) {
+        port.wake.wait(lock, []() { return port.running; });
+
+        uint32_t generation = port.generation;
+        Clock::time_point start = port.epoch + std::chrono::microseconds(framesToMicroseconds(port.clock));
+
+        if (port.wake.wait_until(lock, start, [generation]() { return port.generation != generation; })) continue;
+
+        buffer.assign(2 * port.bufferFrames, 0);
+
+        uint32_t valid = std::min(port.count, port.bufferFrames);
+
+        for (uint32_t i = 0; i < valid; i++)
+            memcpy(&buffer[2 * i], &port.ring[2 * ((port.head + i) % port.capacity)], 4);
+
+        port.head = (port.head + valid) % port.capacity;
+        port.count -= valid;
+
+        // Silence before the first write after a start is not an underrun, the stream has not started yet
+        if (valid < port.bufferFrames && port.writtenSinceStart > 0) {
+            port.underruns++;
+            port.silence += port.bufferFrames - valid;
+        }
+
+        Probe::I2sBuffer played = {.samples = buffer.data(),
+                                   .frames = port.bufferFrames,
+                                   .first = port.played + port.dropped,
+                                   .valid = valid,
+                                   .start = port.epochTime + framesToMicroseconds(port.clock)};
+
+        port.played += valid;
+        port.clock += port.bufferFrames;
+
+        Probe::I2sCallback callback = port.callback;
+
+        lock.unlock();
+        port.space.notify_all();
+
+        if (callback) callback(played);
+
+        lock.lock();
+    }
+}
+
+}  // namespace
+
+Probe::I2sState Probe::i2sState() {
+    std::lock_guard<std::mutex> lock(port.mutex);
+
+    return {.running = port.running,
+            .buffered = port.count,
+            .written = port.written,
+            .played = port.played,
+            .underruns = port.underruns,
+            .silence = port.silence};
+}
+
+void Probe::onI2sPlay(const I2sCallback& callback) {
+    std::lock_guard<std::mutex> lock(port.mutex);
+
+    port.callback = callback;
+}
+
+esp_err_t i2s_driver_install(i2s_port_t i2sPort, const i2s_config_t* config, int queueSize, void* queue) {
+    if (i2sPort != I2S_NUM_0 || config->bits_per_sample != I2S_BITS_PER_SAMPLE_16BIT || config->dma_buf_count < 2 ||
+        config->dma_buf_len <= 0)
+        return ESP_ERR_INVALID_ARG;
+
+    std::lock_guard<std::mutex> lock(port.mutex);
+
+    if (port.installed) return ESP_ERR_INVALID_STATE;
+
+    port.installed = true;
+    port.running = true;
+    port.rate = config->sample_rate;
+    port.bufferFrames = config->dma_buf_len;
+
+    // One more buffer is always playing
+    port.capacity = (config->dma_buf_count - 1) * config->dma_buf_len;
+    port.ring.assign(2 * port.capacity, 0);
+
+    port.epoch = Clock::now();
+    port.epochTime = Probe::now();
+
+    std::thread(dmaTask).detach();
+
+    return ESP_OK;
+}
+
+esp_err_t i2s_driver_uninstall(i2s_port_t i2sPort) { return ESP_ERR_INVALID_STATE; }
+
+esp_err_t i2s_set_pin(i2s_port_t i2sPort, const i2s_pin_config_t* pins) {
+    return i2sPort == I2S_NUM_0 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2s_set_clk(i2s_port_t i2sPort, uint32_t rate, i2s_bits_per_sample_t bits, i2s_channel_t channels) {
+    if (i2sPort != I2S_NUM_0 || bits != I2S_BITS_PER_SAMPLE_16BIT || channels != I2S_CHANNEL_STEREO)
+        return ESP_ERR_INVALID_ARG;
+
+    std::lock_guard<std::mutex> lock(port.mutex);
+
+    port.rate = rate;
+
+    return ESP_OK;
+}
+
+esp_err_t i2s_start(i2s_port_t i2sPort) {
+    if (i2sPort != I2S_NUM_0) return ESP_ERR_INVALID_ARG;
+
+    {
+        std::lock_guard<std::mutex> lock(port.mutex);
+
+        port.running = true;
+        port.generation++;
+        port.epoch = Clock::now();
+        port.epochTime = Probe::now();
+        port.clock = 0;
+        port.writtenSinceStart = 0;
+    }
+
+    port.wake.notify_all();
+
+    return ESP_OK;
+}
+
+esp_err_t i2s_stop(i2s_port_t i2sPort) {
+    if (i2sPort != I2S_NUM_0) return ESP_ERR_INVALID_ARG;
+
+    {
+        std::lock_guard<std::mutex> lock(port.mutex);
+
+        port.running = false;
+        port.generation++;
+    }
+
+    port.wake.notify_all();
+
+    return ESP_OK;
+}
+
+esp_err_t i2s_zero_dma_buffer(i2s_port_t i2sPort) {
+    if (i2sPort != I2S_NUM_0) return ESP_ERR_INVALID_ARG;
+
+    {
+        std::lock_guard<std::mutex> lock(port.mutex);
+
+        port.dropped += port.count;
+        port.head = port.count = 0;
+    }
+
+    port.space.notify_all();
+
+    return ESP_OK;
+}
+
+esp_err_t i2s_write(i2s_port_t i2sPort, const void* source, size_t size, size_t* bytesWritten, TickType_t ticksToWait) {
+    if (i2sPort != I2S_NUM_0) return ESP_ERR_INVALID_ARG;
+
+    const int16_t* samples = static_cast<const int16_t*>(source);
+    uint32_t frames = size / 4;
+    uint32_t done = 0;
+
+    std::unique_lock<std::mutex> lock(port.mutex);
+
+    auto hasSpace = []() { return port.count < port.capacity; };
+
+    while (done < frames) {
+        if (ticksToWait == portMAX_DELAY)
+            port.space.wait(lock, hasSpace);
+        else if (!port.space.wait_for(lock, std::chrono::milliseconds(ticksToWait * portTICK_PERIOD_MS), hasSpace))
+            break;
+
+        uint32_t n = std::min(frames - done, port.capacity - port.count);
+
+        for (uint32_t i = 0; i < n; i++)
+            memcpy(&port.ring[2 * ((port.head + port.count + i) % port.capacity)], samples + 2 * (done + i), 4);
+
+        port.count += n;
+        port.written += n;
+        port.writtenSinceStart += n;
+        done += n;
+    }
+
+    if (bytesWritten) *bytesWritten = 4 * done;
+
+    return done == frames ? ESP_OK : ESP_ERR_TIMEOUT;
+}
@@ -0,0 +1,70 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <freertos/queue.h>
+
+#include <cstdint>
+#include <functional>
+
+// Host only: observes the queues and the I2S port of the stubs while the firmware runs on top of them
+namespace Probe {
+
+// Microseconds since the start of the process, all times of the probes use this clock
+uint64_t now();
+
+struct QueueState {
+    uint32_t waiting;
+    uint32_t length;
+
+    // Items that have ever been sent / received, items dropped by a reset are never received
+    uint64_t sent;
+    uint64_t received;
+};
+
+// Called by the thread that sent / received the item after the operation, sequence counts the items sent
+using QueueCallback = std::function<void(uint64_t sequence)>;
+
+// nullptr if no queue was registered under this name
+QueueHandle_t findQueue(const char* name);
+
+QueueState queueState(QueueHandle_t queue);
+
+void onQueueSend(QueueHandle_t queue, const QueueCallback& callback);
+void onQueueReceive(QueueHandle_t queue, const QueueCallback& callback);
+
+struct I2sState {
+    bool running;
+
+    // Frames waiting in the DMA buffers
+    uint32_t buffered;
+
+    uint64_t written;
+    uint64_t played;
+
+    // DMA buffers that were not filled in time and the frames of silence that were played instead
+    uint32_t underruns;
+    uint64_t silence;
+};
+
+struct I2sBuffer {
+    const int16_t* samples;
+    uint32_t frames;
+
+    // The first valid frames are from i2s_write, counted from the first frame ever written. The rest is silence.
+    uint64_t first;
+    uint32_t valid;
+
+    // When the DMA started to play the buffer
+    uint64_t start;
+};
+
+// Called by the I2S thread for every DMA buffer it plays
+using I2sCallback = std::function<void(const I2sBuffer& buffer)>;
+
+I2sState i2sState();
+
+void onI2sPlay(const I2sCallback& callback);
+
+}  // namespace Probe
+
+#endif  // PROBE_H
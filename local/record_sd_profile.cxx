@@ -0,0 +1,109 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "fs/FaultProfile.h"
+
+using namespace std;
+
+namespace {
+
+// Small reads mostly measure the latency of the card, large ones its bandwidth
+constexpr uint32_t READ_SIZES[] = {512, 4096, 32768};
+constexpr uint32_t ALIGNMENT = 4096;
+
+uint8_t* buffer;
+
+uint64_t now() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// O_DIRECT bypasses the page cache of the host, without it the cached pages are dropped first
+int openUncached(const char* path) {
+    int fd = open(path, O_RDONLY | O_DIRECT);
+
+    if (fd < 0) {
+        fd = open(path, O_RDONLY);
+
+        if (fd >= 0) posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    return fd;
+}
+
+bool measure(const char* path, vector<FaultProfile::Measurement>& measurements) {
+    int fd = openUncached(path);
+
+    if (fd < 0) return false;
+
+    for (uint32_t i = 0;; i++) {
+        uint32_t size = READ_SIZES[i % (sizeof(READ_SIZES) / sizeof(READ_SIZES[0]))];
+
+        uint64_t start = now();
+        ssize_t bytesRead = read(fd, buffer, size);
+        uint64_t latency = now() - start;
+
+        if (bytesRead <= 0) break;
+
+        measurements.push_back({.bytes = static_cast<uint32_t>(bytesRead), .latency = static_cast<uint32_t>(latency)});
+    }
+
+    close(fd);
+
+    return true;
+}
+
+}  // namespace
+
+// Reads files from a card in a card reader sequentially, like the decoders, and writes the timing as a FaultProfile
+int main(int argc, const char** argv) {
+    if (argc < 3) {
+        cerr << "usage: record_sd_profile <profile> <file on the card> ..." << endl
+             << endl
+             << "Large files that have not been read since the card was inserted give the most honest timing." << endl
+             << "Other binaries read like the card with SD_PROFILE=<profile>." << endl;
+
+        return 0;
+    }
+
+    if (posix_memalign(reinterpret_cast<void**>(&buffer), ALIGNMENT, *max_element(begin(READ_SIZES), end(READ_SIZES))))
+        return 1;
+
+    vector<FaultProfile::Measurement> measurements;
+
+    for (int i = 2; i < argc; i++)
+        if (!measure(argv[i], measurements)) {
+            cerr << "ERROR: unable to read " << argv[i] << endl;
+
+            return 1;
+        }
+
+    FaultProfile profile;
+    profile.record(measurements);
+
+    if (!profile.save(argv[1])) {
+        cerr << "ERROR: unable to write " << argv[1] << endl;
+
+        return 1;
+    }
+
+    const vector<uint32_t>& latencies = profile.getLatencies();
+
+    cout << measurements.size() << " reads: " << profile.getBandwidth() / 1024 << " KiB/s";
+
+    if (!latencies.empty())
+        cout << ", latency median " << latencies[latencies.size() / 2] << " us, max " << latencies.back() << " us";
+
+    if (profile.getStallInterval() > 0)
+        cout << ", " << profile.getStallDuration() << " ms stalls every " << profile.getStallInterval() << " ms";
+
+    cout << endl;
+
+    free(buffer);
+}
@@ -0,0 +1,112 @@
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Decoder.hxx"
+#include "DirectoryReader.hxx"
+#include "FlacDecoder.hxx"
+#include "Loudness.hxx"
+#include "MadDecoder.hxx"
+#include "WavDecoder.hxx"
+
+using namespace std;
+
+namespace {
+
+constexpr uint32_t CHUNK_SAMPLES = 1024;
+constexpr uint32_t SAMPLES_PER_SECOND = 44100;
+
+int16_t buffer[2 * CHUNK_SAMPLES];
+
+MadDecoder madDecoder;
+WavDecoder wavDecoder;
+FlacDecoder flacDecoder;
+
+Decoder& decoderFor(const char* path) {
+    if (Decoder::hasExtension(path, "flac")) return flacDecoder;
+    if (Decoder::hasExtension(path, "wav") || Decoder::hasExtension(path, "pcm")) return wavDecoder;
+
+    return madDecoder;
+}
+
+uint64_t samplesFor(uint32_t milliseconds) { return static_cast<uint64_t>(milliseconds) * SAMPLES_PER_SECOND / 1000; }
+
+// Virtual tracks only cover the part of their file between start and end
+bool analyzeTrack(const string& path, const DirectoryReader::TrackInfo& track, Loudness& loudness) {
+    Decoder& decoder = decoderFor(path.c_str());
+
+    if (!decoder.open(path.c_str())) return false;
+
+    uint64_t remaining = track.end > track.start ? samplesFor(track.end - track.start) : UINT64_MAX;
+
+    if (track.start > 0) decoder.seekToSample(samplesFor(track.start));
+
+    for (uint32_t decoded; remaining > 0 && (decoded = decoder.decode(buffer, CHUNK_SAMPLES)) > 0;) {
+        if (decoded > remaining) decoded = remaining;
+
+        loudness.add(buffer, decoded);
+        remaining -= decoded;
+    }
+
+    decoder.close();
+
+    return true;
+}
+
+}  // namespace
+
+// Measures the loudness of each track and album and stores the gains in the album index, so the
+// player normalizes the volume without analyzing anything itself
+int main(int argc, const char** argv) {
+    if (argc < 2) {
+        cerr << "usage: scan_loudness <album directory> ..." << endl;
+
+        return 0;
+    }
+
+    Loudness trackLoudness(SAMPLES_PER_SECOND);
+    Loudness albumLoudness(SAMPLES_PER_SECOND);
+
+    for (int i = 1; i < argc; i++) {
+        DirectoryReader reader;
+
+        if (!reader.open(argv[i])) {
+            cerr << "ERROR: unable to open " << argv[i] << endl;
+
+            return 1;
+        }
+
+        vector<int16_t> trackGains(reader.getLength());
+        albumLoudness.reset();
+
+        for (uint32_t j = 0; j < reader.getLength(); j++) {
+            const DirectoryReader::TrackInfo* track = reader.getTrackInfo(j);
+            string path = string(argv[i]) + "/" + track->name;
+
+            trackLoudness.reset();
+
+            if (!analyzeTrack(path, *track, trackLoudness)) {
+                cerr << "ERROR: unable to open " << path << endl;
+
+                return 1;
+            }
+
+            trackGains[j] = trackLoudness.gain();
+            albumLoudness.add(trackLoudness);
+
+            cout << path << " (" << track->start << " ms): " << trackLoudness.integrated() << " LUFS, gain "
+                 << trackGains[j] / 100. << " dB" << endl;
+        }
+
+        cout << argv[i] << ": " << albumLoudness.integrated() << " LUFS, gain " << albumLoudness.gain() / 100. << " dB"
+             << endl;
+
+        if (!reader.writeGains(argv[i], trackGains.data(), albumLoudness.gain())) {
+            cerr << "ERROR: unable to write the index of " << argv[i] << endl;
+
+            return 1;
+        }
+    }
+}
@@ -0,0 +1,553 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Audio.hxx"
+#include "Button.hxx"
+#include "CommandBus.hxx"
+#include "Command.hxx"
+#include "Config.hxx"
+#include "Gpio.hxx"
+#include "Power.hxx"
+#include "RfidMap.hxx"
+#include "Telemetry.hxx"
+#include "Watchdog.hxx"
+#include "config.h"
+#include "net/Net.hxx"
+#include "probe.h"
+
+using namespace std;
+
+// Runs the audio task on top of the FreeRTOS stubs against a virtual I2S port that plays in real time.
+// Scripted button presses and RFID scans are timed from the press / scan until the change can be heard.
+
+void Gpio::enableAmp() {}
+
+bool Power::isResumeFromSleep() { return false; }
+
+void Power::dbgSetVoltage(uint32_t) {}
+
+void Watchdog::notify() {}
+
+void Net::start() {}
+
+void Net::stop() {}
+
+namespace {
+
+constexpr uint32_t SAMPLE_INTERVAL_MS = 10;
+constexpr uint32_t DEFAULT_HOLD_MS = 100;
+constexpr uint32_t TAIL_MS = 2000;
+constexpr uint64_t NOT_YET = UINT64_MAX;
+
+// Every album in the script has a card with a 7 byte UID, it is mapped if the album exists
+class SimulatedConfig : public Config {
+   public:
+    void issueCards(const vector<string>& albums) {
+        size_t arenaSize = 0;
+
+        for (const string& album : albums) arenaSize += album.size() + 1;
+
+        rfidMap.reset(albums.size(), arenaSize);
+
+        for (const string& album : albums) {
+            uint32_t serial = cards.size();
+            uint8_t bytes[] = {0x04, 0x5a, 0x00, static_cast<uint8_t>(serial >> 24), static_cast<uint8_t>(serial >> 16),
+                               static_cast<uint8_t>(serial >> 8), static_cast<uint8_t>(serial)};
+            RfidMap::Uid uid = RfidMap::Uid::fromBytes(bytes, sizeof(bytes));
+            struct stat info;
+
+            if (!cards.emplace(album, uid).second) continue;
+
+            if (stat(Audio::directoryForAlbum(album.c_str()).c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+                rfidMap.insert(uid, Command::Command::play(album.c_str()));
+        }
+    }
+
+    RfidMap::Uid card(const string& album) const { return cards.at(album); }
+
+    const Command::Command* commandForRfid(const RfidMap::Uid& uid) override { return rfidMap.find(uid); }
+
+    const RfidMap& rfidMappings() override { return rfidMap; }
+
+    const vector<string>& transcodeAlbums() override { return transcode; }
+
+    uint32_t playbackSpeed(const string&) override { return 100; }
+
+    const vector<Equalizer::Band>& equalizerBands() override { return bands; }
+
+    float loudnessCompensation() override { return 0; }
+
+   private:
+    RfidMap rfidMap;
+    unordered_map<string, RfidMap::Uid> cards;
+    vector<string> transcode;
+    vector<Equalizer::Band> bands;
+};
+
+struct Event {
+    uint32_t time;
+    string name;
+    string argument;
+
+    uint8_t buttonMask;
+    uint32_t hold;
+
+    // Microseconds, NOT_YET until the event got that far
+    uint64_t triggered{NOT_YET};
+    uint64_t dispatched{NOT_YET};
+    uint64_t handled{NOT_YET};
+    uint64_t dequeued{NOT_YET};
+    uint64_t audible{NOT_YET};
+
+    // When the command was issued, the first chunk rendered after it and the first frame of that chunk
+    uint64_t command{NOT_YET};
+    uint64_t chunk{NOT_YET};
+    uint64_t frame{NOT_YET};
+};
+
+struct Sample {
+    uint64_t time;
+    uint32_t queued;
+    uint32_t buffered;
+    uint32_t underruns;
+    bool running;
+};
+
+SimulatedConfig config;
+
+vector<Event> events;
+vector<Sample> timeline;
+
+// Guards the events while the hooks run in the tasks
+mutex traceMutex;
+vector<size_t> awaitingDispatch;
+
+atomic<uint32_t> stallMs{0};
+atomic<uint32_t> stateChanges{0};
+atomic<bool> finished{false};
+
+atomic<uint8_t> pins{0};
+TaskHandle_t gpioTaskHandle;
+
+// Same as the hardware buttons, without the power off
+Button buttons[] = {
+    Button(BTN_PAUSE_MASK, []() { Audio::togglePause(); }),
+    Button(BTN_VOLUME_DOWN_MASK, BTN_VOLUME_REPEAT, []() { Audio::volumeDown(); }),
+    Button(BTN_VOLUME_UP_MASK, BTN_VOLUME_REPEAT, []() { Audio::volumeUp(); }),
+    Button(
+        BTN_PREVIOUS_MASK, []() { Audio::previous(); }, BTN_REWIND_DELAY, []() { Audio::rewind(); }),
+    Button(BTN_NEXT_MASK, BTN_NEXT_REPEAT, []() { Audio::next(); }),
+};
+
+uint8_t buttonMaskFor(const string& name) {
+    if (name == "pause") return BTN_PAUSE_MASK;
+    if (name == "volume_down") return BTN_VOLUME_DOWN_MASK;
+    if (name == "volume_up") return BTN_VOLUME_UP_MASK;
+    if (name == "previous") return BTN_PREVIOUS_MASK;
+    if (name == "next") return BTN_NEXT_MASK;
+
+    return 0;
+}
+
+void gpioTask(void*) {
+    while (true) {
+        uint64_t timestamp = Probe::now() / 1000;
+
+        uint32_t timeout = Button::NEVER;
+        for (const Button& button : buttons) timeout = min(timeout, button.delayToNextNotification(timestamp));
+
+        uint32_t value;
+        bool pendingInterrupt = xTaskNotifyWait(0x0, 0x0, &value, timeout) == pdTRUE;
+
+        timestamp = Probe::now() / 1000;
+
+        if (pendingInterrupt)
+            for (Button& button : buttons) button.updateState(pins, timestamp);
+
+        for (Button& button : buttons) button.notify(timestamp);
+    }
+}
+
+void handleRfid(const string& album) {
+    const Command::Command* command = config.commandForRfid(config.card(album));
+
+    if (command)
+        Command::dispatch(*command);
+    else
+        Audio::signalError();
+}
+
+// Repeated presses also post commands, they are not attributed to an event. Neither are commands merged into a
+// pending one.
+void onCommandPosted(const AudioCommand& command) {
+    lock_guard<mutex> lock(traceMutex);
+
+    if (awaitingDispatch.empty()) return;
+
+    Event& event = events[awaitingDispatch.front()];
+
+    event.dispatched = Probe::now();
+    event.command = command.issued;
+
+    awaitingDispatch.erase(awaitingDispatch.begin());
+}
+
+// Runs in the audio task, so the next chunk it sends is the first one that reflects the command
+void onCommandReceived(const AudioCommand& command) {
+    uint64_t nextChunk = Probe::queueState(Probe::findQueue("audio")).sent;
+
+    lock_guard<mutex> lock(traceMutex);
+
+    for (Event& event : events)
+        if (event.command == static_cast<uint64_t>(command.issued)) {
+            event.handled = Probe::now();
+            event.chunk = nextChunk;
+        }
+}
+
+// Also runs in the audio task, right after a chunk was queued
+void onChunkSent(uint64_t) {
+    uint32_t stall = stallMs.exchange(0);
+
+    if (stall > 0) this_thread::sleep_for(chrono::milliseconds(stall));
+}
+
+// Runs in the I2S task before the chunk is written, so the frames written so far precede it
+void onChunkReceived(uint64_t sequence) {
+    uint64_t written = Probe::i2sState().written;
+
+    lock_guard<mutex> lock(traceMutex);
+
+    for (Event& event : events)
+        if (event.chunk == sequence) {
+            event.dequeued = Probe::now();
+            event.frame = written;
+        }
+}
+
+void onI2sPlay(const Probe::I2sBuffer& buffer) {
+    lock_guard<mutex> lock(traceMutex);
+
+    for (Event& event : events)
+        if (event.audible == NOT_YET && event.frame != NOT_YET && event.frame < buffer.first + buffer.valid)
+            event.audible = buffer.start + (event.frame - min(event.frame, buffer.first)) * 1000000ULL / SAMPLE_RATE;
+}
+
+void sample() {
+    Probe::QueueState queue = Probe::queueState(Probe::findQueue("audio"));
+    Probe::I2sState i2s = Probe::i2sState();
+    uint64_t now = Probe::now();
+
+    lock_guard<mutex> lock(traceMutex);
+
+    timeline.push_back({.time = now,
+                        .queued = queue.waiting,
+                        .buffered = i2s.buffered,
+                        .underruns = i2s.underruns,
+                        .running = i2s.running});
+
+    // A chunk that pauses stops I2S instead of being written, the pause is audible right away
+    for (Event& event : events)
+        if (event.audible == NOT_YET && event.dequeued != NOT_YET && now > event.dequeued + 1000 && !i2s.running &&
+            i2s.written <= event.frame)
+            event.audible = event.dequeued;
+}
+
+void sampleTask() {
+    auto next = chrono::steady_clock::now();
+
+    while (!finished) {
+        sample();
+
+        next += chrono::milliseconds(SAMPLE_INTERVAL_MS);
+        this_thread::sleep_until(next);
+    }
+}
+
+bool readScript(const char* path) {
+    ifstream script(path);
+
+    if (!script) {
+        cerr << "ERROR: unable to open " << path << endl;
+        return false;
+    }
+
+    string line;
+
+    for (uint32_t number = 1; getline(script, line); number++) {
+        line = line.substr(0, line.find('#'));
+
+        istringstream fields(line);
+        Event event;
+
+        if (!(fields >> event.time)) continue;
+
+        if (!(fields >> event.name)) {
+            cerr << "ERROR: line " << number << " has no event" << endl;
+            return false;
+        }
+
+        fields >> event.argument;
+
+        event.buttonMask = buttonMaskFor(event.name);
+        event.hold = event.argument.empty() ? DEFAULT_HOLD_MS : strtoul(event.argument.c_str(), nullptr, 10);
+
+        if (!event.buttonMask && event.name != "rfid" && event.name != "stall" && event.name != "stop" &&
+            event.name != "end") {
+            cerr << "ERROR: line " << number << " has an unknown event " << event.name << endl;
+            return false;
+        }
+
+        events.push_back(event);
+    }
+
+    stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.time < b.time; });
+
+    return true;
+}
+
+string formatInterval(uint64_t from, uint64_t to) {
+    if (from == NOT_YET || to == NOT_YET) return "-";
+
+    ostringstream formatted;
+    formatted << fixed << setprecision(1) << (to - from) / 1000.0;
+
+    return formatted.str();
+}
+
+void report() {
+    lock_guard<mutex> lock(traceMutex);
+
+    cout << "event                      at ms  dispatch  handled  audible    total" << endl;
+
+    for (const Event& event : events) {
+        if (event.name == "stall" || event.name == "end") continue;
+
+        cout << left << setw(24) << (event.name + " " + event.argument).substr(0, 23) << right << setw(8)
+             << event.time << setw(10) << formatInterval(event.triggered, event.dispatched) << setw(9)
+             << formatInterval(event.dispatched, event.handled) << setw(9)
+             << formatInterval(event.handled, event.audible) << setw(9)
+             << formatInterval(event.triggered, event.audible) << endl;
+    }
+
+    cout << "(milliseconds from the press or scan to the command, to the audio task, to the speaker and in total)"
+         << endl;
+
+    vector<uint32_t> histogram(PLAYBACK_QUEUE_SIZE + 1);
+    uint64_t total = 0, count = 0;
+    uint32_t minimum = PLAYBACK_QUEUE_SIZE;
+
+    for (const Sample& sample : timeline) {
+        if (!sample.running) continue;
+
+        histogram[min(sample.queued, static_cast<uint32_t>(PLAYBACK_QUEUE_SIZE))]++;
+        total += sample.queued;
+        minimum = min(minimum, sample.queued);
+        count++;
+    }
+
+    cout << endl << "audio queue while playing, " << count << " samples: ";
+
+    if (count > 0) {
+        cout << "min " << minimum << ", mean " << fixed << setprecision(2) << static_cast<double>(total) / count
+             << " of " << PLAYBACK_QUEUE_SIZE << endl;
+
+        for (uint32_t depth = 0; depth <= PLAYBACK_QUEUE_SIZE; depth++)
+            cout << "  " << depth << ": " << setw(5) << setprecision(1) << 100.0 * histogram[depth] / count << "% "
+                 << string(50 * histogram[depth] / count, '#') << endl;
+    } else {
+        cout << "-" << endl;
+    }
+
+    Probe::I2sState i2s = Probe::i2sState();
+
+    cout << "I2S: " << i2s.played << " frames played, " << i2s.underruns << " underruns, " << fixed
+         << setprecision(1) << i2s.silence * 1000.0 / SAMPLE_RATE << " ms of silence" << endl;
+
+    // What the firmware itself reports. It counts episodes where the I2S stub counts silent DMA buffers, but the
+    // silence should match.
+    Telemetry::Snapshot telemetry = Telemetry::snapshot();
+
+    cout << "telemetry: " << telemetry.underruns << " underruns, " << telemetry.underrunFrames * 1000.0 / SAMPLE_RATE
+         << " ms of silence, " << telemetry.lateChunks << " of " << telemetry.chunks << " chunks late, render max "
+         << telemetry.maxRenderTime << " us, track switch max " << telemetry.maxTrackSwitchTime << " us, "
+         << telemetry.decoderErrors << " decoder errors, command latency max " << telemetry.maxCommandLatency
+         << " us" << endl
+         << "jitter buffer: " << telemetry.bufferDepth << " of " << telemetry.bufferTarget << " blocks, max target "
+         << telemetry.maxBufferTarget << ", ran dry " << telemetry.bufferUnderruns << " times" << endl;
+
+    // Host cycles, the time stamp counter on x86
+    cout << "graph cycles per chunk:";
+
+    for (uint32_t i = 0; i < telemetry.nodeCount; i++)
+        cout << (i > 0 ? "," : "") << " " << telemetry.nodes[i].name << " " << telemetry.nodes[i].cycles << " (max "
+             << telemetry.nodes[i].maxCycles << ")";
+
+    cout << endl;
+
+    Audio::PlaybackState playback = Audio::playbackState();
+
+    cout << "playback state: " << stateChanges << " changes pushed, album '" << Audio::albumName(playback.album)
+         << "' track " << playback.track << " at " << playback.position * 1000.0 / SAMPLE_RATE << " ms, volume "
+         << playback.volume << (playback.paused ? ", paused" : "") << endl;
+}
+
+void writeTimeline(ofstream& file) {
+    lock_guard<mutex> lock(traceMutex);
+
+    file << "ms,audio_queue,dma_frames,underruns,running" << endl;
+
+    for (const Sample& sample : timeline)
+        file << sample.time / 1000 << "," << sample.queued << "," << sample.buffered << "," << sample.underruns << ","
+             << sample.running << endl;
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+    if (argc < 3) {
+        cerr << "usage: simulate_audio <sd card directory> <script> [timeline.csv]" << endl
+             << endl
+             << "Script lines are '<ms> <event> [argument]':" << endl
+             << "  pause | volume_down | volume_up | previous | next [hold ms]" << endl
+             << "  rfid <album>   scans a card that is mapped to the album if it exists" << endl
+             << "  stall <ms>     delays the audio task once, a slow SD card only delays the decoder (see below)"
+             << endl
+             << "  stop           shuts the audio task down" << endl
+             << "  end            ends the simulation, by default " << TAIL_MS << " ms after the last event" << endl
+             << endl
+             << "Bookmarks and the decoder snapshot are written to the SD card directory. With SD_PROFILE=<profile>"
+             << endl
+             << "it reads like the card the profile was recorded from." << endl;
+
+        return 0;
+    }
+
+    if (!readScript(argv[2])) return 1;
+
+    ofstream timelineFile;
+
+    if (argc > 3) {
+        timelineFile.open(argv[3]);
+
+        if (!timelineFile) {
+            cerr << "ERROR: unable to write " << argv[3] << endl;
+            return 1;
+        }
+    }
+
+    if (chdir(argv[1]) != 0) {
+        cerr << "ERROR: unable to change to " << argv[1] << endl;
+        return 1;
+    }
+
+    vector<string> albums;
+
+    for (const Event& event : events)
+        if (event.name == "rfid") albums.push_back(event.argument);
+
+    config.issueCards(albums);
+
+    Audio::initialize(config);
+    Audio::setStateListener([]() { stateChanges++; });
+
+    CommandBus::trace(onCommandPosted, onCommandReceived);
+    Probe::onQueueSend(Probe::findQueue("audio"), onChunkSent);
+    Probe::onQueueReceive(Probe::findQueue("audio"), onChunkReceived);
+    Probe::onI2sPlay(onI2sPlay);
+
+    Audio::start(false);
+
+    xTaskCreatePinnedToCore(gpioTask, "gpio", STACK_SIZE_GPIO, NULL, TASK_PRIORITY_GPIO, &gpioTaskHandle,
+                            SERVICE_CORE);
+
+    thread sampler(sampleTask);
+
+    // Presses and releases in the order of time
+    vector<pair<uint32_t, size_t>> actions;
+
+    for (size_t i = 0; i < events.size(); i++) {
+        actions.push_back({events[i].time, i});
+
+        if (events[i].buttonMask) actions.push_back({events[i].time + events[i].hold, i});
+    }
+
+    stable_sort(actions.begin(), actions.end(),
+                [](const pair<uint32_t, size_t>& a, const pair<uint32_t, size_t>& b) { return a.first < b.first; });
+
+    uint32_t end = actions.empty() ? TAIL_MS : actions.back().first + TAIL_MS;
+    auto start = chrono::steady_clock::now();
+
+    for (const auto& action : actions) {
+        this_thread::sleep_until(start + chrono::milliseconds(action.first));
+
+        Event& event = events[action.second];
+
+        if (event.name == "end") {
+            end = event.time;
+            break;
+        }
+
+        if (event.buttonMask) {
+            bool press = event.triggered == NOT_YET;
+
+            if (press) {
+                lock_guard<mutex> lock(traceMutex);
+
+                event.triggered = Probe::now();
+                awaitingDispatch.push_back(action.second);
+            }
+
+            pins = press ? pins | event.buttonMask : pins & ~event.buttonMask;
+            xTaskNotify(gpioTaskHandle, 0, eNoAction);
+
+            continue;
+        }
+
+        if (event.name == "stall") {
+            stallMs = event.hold;
+            continue;
+        }
+
+        {
+            lock_guard<mutex> lock(traceMutex);
+
+            event.triggered = Probe::now();
+            awaitingDispatch.push_back(action.second);
+        }
+
+        if (event.name == "rfid") handleRfid(event.argument);
+        if (event.name == "stop") Audio::stop();
+    }
+
+    this_thread::sleep_until(start + chrono::milliseconds(end));
+
+    finished = true;
+    sampler.join();
+
+    report();
+
+    if (timelineFile.is_open()) writeTimeline(timelineFile);
+
+    cout.flush();
+
+    // The tasks never return, so nothing may be destroyed under them
+    quick_exit(0);
+}
@@ -0,0 +1,82 @@
+#include "AlbumNames.hxx"
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "Log.hxx"
+
+#define TAG "albums"
+
+AlbumNames::~AlbumNames() {
+    if (arena) free(arena);
+
+    delete[] names;
+    delete[] published;
+}
+
+bool AlbumNames::initialize(uint32_t capacity, size_t arenaSize) {
+    if (names) return true;
+
+    // IDs are 16 bit and start at 1
+    capacity = std::min(capacity + SPARE_NAMES, static_cast<uint32_t>(std::numeric_limits<Id>::max()));
+    arenaSize += SPARE_BYTES;
+
+    arena = static_cast<char*>(ps_malloc(arenaSize));
+    if (!arena) arena = static_cast<char*>(malloc(arenaSize));
+
+    if (!arena) {
+        LOG_ERROR(TAG, "failed to allocate %u bytes for album names", static_cast<unsigned>(arenaSize));
+        return false;
+    }
+
+    names = new const char*[capacity];
+    published = new std::atomic<bool>[capacity];
+
+    for (uint32_t i = 0; i < capacity; i++) published[i].store(false, std::memory_order_relaxed);
+
+    this->arenaSize = arenaSize;
+    this->capacity = capacity;
+
+    return true;
+}
+
+AlbumNames::Id AlbumNames::intern(const char* name) {
+    Id id = find(name);
+
+    if (id != NONE) return id;
+
+    uint32_t index = claimed.fetch_add(1, std::memory_order_relaxed);
+    size_t length = strlen(name) + 1;
+
+    if (index >= capacity) return NONE;
+
+    size_t offset = arenaUsed.fetch_add(length, std::memory_order_relaxed);
+
+    // The slot stays unpublished, so it is skipped by lookups
+    if (offset + length > arenaSize) return NONE;
+
+    memcpy(arena + offset, name, length);
+    names[index] = arena + offset;
+
+    published[index].store(true, std::memory_order_release);
+
+    return index + 1;
+}
+
+const char* AlbumNames::name(Id id) const {
+    if (id == NONE || id > capacity || !published[id - 1].load(std::memory_order_acquire)) return "";
+
+    return names[id - 1];
+}
+
+AlbumNames::Id AlbumNames::find(const char* name) const {
+    uint32_t count = std::min(claimed.load(std::memory_order_relaxed), capacity);
+
+    for (uint32_t i = 0; i < count; i++)
+        if (published[i].load(std::memory_order_acquire) && strcmp(names[i], name) == 0) return i + 1;
+
+    return NONE;
+}
@@ -0,0 +1,63 @@
+#ifndef ALBUM_NAMES_HXX
+#define ALBUM_NAMES_HXX
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Interns album names, so commands and the playback state can refer to an album by a small ID instead of copying
+ * its name around. Names are only ever added and stay valid forever, so the table is sized once for every album
+ * that can be played. Interning and lookups are lock free and can be done by any task, two tasks interning the same
+ * new name at once may get different IDs for it.
+ */
+class AlbumNames {
+   public:
+    using Id = uint16_t;
+
+    // No album, also returned when the table is full
+    static constexpr Id NONE = 0;
+
+    // On top of the albums the table is sized for, for one that is restored after sleep but no longer mapped
+    static constexpr uint32_t SPARE_NAMES = 4;
+    static constexpr size_t SPARE_BYTES = 1024;
+
+   public:
+    AlbumNames() = default;
+
+    ~AlbumNames();
+
+    // For up to capacity names of arenaSize bytes in total, before the table is shared. Nothing is interned before.
+    bool initialize(uint32_t capacity, size_t arenaSize);
+
+    Id intern(const char* name);
+
+    // The empty string for NONE and unknown IDs
+    const char* name(Id id) const;
+
+   private:
+    Id find(const char* name) const;
+
+   private:
+    char* arena{nullptr};
+    size_t arenaSize{0};
+    std::atomic<size_t> arenaUsed{0};
+
+    const char** names{nullptr};
+    std::atomic<bool>* published{nullptr};
+    uint32_t capacity{0};
+
+    // May exceed the capacity, interning past it fails
+    std::atomic<uint32_t> claimed{0};
+
+   private:
+    AlbumNames(const AlbumNames&) = delete;
+
+    AlbumNames(AlbumNames&&) = delete;
+
+    AlbumNames& operator=(const AlbumNames&) = delete;
+
+    AlbumNames& operator=(AlbumNames&&) = delete;
+};
+
+#endif  // ALBUM_NAMES_HXX
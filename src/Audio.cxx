@@ -4,37 +4,76 @@
 #include <freertos/FreeRTOS.h>
 // clang-format on
 
+#include <Arduino.h>
 #include <driver/i2s.h>
+#include <esp_timer.h>
 #include <freertos/queue.h>
 #include <freertos/semphr.h>
 #include <freertos/task.h>
 
 #include <atomic>
+#include <cstdio>
 #include <cstring>
 
+#include "AlbumNames.hxx"
+#include "AudioGraph.hxx"
+#include "Bookmarks.hxx"
+#include "CommandBus.hxx"
+#include "Config.hxx"
 #include "DirectoryPlayer.hxx"
+#include "Equalizer.hxx"
+#include "Gain.hxx"
 #include "Gpio.hxx"
+#include "JitterBuffer.hxx"
 #include "Lock.hxx"
 #include "Log.hxx"
+#include "Mixer.hxx"
+#include "PcmCache.hxx"
 #include "Power.hxx"
+#include "Seqlock.hxx"
 #include "Signal.hxx"
+#include "Telemetry.hxx"
+#include "TimeStretch.hxx"
 #include "Watchdog.hxx"
-#include "net/Server.hxx"
 
 #define TAG "audio"
 
-#define COMMAND_QUEUE_SIZE 3
 #define I2S_NUM I2S_NUM_0
+#define DMA_BUFFER_COUNT 4
+#define DMA_BUFFER_LENGTH 256
+#define SNAPSHOT_FILE SD_MOUNT_POINT "/snapshot"
+#define BOOKMARK_FILE SD_MOUNT_POINT "/bookmarks"
 
 namespace {
 
 struct Chunk {
     bool paused;
-    bool clearDmaBufferOnResume;
+
+    // Incremented by every jump, the I2S task drops chunks from an older epoch
+    uint32_t epoch;
+
+    // When the first command this chunk reflects was issued in esp_timer time, 0 if none
+    int64_t issued;
 
     int16_t samples[PLAYBACK_CHUNK_SIZE / 2];
 };
 
+static_assert(Gain::CROSSFADE_SAMPLES <= PLAYBACK_CHUNK_SIZE / 4, "crossfade does not fit into a chunk");
+static_assert(JitterBuffer::BLOCK_SAMPLES == PLAYBACK_CHUNK_SIZE / 4, "a chunk is rendered from whole blocks");
+static_assert(AudioGraph::BLOCK_SAMPLES == PLAYBACK_CHUNK_SIZE / 4, "a chunk is one block of the graph");
+static_assert(Equalizer::MAX_SAMPLES >= PLAYBACK_CHUNK_SIZE / 4, "chunk does not fit into the equalizer");
+
+// microseconds
+constexpr int64_t DMA_DURATION = static_cast<int64_t>(DMA_BUFFER_COUNT * DMA_BUFFER_LENGTH) * 1000000 / SAMPLE_RATE;
+
+// microseconds, copying a chunk into free DMA buffers is much faster
+constexpr int64_t I2S_WRITE_WAIT = 100;
+
+constexpr uint32_t JITTER_BUFFER_CAPACITY = JITTER_BUFFER_MS * (SAMPLE_RATE / 1000) / JitterBuffer::BLOCK_SAMPLES;
+
+// The audio task waits this long per queued chunk for a block that is still being decoded before it renders silence
+constexpr TickType_t DECODER_WAIT = Telemetry::CHUNK_DEADLINE / 1000 / portTICK_PERIOD_MS;
+
 struct State {
     int32_t volume;
 
@@ -42,6 +81,9 @@ struct State {
     uint32_t track;
     size_t position;
 
+    // The decoder snapshot in SNAPSHOT_FILE belongs to this track
+    bool hasSnapshot;
+
     void setAlbum(const char* album) { strncpy(this->album, album, 255); }
 
     void clearAlbum() { album[0] = 0; }
@@ -53,6 +95,7 @@ struct State {
             this->volume = state.volume;
             this->track = state.track;
             this->position = state.position;
+            this->hasSnapshot = state.hasSnapshot;
 
             setAlbum(state.album);
         }
@@ -61,43 +104,82 @@ struct State {
     }
 };
 
-struct Command {
-    enum Type : uint8_t {
-        cmdTogglePause,
-        cmdVolumeDown,
-        cmdVolumeUp,
-        cmdPrevious,
-        cmdNext,
-        cmdRewind,
-        cmdPlay,
-        cmdSignalError,
-        cmdSignalCommandReceived
-    };
-
-    Type type;
-    char album[256];
-
-    Command(Type type) : type(type) {}
-    Command() {}
+CommandBus commands;
+AlbumNames albumNames;
 
-    void setAlbum(const char* album) { strncpy(this->album, album, 255); }
-};
-
-QueueHandle_t commandQueue;
 QueueHandle_t audioQueue;
+TaskHandle_t audioTaskHandle{nullptr};
 
 bool silentStart;
 std::atomic<bool> paused;
 std::atomic<bool> shutdown;
-bool clearDmaBufferOnResume = false;
+std::atomic<uint32_t> epoch{0};
+bool cpuClockedDown = false;
 int32_t volume = VOLLUME_DEFAULT;
 
+// Only used by the audio task, it copies the state to RTC memory when it shuts down
 State state;
 RTC_SLOW_ATTR State persistentState;
+
+// Whoever sets this first writes the persistent state, the audio task or Audio::stop once it gave up waiting for it
+std::atomic<bool> statePersisted{false};
+
+// The interned album of the state
+AlbumNames::Id stateAlbum = AlbumNames::NONE;
+
+Seqlock<Audio::PlaybackState> publishedState(
+    {.album = AlbumNames::NONE, .paused = true, .track = 0, .position = 0, .volume = VOLLUME_DEFAULT});
+Audio::PlaybackState lastPublished = publishedState.read();
+std::atomic<Audio::StateListener> stateListener{nullptr};
+
+// Guards the track info, which other tasks copy
+Audio::TrackInfo trackInfo;
+const DirectoryReader::TrackInfo* trackInfoSource{nullptr};
 SemaphoreHandle_t stateMutex;
+SemaphoreHandle_t shutdownDone;
+
+// Guards the player, the time stretch, the PCM cache recording and the producer side of the jitter buffer. The
+// decoder task holds it for one block at a time, commands that jump take it to flush the buffer.
+SemaphoreHandle_t playerMutex;
+
+// The decoder task fills the jitter buffer while this is set, guarded by playerMutex
+bool decoding = false;
+std::atomic<bool> decodingPcm;
+
+// The tag of the last block that has been played, only used by the audio task
+JitterBuffer::Tag audible;
 
 Signal signal;
 DirectoryPlayer player;
+JitterBuffer jitterBuffer;
+PcmCache pcmCache(PCM_CACHE_BUDGET, SAMPLE_RATE / 1000 * PCM_CACHE_ENTRY_MS);
+Bookmarks bookmarks(BOOKMARK_FILE, BOOKMARK_CAPACITY, BOOKMARK_JOURNAL_LIMIT);
+TimeStretch timeStretch;
+Gain gain;
+Equalizer equalizer;
+AudioGraph graph;
+Config* config;
+
+Chunk* playbackChunk;
+
+// The first command since the last chunk, the next chunk carries it to the I2S task for the latency telemetry
+int64_t commandIssued = 0;
+
+/**
+ * Writing a chunk returns as soon as it has been copied into the DMA buffers, so stopping right after the fade-out
+ * would cut it off and play it on the next start. Silence is written until the fade-out has left the buffers, one
+ * more buffer than there are makes sure the one playing it has finished, and is dropped once I2S has been stopped.
+ */
+void drainAndStop() {
+    static const int16_t silence[2 * DMA_BUFFER_LENGTH] = {};
+    size_t bytesWritten;
+
+    for (uint32_t i = 0; i < DMA_BUFFER_COUNT + 1; i++)
+        i2s_write(I2S_NUM, silence, sizeof(silence), &bytesWritten, portMAX_DELAY);
+
+    i2s_stop(I2S_NUM);
+    i2s_zero_dma_buffer(I2S_NUM);
+}
 
 void i2sStreamTask(void* payload) {
     Chunk* chunk = new Chunk();
@@ -106,158 +188,661 @@ void i2sStreamTask(void* payload) {
     size_t bytes_written;
     bool wasPaused = true;
 
+    // The epoch of the samples in the DMA buffers
+    uint32_t dmaEpoch = epoch;
+
+    // When the DMA buffers run out of samples in esp_timer time, 0 until the first write after a start
+    int64_t dryAt = 0;
+
     while (true) {
         xQueueReceive(*queue, chunk, portMAX_DELAY);
 
-        if (chunk->paused && !wasPaused) i2s_stop(I2S_NUM);
+        // The audio task may be waiting for space
+        xTaskNotifyGive(audioTaskHandle);
 
-        if (!chunk->paused && wasPaused) {
-            if (chunk->clearDmaBufferOnResume) i2s_zero_dma_buffer(I2S_NUM);
+        // The audio task has dropped the chunks queued after this one when it jumped
+        if (chunk->epoch != epoch) continue;
+
+        if (chunk->paused && !wasPaused) drainAndStop();
+
+        wasPaused = wasPaused || chunk->paused;
+
+        if (chunk->paused) continue;
+
+        int64_t now = esp_timer_get_time();
+
+        // The DMA clears the buffers it has played, so it has been playing silence since dryAt
+        if (!wasPaused && dryAt > 0 && now > dryAt) Telemetry::recordUnderrun((now - dryAt) * SAMPLE_RATE / 1000000);
+
+        // The DMA buffers still hold the old position after a jump, they are cleared rather than played out
+        if (chunk->epoch != dmaEpoch) {
+            if (!wasPaused) i2s_stop(I2S_NUM);
+            i2s_zero_dma_buffer(I2S_NUM);
+
+            wasPaused = true;
+            dmaEpoch = chunk->epoch;
+        }
+
+        if (wasPaused) {
             i2s_start(I2S_NUM);
+
+            wasPaused = false;
+            dryAt = 0;
         }
 
-        wasPaused = chunk->paused;
+        // The chunk can be heard once the buffers ahead of it have been played
+        if (chunk->issued > 0) Telemetry::recordCommandLatency(std::max(now, dryAt) - chunk->issued);
+
+        i2s_write(I2S_NUM, chunk->samples, PLAYBACK_CHUNK_SIZE, &bytes_written, portMAX_DELAY);
 
-        if (!chunk->paused) i2s_write(I2S_NUM, chunk->samples, PLAYBACK_CHUNK_SIZE, &bytes_written, portMAX_DELAY);
+        int64_t written = esp_timer_get_time();
+
+        // A write that had to wait returns as soon as the DMA has freed a buffer, so all buffers are full again.
+        // This keeps the estimate from drifting away from the sample clock.
+        if (written - now > I2S_WRITE_WAIT)
+            dryAt = written + DMA_DURATION;
+        else
+            dryAt = std::min(std::max(dryAt, now) + Telemetry::CHUNK_DEADLINE, written + DMA_DURATION);
     }
 }
 
+/**
+ * Must be called by the audio task after the state changed. Only a change of anything but the position is passed
+ * on to the listener, unless it is forced.
+ */
+void publishState(bool force = false) {
+    Audio::PlaybackState current = {.album = stateAlbum,
+                                    .paused = paused,
+                                    .track = audible.track,
+                                    .position = audible.trackPosition,
+                                    .volume = volume};
+
+    bool changed = current.album != lastPublished.album || current.paused != lastPublished.paused ||
+                   current.track != lastPublished.track || current.volume != lastPublished.volume;
+
+    publishedState.write(current);
+    lastPublished = current;
+
+    Audio::StateListener listener = stateListener.load(std::memory_order_acquire);
+
+    if ((changed || force) && listener) listener();
+}
+
 void setPaused(bool _paused) {
     if (paused == _paused) return;
 
     paused = _paused;
 
-    HTTPServer::sendUpdate();
+    publishState();
 }
 
+// Drops the queued audio of the old position, the I2S task skips the chunk it may already hold and clears the DMA
+// buffers before it plays the new position
 void resetAudio() {
-    if (paused) {
-        clearDmaBufferOnResume = true;
-        xQueueReset(audioQueue);
-    }
+    epoch++;
+    xQueueReset(audioQueue);
 }
 
-void setVolume(int32_t newVolume) {
-    Lock lock(stateMutex);
+// Must be called by the audio task
+void stampChunk(Chunk* chunk) {
+    chunk->epoch = epoch;
+    chunk->issued = commandIssued;
+
+    commandIssued = 0;
+}
+
+// Must be called by the audio task
+bool jumpPending() { return commands.jumpPending(); }
 
+// The cache records the decoder output, so a cached album can be replayed at any speed
+uint32_t decodeFromPlayer(int16_t* buffer, uint32_t count) {
+    uint32_t decoded = player.decode(buffer, count);
+
+    pcmCache.record(buffer, decoded);
+
+    return decoded;
+}
+
+void setVolume(int32_t newVolume) {
     state.volume = volume = newVolume;
 
-    HTTPServer::sendUpdate();
+    publishState();
 }
 
-void updatePlaybackState() {
-    Lock lock(stateMutex);
+// Must be called with stateMutex held. The metadata comes from the album index, so this does not touch the SD.
+void updateTrackInfo(const DirectoryReader::TrackInfo* info) {
+    trackInfoSource = info;
+
+    trackInfo.title = info ? info->title : "";
+    trackInfo.artist = info ? info->artist : "";
+    trackInfo.album = info ? info->album : "";
+    trackInfo.duration = info ? info->duration : 0;
 
-    uint32_t oldTrack = state.track;
+    // The album gain keeps the relative loudness of the tracks of an album
+    int16_t normalization = info ? (info->albumGain != DirectoryReader::NO_GAIN ? info->albumGain : info->trackGain)
+                                 : DirectoryReader::NO_GAIN;
+
+    gain.setNormalization(normalization != DirectoryReader::NO_GAIN ? normalization : 0);
+}
 
-    state.track = player.getTrack();
-    state.position = player.getSeekPosition();
+// Only touches RAM, the journal is flushed while playback does not need the SD
+void updateBookmark() {
+    if (!state.hasAlbum()) return;
 
-    if (state.track != oldTrack) HTTPServer::sendUpdate();
+    bookmarks.update(state.album, audible.track, audible.trackPosition);
 }
 
-std::string directoryForAlbum(const char* album) { return std::string("/sdcard/music/") + std::string(album); }
+/**
+ * The state follows what is heard rather than the decoder, which runs ahead by the depth of the jitter buffer. This
+ * runs after every block, so the mutex is only taken when the track changes.
+ */
+void updatePlaybackState(const JitterBuffer::Tag& tag) {
+    bool trackChanged = tag.track != state.track;
 
-void play(const char* album) {
+    // The index may only be read after playback started from the PCM cache
+    bool infoChanged = tag.info != trackInfoSource;
+
+    audible = tag;
+    state.track = tag.track;
+    state.position = tag.position;
+
+    if (trackChanged) updateBookmark();
+
+    if (trackChanged || infoChanged) {
+        Lock lock(stateMutex);
+
+        updateTrackInfo(tag.info);
+    }
+
+    publishState(infoChanged);
+}
+
+// Must be called with playerMutex held
+JitterBuffer::Tag playerTag() {
+    return {.track = player.getTrack(),
+            .position = player.getSeekPosition(),
+            .trackPosition = player.getTrackPosition(),
+            .info = player.getTrackInfo(),
+            .end = false};
+}
+
+/**
+ * The decoder state does not fit into RTC memory, so it goes to the SD and only a flag is kept in the RTC state.
+ * The decoder is ahead of what is heard, so the decoded blocks in between go along with it. Must be called with
+ * playerMutex held.
+ */
+void saveSnapshot() {
+    state.hasSnapshot = false;
+
+    // The blocks in between have to belong to the track that is restored, and writing them must not hold up the
+    // shutdown
+    if (!player.isValid() || player.getTrack() != state.track || jitterBuffer.getDepth() > SNAPSHOT_MAX_BLOCKS)
+        return;
+
+    FILE* file = fopen(SNAPSHOT_FILE, "w");
+
+    if (!file) {
+        LOG_WARN(TAG, "failed to open %s", SNAPSHOT_FILE);
+        return;
+    }
+
+    bool saved = player.saveSnapshot(file) && fwrite(&audible, sizeof(audible), 1, file) == 1 &&
+                 jitterBuffer.save(file);
+    state.hasSnapshot = (fclose(file) == 0) && saved;
+
+    if (!state.hasSnapshot) remove(SNAPSHOT_FILE);
+
+    LOG_DEBUG(TAG, "decoder snapshot %s", state.hasSnapshot ? "saved" : "not available");
+}
+
+// Must be called with the track from the state opened, before the decoder task starts
+bool restoreSnapshot() {
+    if (!state.hasSnapshot) return false;
+
+    state.hasSnapshot = false;
+
+    FILE* file = fopen(SNAPSHOT_FILE, "r");
+
+    if (!file) return false;
+
+    bool restored = player.restoreSnapshot(file) && fread(&audible, sizeof(audible), 1, file) == 1 &&
+                    jitterBuffer.restore(file, player.getTrackInfo());
+
+    fclose(file);
+    remove(SNAPSHOT_FILE);
+
+    if (!restored) {
+        LOG_WARN(TAG, "failed to restore decoder snapshot");
+
+        jitterBuffer.flush();
+    }
+
+    audible.info = player.getTrackInfo();
+
+    return restored;
+}
+
+bool pauseI2s() { return (paused && !signal.isActive()) || shutdown; }
+
+// Plays at the speed of the album
+uint32_t decodeTrack(int16_t* buffer, uint32_t count) {
+    return timeStretch.isActive() ? timeStretch.process(buffer, count, decodeFromPlayer)
+                                  : decodeFromPlayer(buffer, count);
+}
+
+// Must be called with playerMutex held. The next track is opened while decoding, so a block that crosses the end
+// of a track times the switch.
+void decodeBlock() {
+    JitterBuffer::Block& block = jitterBuffer.back();
+
+    int64_t start = esp_timer_get_time();
+    uint32_t track = player.getTrack();
+    bool end = !player.isValid();
+
+    block.count = 0;
+
+    while (!end && block.count < JitterBuffer::BLOCK_SAMPLES) {
+        uint32_t decoded = decodeTrack(block.samples + 2 * block.count, JitterBuffer::BLOCK_SAMPLES - block.count);
+        block.count += decoded;
+
+        if (player.isFinished() && timeStretch.isDrained()) {
+            pcmCache.stopRecording();
+            timeStretch.reset();
+            player.rewind();
+
+            end = true;
+        } else if (decoded == 0) {
+            break;
+        }
+    }
+
+    // The audio task pauses once it has played the last block
+    block.tag = playerTag();
+    block.tag.end = end;
+
+    if (end) decoding = false;
+    decodingPcm = player.isPlayingPcm();
+
+    jitterBuffer.push();
+
+    uint32_t renderTime = esp_timer_get_time() - start;
+
+    Telemetry::recordRenderTime(renderTime);
+    Telemetry::recordDecoderErrors(player.getDecoderErrors());
+
+    if (player.getTrack() != track) Telemetry::recordTrackSwitch(renderTime);
+}
+
+void decoderTask_() {
+    while (true) {
+        bool decoded = false;
+
+        {
+            Lock lock(playerMutex);
+
+            if (decoding && jitterBuffer.hasSpace()) {
+                decodeBlock();
+                decoded = true;
+            }
+        }
+
+        if (!decoded) jitterBuffer.waitForSpace();
+    }
+}
+
+void decoderTask(void* payload) {
+    decoderTask_();
+    vTaskDelete(NULL);
+}
+
+// Waiting is free while the queue still has chunks to play, unless a jump is about to drop them
+bool waitForDecoder() {
+    UBaseType_t slices = std::max(uxQueueMessagesWaiting(audioQueue), static_cast<UBaseType_t>(1));
+
+    for (UBaseType_t i = 0; i < slices && !jumpPending(); i++)
+        if (jitterBuffer.waitForData(DECODER_WAIT)) return true;
+
+    return false;
+}
+
+class Music : public Mixer::Source {
+   public:
+    bool isActive() const override { return !paused; }
+
+    uint32_t render(int16_t* buffer, uint32_t count) override {
+        uint32_t samplesRendered = 0;
+
+        while (samplesRendered < count && isActive()) {
+            JitterBuffer::Tag played;
+            bool completed;
+
+            uint32_t samplesRead = jitterBuffer.read(buffer + 2 * samplesRendered, count - samplesRendered, played,
+                                                     completed);
+            samplesRendered += samplesRead;
+
+            if (completed) updatePlaybackState(played);
+
+            if (completed && played.end) {
+                setPaused(true);
+
+                updateBookmark();
+                bookmarks.flush();
+            } else if (samplesRead == 0 && !completed && !waitForDecoder()) {
+                // The rest of the chunk stays silent rather than holding up commands and signals
+                if (!jumpPending()) {
+                    jitterBuffer.reportUnderrun();
+                    Telemetry::recordBufferUnderrun();
+                }
+
+                break;
+            }
+        }
+
+        return samplesRendered;
+    }
+};
+
+class VolumeNode : public AudioGraph::Processor {
+   public:
+    void process(int16_t* block, uint32_t count) override { gain.apply(block, count, volume); }
+};
+
+// After the volume, so the loudness compensation has headroom at low volume
+class EqualizerNode : public AudioGraph::Processor {
+   public:
+    void process(int16_t* block, uint32_t count) override { equalizer.process(block, count, volume); }
+};
+
+Music music;
+VolumeNode volumeNode;
+EqualizerNode equalizerNode;
+
+// Queues one more chunk that ramps down to silence, so I2S does not stop mid-waveform
+void fadeOut() {
+    if (pauseI2s()) return;
+
+    gain.fadeOut();
+    graph.render(playbackChunk->samples);
+
+    playbackChunk->paused = false;
+    stampChunk(playbackChunk);
+
+    xQueueSend(audioQueue, (void*)playbackChunk, portMAX_DELAY);
+}
+
+// Must be called with playerMutex held before the player jumps, the samples that would have followed are crossfaded
+// into the new position
+void stopDecoding() {
+    if (music.isActive()) {
+        JitterBuffer::Tag played;
+        bool completed;
+
+        gain.startCrossfade(playbackChunk->samples,
+                            jitterBuffer.read(playbackChunk->samples, Gain::CROSSFADE_SAMPLES, played, completed));
+    }
+
+    decoding = false;
+
+    jitterBuffer.flush();
+    pcmCache.stopRecording();
+    timeStretch.reset();
+}
+
+// Must be called with playerMutex held. The decoder may already be in the next track, a jump is relative to the
+// track that is heard.
+void goToAudibleTrack() {
+    if (player.isValid() && player.getTrack() != audible.track) player.goToTrack(audible.track);
+}
+
+// Must be called with playerMutex held after the player jumped. The first block is decoded right away, so the
+// crossfade has something to fade into.
+void startDecoding() {
+    JitterBuffer::Tag tag = playerTag();
+
+    decoding = player.isValid();
+
+    if (decoding && jitterBuffer.hasSpace()) decodeBlock();
+
+    jitterBuffer.wake();
+
+    updatePlaybackState(tag);
+}
+
+// Must be called with playerMutex held
+void play(AlbumNames::Id id) {
     Lock lock(stateMutex);
 
+    const char* album = albumNames.name(id);
+    const int16_t* cachedSamples;
+    uint32_t cachedCount;
+    Bookmarks::Bookmark bookmark;
+
+    updateBookmark();
+
+    timeStretch.setSpeed(config->playbackSpeed(album));
+    timeStretch.reset();
+
     if (strcmp(state.album, album) == 0 && player.isValid()) {
         player.rewind();
         setPaused(false);
+    } else if (bookmarks.lookup(album, bookmark)) {
+        LOG_DEBUG(TAG, "resuming %s at track %u", album, bookmark.track);
+
+        setPaused(!player.open(Audio::directoryForAlbum(album).c_str(), bookmark.track));
+
+        if (!paused && player.getTrack() == bookmark.track && bookmark.position > 0)
+            player.seekToTrackPosition(bookmark.position);
+    } else if (pcmCache.lookup(album, cachedSamples, cachedCount)) {
+        LOG_DEBUG(TAG, "starting %s from cache", album);
+
+        setPaused(!player.openWithPrefix(Audio::directoryForAlbum(album).c_str(), cachedSamples, cachedCount,
+                                         PCM_CACHE_HEAD_START));
     } else {
-        setPaused(!player.open(directoryForAlbum(album).c_str()));
+        setPaused(!player.open(Audio::directoryForAlbum(album).c_str()));
+
+        if (!paused) pcmCache.startRecording(album);
     }
 
+    audible = playerTag();
+    state.track = audible.track;
+    updateTrackInfo(audible.info);
+
     if (paused) {
         state.clearAlbum();
+        stateAlbum = AlbumNames::NONE;
         LOG_WARN(TAG, "failed to open album %s", album);
     } else {
         state.setAlbum(album);
+        stateAlbum = id;
         LOG_INFO(TAG, "playback switched to %s", album);
+    }
+
+    publishState(true);
+}
+
+// There is nothing to resume without an album
+bool resumeDecoding() {
+    Lock lock(playerMutex);
+
+    if (!player.isValid()) return false;
+
+    decoding = true;
+    jitterBuffer.wake();
 
-        HTTPServer::sendUpdate();
+    return true;
+}
+
+// Blocking waits for the task notification that commands and the I2S task give
+bool receiveCommand(AudioCommand& command, bool block) {
+    while (!commands.receive(command)) {
+        if (!block) return false;
+
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     }
+
+    return true;
 }
 
 void receiveAndHandleCommand(bool block) {
-    Command command;
+    AudioCommand command;
+
+    if (receiveCommand(command, block)) {
+        int64_t received = esp_timer_get_time();
+
+        if (commandIssued == 0) commandIssued = command.issued;
 
-    if (xQueueReceive(commandQueue, (void*)&command, block ? portMAX_DELAY : 0) == pdTRUE) {
         switch (command.type) {
-            case Command::cmdTogglePause:
-                setPaused(!paused);
-                break;
+            case AudioCommand::cmdTogglePause: {
+                // The fade out may already reach the end of the album
+                bool pause = !paused;
+
+                if (pause)
+                    fadeOut();
+                else if (!resumeDecoding())
+                    break;
 
-            case Command::cmdVolumeUp:
-                setVolume(std::min((int32_t)VOLUME_LIMIT, volume + VOLUME_STEP));
+                setPaused(pause);
+
+                if (paused) {
+                    updateBookmark();
+                    bookmarks.flush();
+                }
 
                 break;
+            }
 
-            case Command::cmdVolumeDown:
-                setVolume(state.volume = volume = std::max((int32_t)VOLUME_STEP, volume - VOLUME_STEP));
+            case AudioCommand::cmdVolume:
+                setVolume(std::min((int32_t)VOLUME_LIMIT,
+                                   std::max((int32_t)VOLUME_STEP, volume + command.argument * VOLUME_STEP)));
 
                 break;
 
-            case Command::cmdPrevious:
+            case AudioCommand::cmdPrevious: {
+                Lock lock(playerMutex);
+
                 resetAudio();
+                stopDecoding();
+                goToAudibleTrack();
 
-                if (player.getTrackPosition() / (SAMPLE_RATE / 1000) < REWIND_TIMEOUT)
+                if (audible.trackPosition / (SAMPLE_RATE / 1000) < REWIND_TIMEOUT)
                     player.previousTrack();
                 else
                     player.rewindTrack();
 
-                updatePlaybackState();
+                startDecoding();
+                Telemetry::recordTrackSwitch(esp_timer_get_time() - received);
 
                 break;
+            }
+
+            case AudioCommand::cmdNext: {
+                Lock lock(playerMutex);
 
-            case Command::cmdNext:
                 resetAudio();
+                stopDecoding();
+                goToAudibleTrack();
                 player.nextTrack();
 
-                updatePlaybackState();
+                startDecoding();
+                Telemetry::recordTrackSwitch(esp_timer_get_time() - received);
 
                 break;
+            }
+
+            case AudioCommand::cmdRewind: {
+                Lock lock(playerMutex);
 
-            case Command::cmdRewind:
                 resetAudio();
+                stopDecoding();
                 player.rewind();
 
-                updatePlaybackState();
+                startDecoding();
 
                 break;
+            }
+
+            case AudioCommand::cmdPlay: {
+                const char* album = albumNames.name(command.argument);
 
-            case Command::cmdPlay:
-                LOG_INFO(TAG, "switching playback to %s", command.album);
+                LOG_INFO(TAG, "switching playback to %s", album);
+
+                Lock lock(playerMutex);
 
                 resetAudio();
+                stopDecoding();
 
-                play(command.album);
+                play(command.argument);
 
                 if (!paused) {
+                    startDecoding();
                     signal.start(Signal::commandReceived);
-                    updatePlaybackState();
                 }
 
+                Telemetry::recordTrackSwitch(esp_timer_get_time() - received);
+
                 break;
+            }
 
-            case Command::cmdSignalError:
-                resetAudio();
+            case AudioCommand::cmdSignalError:
                 signal.start(Signal::error);
 
                 break;
 
-            case Command::cmdSignalCommandReceived:
-                resetAudio();
+            case AudioCommand::cmdSignalCommandReceived:
                 signal.start(Signal::commandReceived);
 
                 break;
 
+            case AudioCommand::cmdShutdown: {
+                fadeOut();
+
+                // Nothing is decoded after this, so the snapshot matches the state that is persisted
+                Lock lock(playerMutex);
+
+                decoding = false;
+                shutdown = true;
+                updateBookmark();
+                bookmarks.flush();
+                // Audio::stop may have persisted the published state already, the SD is not touched then
+                if (!statePersisted.load()) saveSnapshot();
+
+                if (!statePersisted.exchange(true)) persistentState = state;
+
+                xSemaphoreGive(shutdownDone);
+
+                break;
+            }
+
             default:
                 LOG_ERROR(TAG, "unhandled audio command: %i", (int)command.type);
         }
     }
 }
 
+// Waits for space in the audio queue. A jump does not wait, the chunk is dropped along with the queued ones.
+void queueChunk(Chunk* chunk) {
+    while (xQueueSend(audioQueue, (void*)chunk, 0) != pdTRUE) {
+        if (jumpPending()) {
+            receiveAndHandleCommand(false);
+            return;
+        }
+
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+// The graph renders into the playback chunk
+class ChunkSink : public AudioGraph::Sink {
+   public:
+    void consume(int16_t* block, uint32_t count) override {
+        Telemetry::recordChunk(uxQueueMessagesWaiting(audioQueue), jitterBuffer.getDepth(), jitterBuffer.getTarget());
+
+        queueChunk(playbackChunk);
+    }
+};
+
+ChunkSink chunkSink;
+
 bool tryToRestore() {
     if (!Power::isResumeFromSleep()) return false;
 
@@ -265,18 +850,50 @@ bool tryToRestore() {
 
     volume = state.volume;
 
-    if (!(state.hasAlbum() && player.open(directoryForAlbum(state.album).c_str(), state.track))) return false;
-    if (player.getTrack() == state.track) player.seekTo(state.position);
+    if (state.hasAlbum()) timeStretch.setSpeed(config->playbackSpeed(state.album));
+
+    if (!(state.hasAlbum() && player.open(Audio::directoryForAlbum(state.album).c_str(), state.track))) return false;
+
+    bool restored = player.getTrack() == state.track && restoreSnapshot();
+
+    if (!restored) {
+        if (player.getTrack() == state.track) player.seekTo(state.position);
+
+        audible = playerTag();
+    }
+
+    state.track = audible.track;
+    stateAlbum = albumNames.intern(state.album);
+    updateTrackInfo(audible.info);
+
+    decoding = true;
+    publishState();
 
     return true;
 }
 
-bool pauseI2s() { return ((!player.isValid() || paused) && !signal.isActive()) || shutdown; }
+// PCM tracks need no decoding, so we can save power by clocking down while playing them
+void updateCpuFrequency() {
+    bool lowFrequency = !paused && decodingPcm && !signal.isActive();
+
+    if (lowFrequency == cpuClockedDown) return;
+
+    cpuClockedDown = lowFrequency;
+    setCpuFrequencyMhz(lowFrequency ? CPU_FREQUENCY_TRANSCODED : CPU_FREQUENCY);
+}
 
 void audioTask_() {
+    bookmarks.initialize();
+
+    // The configuration is only loaded after Audio::initialize
+    equalizer.initialize(config->equalizerBands(), config->loudnessCompensation());
+
     setPaused(!tryToRestore() || silentStart);
 
-    Chunk* chunk = new Chunk();
+    Chunk* chunk = playbackChunk = new Chunk();
+
+    audioTaskHandle = xTaskGetCurrentTaskHandle();
+    commands.setConsumer(audioTaskHandle);
 
     Gpio::enableAmp();
 
@@ -284,45 +901,23 @@ void audioTask_() {
     xTaskCreatePinnedToCore(i2sStreamTask, "i2s", STACK_SIZE_I2S, (void*)&audioQueue, TASK_PRIORITY_I2S, &task,
                             AUDIO_CORE);
 
-    clearDmaBufferOnResume = false;
+    // The decoder only starts after the snapshot has been restored, it runs whenever the audio task waits
+    xTaskCreatePinnedToCore(decoderTask, "decoder", STACK_SIZE_DECODER, NULL, TASK_PRIORITY_DECODER, &task,
+                            AUDIO_CORE);
 
     while (true) {
         Watchdog::notify();
 
         receiveAndHandleCommand(pauseI2s());
+        updateCpuFrequency();
 
         chunk->paused = pauseI2s();
-        chunk->clearDmaBufferOnResume = clearDmaBufferOnResume;
+        stampChunk(chunk);
 
-        if (!chunk->paused) {
-            clearDmaBufferOnResume = false;
-            size_t samplesDecoded = 0;
-
-            while (samplesDecoded < PLAYBACK_CHUNK_SIZE / 4) {
-                if (signal.isActive()) {
-                    samplesDecoded += signal.play(chunk->samples, (PLAYBACK_CHUNK_SIZE / 4 - samplesDecoded));
-                } else if (!paused && player.isValid()) {
-                    samplesDecoded += player.decode(chunk->samples, (PLAYBACK_CHUNK_SIZE / 4 - samplesDecoded));
-
-                    if (player.isFinished()) {
-                        player.rewind();
-                        setPaused(true);
-                    }
-                } else {
-                    memset(chunk->samples + 2 * samplesDecoded, 0, PLAYBACK_CHUNK_SIZE - samplesDecoded * 4);
-
-                    break;
-                }
-            }
-
-            for (int i = 0; i < PLAYBACK_CHUNK_SIZE / 2; i++) {
-                chunk->samples[i] = (static_cast<int32_t>(chunk->samples[i]) * volume) / VOLUME_FULL;
-            }
-
-            updatePlaybackState();
-        }
-
-        xQueueSend(audioQueue, (void*)chunk, portMAX_DELAY);
+        if (chunk->paused)
+            queueChunk(chunk);
+        else
+            graph.run(chunk->samples);
     }
 }
 
@@ -339,8 +934,8 @@ void setupI2s() {
         .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
         .communication_format = (i2s_comm_format_t)(I2S_COMM_FORMAT_I2S | I2S_COMM_FORMAT_I2S_MSB),
         .intr_alloc_flags = ESP_INTR_FLAG_LEVEL3,
-        .dma_buf_count = 4,
-        .dma_buf_len = 256,
+        .dma_buf_count = DMA_BUFFER_COUNT,
+        .dma_buf_len = DMA_BUFFER_LENGTH,
         .use_apll = false,
         .tx_desc_auto_clear = true,
     };
@@ -354,21 +949,42 @@ void setupI2s() {
     i2s_stop(I2S_NUM);
 }
 
-void dispatchCommand(const Command& command) {
+void dispatchCommand(const AudioCommand& command) {
     if (shutdown) return;
 
-    xQueueSend(commandQueue, (void*)&command, portMAX_DELAY);
+    if (!commands.post(command)) LOG_WARN(TAG, "audio command %i dropped", (int)command.type);
 }
 
-void dispatchCommand(Command::Type type) { dispatchCommand(Command(type)); }
+void dispatchCommand(AudioCommand::Type type) { dispatchCommand(AudioCommand(type)); }
 
 }  // namespace
 
-void Audio::initialize() {
-    commandQueue = xQueueCreate(COMMAND_QUEUE_SIZE, sizeof(Command));
+void Audio::initialize(Config& _config) {
+    config = &_config;
+
     audioQueue = xQueueCreate(PLAYBACK_QUEUE_SIZE, sizeof(Chunk));
 
+    // For debugging and the host simulator
+    vQueueAddToRegistry(audioQueue, "audio");
+
     stateMutex = xSemaphoreCreateMutex();
+    playerMutex = xSemaphoreCreateMutex();
+    shutdownDone = xSemaphoreCreateBinary();
+
+    pcmCache.initialize();
+    jitterBuffer.initialize(JITTER_BUFFER_MIN_DEPTH, JITTER_BUFFER_CAPACITY);
+    timeStretch.initialize();
+    gain.initialize();
+    signal.initialize();
+
+    // Music includes the time it waits for the decoder
+    graph.addSource(music, Mixer::background, "music");
+    graph.addSource(signal, Mixer::foreground, "signal");
+    graph.addProcessor(volumeNode, "volume");
+    graph.addProcessor(equalizerNode, "equalizer");
+    graph.setSink(chunkSink);
+
+    Telemetry::recordGraph(graph);
 
     if (Power::isResumeFromSleep()) {
         Lock lock(stateMutex);
@@ -378,6 +994,7 @@ void Audio::initialize() {
         Lock lock(stateMutex);
 
         state.volume = volume;
+        state.hasSnapshot = false;
         state.clearAlbum();
     }
 
@@ -387,59 +1004,85 @@ void Audio::initialize() {
 void Audio::start(bool silent) {
     silentStart = silent;
 
+    // Only cards play albums, so the mappings bound the names that are interned
+    const RfidMap& mappings = config->rfidMappings();
+    albumNames.initialize(mappings.albums(), mappings.albumBytes());
+
     setupI2s();
 
-    TaskHandle_t audioTaskHandle;
-    xTaskCreatePinnedToCore(audioTask, "audio", STACK_SIZE_AUDIO, NULL, TASK_PRIORITY_AUDIO, &audioTaskHandle,
-                            AUDIO_CORE);
+    TaskHandle_t task;
+    xTaskCreatePinnedToCore(audioTask, "audio", STACK_SIZE_AUDIO, NULL, TASK_PRIORITY_AUDIO, &task, AUDIO_CORE);
 }
 
-void Audio::togglePause() { dispatchCommand(Command::cmdTogglePause); }
+void Audio::togglePause() { dispatchCommand(AudioCommand::cmdTogglePause); }
 
-void Audio::volumeUp() { dispatchCommand(Command::cmdVolumeUp); }
+void Audio::volumeUp() { dispatchCommand(AudioCommand(AudioCommand::cmdVolume, 1)); }
 
-void Audio::volumeDown() { dispatchCommand(Command::cmdVolumeDown); }
+void Audio::volumeDown() { dispatchCommand(AudioCommand(AudioCommand::cmdVolume, -1)); }
 
-void Audio::previous() { dispatchCommand(Command::cmdPrevious); }
+void Audio::previous() { dispatchCommand(AudioCommand::cmdPrevious); }
 
-void Audio::next() { dispatchCommand(Command::cmdNext); }
+void Audio::next() { dispatchCommand(AudioCommand::cmdNext); }
 
-void Audio::rewind() { dispatchCommand(Command::cmdRewind); }
+void Audio::rewind() { dispatchCommand(AudioCommand::cmdRewind); }
 
 void Audio::play(const char* album) {
-    Command command(Command::cmdPlay);
-    command.setAlbum(album);
+    AlbumNames::Id id = albumNames.intern(album);
 
-    dispatchCommand(command);
+    if (id == AlbumNames::NONE) {
+        LOG_ERROR(TAG, "no room left to intern album %s", album);
+        signalError();
+        return;
+    }
+
+    dispatchCommand(AudioCommand(AudioCommand::cmdPlay, id));
 }
 
 void Audio::stop() {
+    AudioCommand command(AudioCommand::cmdShutdown);
+
+    if (!shutdown &&
+        (!commands.post(command) || xSemaphoreTake(shutdownDone, AUDIO_STOP_TIMEOUT / portTICK_PERIOD_MS) != pdTRUE) &&
+        !statePersisted.exchange(true)) {
+        LOG_WARN(TAG, "audio task did not stop in time");
+
+        // The state belongs to the audio task, so only what has been published can be kept. The track starts over.
+        Audio::PlaybackState playback = publishedState.read();
+
+        persistentState.volume = playback.volume;
+        persistentState.setAlbum(albumNames.name(playback.album));
+        persistentState.track = playback.track;
+        persistentState.position = 0;
+        persistentState.hasSnapshot = false;
+    }
+
     shutdown = true;
+}
 
-    Lock lock(stateMutex);
-    persistentState = state;
+std::string Audio::directoryForAlbum(const char* album) {
+    return std::string(SD_MOUNT_POINT "/music/") + std::string(album);
 }
 
-bool Audio::isPlaying() { return player.isValid() && !paused; }
+void Audio::setStateListener(StateListener listener) { stateListener = listener; }
 
-std::string Audio::currentAlbum() {
-    Lock lock(stateMutex);
+Audio::PlaybackState Audio::playbackState() { return publishedState.read(); }
 
-    return state.album;
-}
+const char* Audio::albumName(AlbumNames::Id album) { return albumNames.name(album); }
 
-uint32_t Audio::currentTrack() {
-    Lock lock(stateMutex);
+bool Audio::isPlaying() { return !publishedState.read().paused; }
 
-    return state.track;
-}
+std::string Audio::currentAlbum() { return albumNames.name(publishedState.read().album); }
 
-int32_t Audio::currentVolume() {
+uint32_t Audio::currentTrack() { return publishedState.read().track; }
+
+Audio::TrackInfo Audio::currentTrackInfo() {
     Lock lock(stateMutex);
 
-    return state.volume;
+    return trackInfo;
 }
 
-void Audio::signalError() { dispatchCommand(Command::cmdSignalError); }
+int32_t Audio::currentVolume() { return publishedState.read().volume; }
+
+void Audio::signalError() { dispatchCommand(AudioCommand::cmdSignalError); }
 
-void Audio::signalCommandReceived() { dispatchCommand(Command::cmdSignalCommandReceived); }
+void Audio::signalCommandReceived() { dispatchCommand(AudioCommand::cmdSignalCommandReceived); }
@@ -3,11 +3,39 @@
 
 #include <string>
 
+#include "AlbumNames.hxx"
 #include "config.h"
 
+class Config;
+
 namespace Audio {
 
-void initialize();
+struct TrackInfo {
+    std::string title;
+    std::string artist;
+    std::string album;
+
+    // milliseconds
+    uint32_t duration;
+};
+
+// What can be heard, published by the audio task
+struct PlaybackState {
+    AlbumNames::Id album;
+    bool paused;
+
+    uint32_t track;
+
+    // Frames since the start of the track
+    uint32_t position;
+
+    int32_t volume;
+};
+
+// Called by the audio task whenever anything but the position changes, it must not block
+using StateListener = void (*)();
+
+void initialize(Config& config);
 
 void start(bool silent);
 
@@ -21,9 +49,19 @@ void play(const char* album);
 
 void stop();
 
+void setStateListener(StateListener listener);
+
+// Lock free and consistent, from any task
+PlaybackState playbackState();
+
+// The name stays valid forever, the empty string for AlbumNames::NONE
+const char* albumName(AlbumNames::Id album);
+
 bool isPlaying();
+std::string directoryForAlbum(const char* album);
 std::string currentAlbum();
 uint32_t currentTrack();
+TrackInfo currentTrackInfo();
 int32_t currentVolume();
 
 void signalError();
@@ -0,0 +1,97 @@
+#include "AudioGraph.hxx"
+
+#include <Arduino.h>
+
+static_assert(AudioGraph::BLOCK_SAMPLES <= Mixer::MAX_SAMPLES, "block does not fit into the mixer");
+
+AudioGraph::AudioGraph() { mixNode = addNode("mix"); }
+
+bool AudioGraph::addSource(Mixer::Source& source, Mixer::Role role, const char* name) {
+    if (sourceCount == Mixer::MAX_SOURCES) return false;
+
+    SourceNode& sourceNode = sources[sourceCount];
+
+    sourceNode.graph = this;
+    sourceNode.source = &source;
+    sourceNode.node = addNode(name);
+
+    if (!mixer.addSource(sourceNode, role)) return false;
+
+    sourceCount++;
+
+    return true;
+}
+
+bool AudioGraph::addProcessor(Processor& processor, const char* name) {
+    if (processorCount == MAX_PROCESSORS) return false;
+
+    processors[processorCount++] = {.processor = &processor, .node = addNode(name)};
+
+    return true;
+}
+
+void AudioGraph::setSink(Sink& sink) { this->sink = &sink; }
+
+bool AudioGraph::render(int16_t* block) {
+    sourceCycles = 0;
+
+    uint32_t start = ESP.getCycleCount();
+    bool active = mixer.mix(block, BLOCK_SAMPLES);
+
+    account(*mixNode, ESP.getCycleCount() - start - sourceCycles);
+
+    for (uint32_t i = 0; i < processorCount; i++) {
+        start = ESP.getCycleCount();
+        processors[i].processor->process(block, BLOCK_SAMPLES);
+
+        account(*processors[i].node, ESP.getCycleCount() - start);
+    }
+
+    return active;
+}
+
+void AudioGraph::run(int16_t* block) {
+    render(block);
+
+    if (sink) sink->consume(block, BLOCK_SAMPLES);
+}
+
+AudioGraph::NodeStats AudioGraph::getNodeStats(uint32_t index) const {
+    const Node& node = nodes[index];
+
+    return {.name = node.name,
+            .cycles = node.cycles.load(std::memory_order_relaxed),
+            .maxCycles = node.maxCycles.load(std::memory_order_relaxed)};
+}
+
+uint32_t AudioGraph::SourceNode::render(int16_t* buffer, uint32_t count) {
+    uint32_t start = ESP.getCycleCount();
+    uint32_t rendered = source->render(buffer, count);
+    uint32_t cycles = ESP.getCycleCount() - start;
+
+    graph->sourceCycles += cycles;
+    graph->account(*node, cycles);
+
+    return rendered;
+}
+
+// There is a node for every source and processor that can be added
+AudioGraph::Node* AudioGraph::addNode(const char* name) {
+    Node& node = nodes[nodeCount++];
+
+    node.name = name;
+    node.cycles.store(0, std::memory_order_relaxed);
+    node.maxCycles.store(0, std::memory_order_relaxed);
+
+    return &node;
+}
+
+void AudioGraph::account(Node& node, uint32_t cycles) {
+    uint32_t average = node.cycles.load(std::memory_order_relaxed);
+
+    // Only the graph writes, so a relaxed load and store is enough
+    node.cycles.store(average + (static_cast<int32_t>(cycles - average) >> AVERAGE_SHIFT), std::memory_order_relaxed);
+
+    if (cycles > node.maxCycles.load(std::memory_order_relaxed))
+        node.maxCycles.store(cycles, std::memory_order_relaxed);
+}
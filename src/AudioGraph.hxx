@@ -0,0 +1,129 @@
+#ifndef AUDIO_GRAPH_HXX
+#define AUDIO_GRAPH_HXX
+
+#include <atomic>
+#include <cstdint>
+
+#include "Mixer.hxx"
+#include "config.h"
+
+/**
+ * The processing chain of the audio task: sources that are mixed into a block, processors that work on the block in
+ * place, one after the other, and a sink that takes the block. The graph is built once at startup into fixed
+ * arrays, running it allocates nothing.
+ *
+ * Every node is accounted in CPU cycles per block, the mixing itself as a node of its own. The sink is not, it may
+ * wait for the consumer. The accounting has a single writer, the task that runs the graph, and can be read from
+ * any task.
+ */
+class AudioGraph {
+   public:
+    class Processor {
+       public:
+        virtual void process(int16_t* block, uint32_t count) = 0;
+
+       protected:
+        ~Processor() = default;
+    };
+
+    class Sink {
+       public:
+        virtual void consume(int16_t* block, uint32_t count) = 0;
+
+       protected:
+        ~Sink() = default;
+    };
+
+    struct NodeStats {
+        const char* name;
+
+        // Mean over about the last 2^AVERAGE_SHIFT blocks and the maximum since boot
+        uint32_t cycles;
+        uint32_t maxCycles;
+    };
+
+    static constexpr uint32_t BLOCK_SAMPLES = PLAYBACK_CHUNK_SIZE / 4;
+
+    static constexpr uint32_t MAX_PROCESSORS = 4;
+    static constexpr uint32_t MAX_NODES = Mixer::MAX_SOURCES + 1 + MAX_PROCESSORS;
+
+    static constexpr uint32_t AVERAGE_SHIFT = 6;
+
+   public:
+    AudioGraph();
+
+    bool addSource(Mixer::Source& source, Mixer::Role role, const char* name);
+
+    bool addProcessor(Processor& processor, const char* name);
+
+    void setSink(Sink& sink);
+
+    // Mixes the sources into the block and runs the processors, returns false if no source was active
+    bool render(int16_t* block);
+
+    // Renders the block and passes it to the sink
+    void run(int16_t* block);
+
+    uint32_t getNodeCount() const { return nodeCount; }
+
+    NodeStats getNodeStats(uint32_t index) const;
+
+   private:
+    struct Node {
+        const char* name;
+
+        std::atomic<uint32_t> cycles;
+        std::atomic<uint32_t> maxCycles;
+    };
+
+    // Accounts the renders of a source, the mixer calls it in place of the source
+    class SourceNode : public Mixer::Source {
+       public:
+        bool isActive() const override { return source->isActive(); }
+
+        uint32_t render(int16_t* buffer, uint32_t count) override;
+
+       public:
+        AudioGraph* graph;
+        Mixer::Source* source;
+        Node* node;
+    };
+
+    struct ProcessorNode {
+        Processor* processor;
+        Node* node;
+    };
+
+    Node* addNode(const char* name);
+
+    void account(Node& node, uint32_t cycles);
+
+   private:
+    Mixer mixer;
+
+    Node nodes[MAX_NODES];
+    uint32_t nodeCount{0};
+
+    SourceNode sources[Mixer::MAX_SOURCES];
+    uint32_t sourceCount{0};
+
+    ProcessorNode processors[MAX_PROCESSORS];
+    uint32_t processorCount{0};
+
+    Node* mixNode;
+    Sink* sink{nullptr};
+
+    // Spent by the sources in the block that is being mixed
+    uint32_t sourceCycles{0};
+
+   private:
+    AudioGraph(const AudioGraph&) = delete;
+
+    AudioGraph(AudioGraph&&) = delete;
+
+    AudioGraph& operator=(const AudioGraph&) = delete;
+
+    AudioGraph& operator=(AudioGraph&&) = delete;
+};
+
+#endif  // AUDIO_GRAPH_HXX
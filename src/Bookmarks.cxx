@@ -0,0 +1,212 @@
+#include "Bookmarks.hxx"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "Log.hxx"
+
+#define TAG "bookmarks"
+
+namespace {
+
+// Records of the first version held decoder seek positions, they are dropped
+constexpr uint32_t RECORD_MAGIC = 0x424d4b32;
+constexpr uint32_t RECORDS_PER_IO = 8;
+
+}  // namespace
+
+Bookmarks::Bookmarks(const char* path, uint32_t capacity, uint32_t journalLimit)
+    : path(path), capacity(capacity), journalLimit(journalLimit) {}
+
+Bookmarks::~Bookmarks() { delete[] entries; }
+
+void Bookmarks::initialize() {
+    if (entries) return;
+
+    entries = new Entry[capacity]();
+
+    replay();
+
+    if (journalLength >= journalLimit || corrupt) compact();
+}
+
+bool Bookmarks::lookup(const char* album, Bookmark& bookmark) const {
+    Entry* entry = findEntry(keyFor(album), false);
+
+    if (!entry || (entry->bookmark.track == 0 && entry->bookmark.position == 0)) return false;
+
+    bookmark = entry->bookmark;
+
+    return true;
+}
+
+void Bookmarks::update(const char* album, uint32_t track, uint32_t position) {
+    uint64_t key = keyFor(album);
+    Entry* entry = findEntry(key, true);
+
+    if (!entry) {
+        LOG_WARN(TAG, "no space left for a bookmark for %s", album);
+        return;
+    }
+
+    if (entry->key == key && entry->bookmark.track == track && entry->bookmark.position == position) return;
+
+    entry->key = key;
+    entry->bookmark = {.track = track, .position = position};
+    entry->dirty = dirty = true;
+}
+
+void Bookmarks::flush() {
+    if (!dirty || !entries) return;
+
+    if (journalLength >= journalLimit || corrupt) {
+        compact();
+        return;
+    }
+
+    if (!write(path, "a", true)) {
+        LOG_WARN(TAG, "failed to append to %s", path);
+        return;
+    }
+
+    for (uint32_t i = 0; i < capacity; i++) entries[i].dirty = false;
+    dirty = false;
+}
+
+uint64_t Bookmarks::keyFor(const char* album) {
+    // FNV-1a, 0 is reserved for empty slots
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (const char* c = album; *c; c++) hash = (hash ^ static_cast<uint8_t>(*c)) * 0x100000001b3ULL;
+
+    return hash ? hash : 1;
+}
+
+uint32_t Bookmarks::checksumFor(const Record& record) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(&record);
+    uint32_t hash = 0x811c9dc5;
+
+    for (size_t i = 0; i < offsetof(Record, checksum); i++) hash = (hash ^ data[i]) * 0x01000193;
+
+    return hash;
+}
+
+Bookmarks::Entry* Bookmarks::findEntry(uint64_t key, bool insert) const {
+    if (!entries) return nullptr;
+
+    for (uint32_t i = 0; i < capacity; i++) {
+        Entry* entry = &entries[(key + i) & (capacity - 1)];
+
+        if (entry->key == key) return entry;
+        if (entry->key == 0) return insert ? entry : nullptr;
+    }
+
+    return nullptr;
+}
+
+void Bookmarks::replay() {
+    std::string tmpPath = std::string(path) + ".tmp";
+    FILE* file = fopen(path, "r");
+
+    // A compaction was interrupted after the old journal had been removed
+    if (!file && rename(tmpPath.c_str(), path) == 0) file = fopen(path, "r");
+
+    if (!file) return;
+
+    Record records[RECORDS_PER_IO];
+    size_t count;
+
+    while ((count = fread(records, sizeof(Record), RECORDS_PER_IO, file)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            const Record& record = records[i];
+
+            if (record.magic != RECORD_MAGIC || record.key == 0 || record.checksum != checksumFor(record)) {
+                LOG_WARN(TAG, "journal is corrupt after %u records", journalLength);
+
+                corrupt = true;
+                fclose(file);
+                return;
+            }
+
+            Entry* entry = findEntry(record.key, true);
+
+            if (entry) *entry = {.key = record.key, .bookmark = record.bookmark, .dirty = false};
+
+            journalLength++;
+        }
+    }
+
+    // A torn append leaves a partial record at the end
+    if (ftell(file) != static_cast<long>(journalLength * sizeof(Record))) {
+        LOG_WARN(TAG, "journal has a partial record after %u records", journalLength);
+
+        corrupt = true;
+    }
+
+    fclose(file);
+
+    LOG_INFO(TAG, "read %u journal records", journalLength);
+}
+
+bool Bookmarks::compact() {
+    std::string tmpPath = std::string(path) + ".tmp";
+
+    if (!write(tmpPath.c_str(), "w", false)) {
+        LOG_WARN(TAG, "failed to write %s", tmpPath.c_str());
+        return false;
+    }
+
+    // FATFS can not rename over an existing file
+    remove(path);
+
+    if (rename(tmpPath.c_str(), path) != 0) {
+        LOG_WARN(TAG, "failed to replace %s", path);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < capacity; i++) entries[i].dirty = false;
+    dirty = corrupt = false;
+
+    LOG_INFO(TAG, "compacted journal to %u records", journalLength);
+
+    return true;
+}
+
+bool Bookmarks::write(const char* filePath, const char* mode, bool dirtyOnly) {
+    FILE* file = fopen(filePath, mode);
+
+    if (!file) return false;
+
+    Record records[RECORDS_PER_IO];
+    uint32_t count = 0, written = 0;
+    bool success = true;
+
+    for (uint32_t i = 0; i <= capacity && success; i++) {
+        if (i < capacity) {
+            const Entry& entry = entries[i];
+
+            // Albums that start from the beginning need no record once the journal is rewritten
+            if (entry.key == 0 || (dirtyOnly && !entry.dirty) ||
+                (!dirtyOnly && entry.bookmark.track == 0 && entry.bookmark.position == 0))
+                continue;
+
+            Record& record = records[count++];
+            record = {.key = entry.key, .bookmark = entry.bookmark, .magic = RECORD_MAGIC, .checksum = 0};
+            record.checksum = checksumFor(record);
+        }
+
+        if (count == RECORDS_PER_IO || (i == capacity && count > 0)) {
+            success = fwrite(records, sizeof(Record), count, file) == count;
+            written += count;
+            count = 0;
+        }
+    }
+
+    success = (fclose(file) == 0) && success;
+
+    if (success) journalLength = dirtyOnly ? journalLength + written : written;
+
+    return success;
+}
@@ -0,0 +1,88 @@
+#ifndef BOOKMARKS_HXX
+#define BOOKMARKS_HXX
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Remembers the track and the position in it of every album that has been played. Bookmarks live in
+ * a hash table in RAM and are persisted as fixed size records appended to a journal on the SD.
+ * Changes are only written by flush, so the caller decides when the SD is not busy with playback.
+ * The journal is compacted to one record per album once it has grown past the limit.
+ */
+class Bookmarks {
+   public:
+    struct Bookmark {
+        uint32_t track;
+
+        // Samples from the start of the track, the same whichever decoder plays it
+        uint32_t position;
+    };
+
+   public:
+    // capacity must be a power of two
+    Bookmarks(const char* path, uint32_t capacity, uint32_t journalLimit);
+
+    ~Bookmarks();
+
+    // Reads the journal, must be called before any other method
+    void initialize();
+
+    bool lookup(const char* album, Bookmark& bookmark) const;
+
+    void update(const char* album, uint32_t track, uint32_t position);
+
+    // Appends all changes since the last flush to the journal
+    void flush();
+
+   private:
+    struct Entry {
+        // 0 marks an empty slot
+        uint64_t key;
+        Bookmark bookmark;
+        bool dirty;
+    };
+
+    struct Record {
+        uint64_t key;
+        Bookmark bookmark;
+        uint32_t magic;
+        uint32_t checksum;
+    };
+
+   private:
+    static uint64_t keyFor(const char* album);
+
+    static uint32_t checksumFor(const Record& record);
+
+    Entry* findEntry(uint64_t key, bool insert) const;
+
+    void replay();
+
+    bool compact();
+
+    bool write(const char* filePath, const char* mode, bool dirtyOnly);
+
+   private:
+    const char* path;
+    const uint32_t capacity;
+    const uint32_t journalLimit;
+
+    Entry* entries{nullptr};
+    uint32_t journalLength{0};
+    bool dirty{false};
+
+    // Records appended after a torn or corrupt one would never be read again
+    bool corrupt{false};
+
+   private:
+    Bookmarks(const Bookmarks&) = delete;
+
+    Bookmarks(Bookmarks&&) = delete;
+
+    Bookmarks& operator=(const Bookmarks&) = delete;
+
+    Bookmarks& operator=(Bookmarks&&) = delete;
+};
+
+#endif  // BOOKMARKS_HXX
@@ -2,38 +2,41 @@
 #define COMMAND_HXX
 
 #include <cstdint>
-#include <string>
 
 namespace Command {
 
+// Plain data, a play command points to its album name, which must outlive the command
 struct Command {
     enum class Type : uint8_t { play, dbgSetVoltage, startNet, stopNet, none };
 
     union Payload {
-        std::string track;
+        const char* track;
         uint32_t voltage;
-
-        ~Payload() {}
-        Payload() {}
     };
 
     Type type;
     Payload payload;
 
-    static Command play(const char* track);
-    static Command dbgSetVoltage(uint32_t voltage);
-    static Command startNet();
-    static Command stopNet();
-    static Command none();
+    static Command play(const char* track) {
+        Command cmd(Type::play);
+        cmd.payload.track = track;
+
+        return cmd;
+    }
+
+    static Command dbgSetVoltage(uint32_t voltage) {
+        Command cmd(Type::dbgSetVoltage);
+        cmd.payload.voltage = voltage;
+
+        return cmd;
+    }
 
-    ~Command();
-    Command(const Command&);
-    Command(Command&&);
+    static Command startNet() { return Command(Type::startNet); }
+    static Command stopNet() { return Command(Type::stopNet); }
+    static Command none() { return Command(Type::none); }
 
    private:
-    Command() = default;
-    Command& operator=(const Command&) = delete;
-    Command& operator=(Command&&) = delete;
+    explicit Command(Type type) : type(type), payload{nullptr} {}
 };
 
 void dispatch(const Command& cmd);
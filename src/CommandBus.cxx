@@ -0,0 +1,132 @@
+#include "CommandBus.hxx"
+
+namespace {
+
+CommandBus::Trace postedTrace = nullptr;
+CommandBus::Trace receivedTrace = nullptr;
+
+}  // namespace
+
+CommandBus::CommandBus() {
+    for (uint32_t i = 0; i < CAPACITY; i++) slots[i].sequence.store(i, std::memory_order_relaxed);
+
+    for (std::atomic<bool>& flag : merging) flag.store(false, std::memory_order_relaxed);
+}
+
+void CommandBus::setConsumer(TaskHandle_t consumer) {
+    this->consumer.store(consumer, std::memory_order_release);
+
+    notify();
+}
+
+bool CommandBus::post(const AudioCommand& command) {
+    if (command.type == AudioCommand::cmdShutdown) {
+        shutdownCommand = command;
+        shutdown.store(true, std::memory_order_release);
+    } else if (command.isMergeable()) {
+        // The steps are added first, so the consumer takes them along even if it clears the flag right after this
+        if (command.type == AudioCommand::cmdVolume)
+            volumeSteps.fetch_add(command.argument, std::memory_order_relaxed);
+
+        if (!merging[command.type].exchange(true, std::memory_order_acq_rel) && !push(command)) {
+            merging[command.type].store(false, std::memory_order_release);
+            return false;
+        }
+    } else if (!push(command)) {
+        return false;
+    }
+
+    if (postedTrace) postedTrace(command);
+
+    notify();
+
+    return true;
+}
+
+bool CommandBus::receive(AudioCommand& command) {
+    if (shutdown.exchange(false, std::memory_order_acq_rel)) {
+        command = shutdownCommand;
+
+        if (receivedTrace) receivedTrace(command);
+
+        return true;
+    }
+
+    while (isReady(tail)) {
+        Slot& slot = slots[tail % CAPACITY];
+
+        command = slot.command;
+
+        bool obsolete = command.isJump() && playFollows();
+
+        slot.sequence.store(tail + CAPACITY, std::memory_order_release);
+        tail++;
+
+        if (command.isMergeable()) {
+            merging[command.type].store(false, std::memory_order_release);
+
+            if (command.type == AudioCommand::cmdVolume) {
+                command.argument = volumeSteps.exchange(0, std::memory_order_relaxed);
+
+                // Taken along with an earlier command
+                if (command.argument == 0) continue;
+            }
+        }
+
+        if (obsolete) continue;
+
+        if (receivedTrace) receivedTrace(command);
+
+        return true;
+    }
+
+    return false;
+}
+
+bool CommandBus::jumpPending() const { return isReady(tail) && slots[tail % CAPACITY].command.isJump(); }
+
+void CommandBus::trace(Trace posted, Trace received) {
+    postedTrace = posted;
+    receivedTrace = received;
+}
+
+bool CommandBus::push(const AudioCommand& command) {
+    uint32_t position = head.load(std::memory_order_relaxed);
+
+    while (true) {
+        Slot& slot = slots[position % CAPACITY];
+        int32_t difference = static_cast<int32_t>(slot.sequence.load(std::memory_order_acquire) - position);
+
+        if (difference < 0) return false;
+
+        if (difference == 0) {
+            if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        } else {
+            position = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    Slot& slot = slots[position % CAPACITY];
+
+    slot.command = command;
+    slot.sequence.store(position + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool CommandBus::isReady(uint32_t position) const {
+    return slots[position % CAPACITY].sequence.load(std::memory_order_acquire) == position + 1;
+}
+
+bool CommandBus::playFollows() const {
+    for (uint32_t position = tail + 1; position != tail + CAPACITY && isReady(position); position++)
+        if (slots[position % CAPACITY].command.type == AudioCommand::cmdPlay) return true;
+
+    return false;
+}
+
+void CommandBus::notify() {
+    TaskHandle_t task = consumer.load(std::memory_order_acquire);
+
+    if (task) xTaskNotifyGive(task);
+}
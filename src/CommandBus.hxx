@@ -0,0 +1,123 @@
+#ifndef COMMAND_BUS_HXX
+#define COMMAND_BUS_HXX
+
+// clang-format off
+#include <freertos/FreeRTOS.h>
+// clang-format on
+
+#include <esp_timer.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+struct AudioCommand {
+    enum Type : uint8_t {
+        cmdTogglePause,
+        cmdVolume,
+        cmdPrevious,
+        cmdNext,
+        cmdRewind,
+        cmdPlay,
+        cmdSignalError,
+        cmdSignalCommandReceived,
+        cmdShutdown,
+        cmdCount
+    };
+
+    Type type;
+
+    // Volume steps for cmdVolume, the interned album for cmdPlay
+    int32_t argument;
+
+    // When the command was issued in esp_timer time, the first one of merged commands
+    int64_t issued;
+
+    AudioCommand(Type type, int32_t argument = 0) : type(type), argument(argument), issued(esp_timer_get_time()) {}
+    AudioCommand() {}
+
+    // Everything that has been queued for playback is stale after a jump
+    bool isJump() const { return type == cmdPrevious || type == cmdNext || type == cmdRewind || type == cmdPlay; }
+
+    // Repeating these before the audio task got to them only adds to the one that is pending
+    bool isMergeable() const { return type == cmdVolume || type == cmdSignalError || type == cmdSignalCommandReceived; }
+};
+
+/**
+ * Commands from the input tasks (buttons, RFID, web) to the audio task. Posting never blocks, so input stays
+ * responsive whatever the audio task is doing: commands go into a fixed ring that any task can append to without
+ * a lock, and the consumer task is woken through its task notification. A full ring drops the command.
+ *
+ * Commands that only add up are merged while one of their type is pending, volume steps are summed, and a play
+ * makes every jump before it obsolete, so the audio task skips them. Shutdown bypasses the ring, it must never be
+ * dropped.
+ */
+class CommandBus {
+   public:
+    static constexpr uint32_t CAPACITY = 16;
+
+    // For the host simulator, called by the task that posted or received a command
+    using Trace = void (*)(const AudioCommand& command);
+
+   public:
+    CommandBus();
+
+    // The task that receives, commands posted before are kept until it does
+    void setConsumer(TaskHandle_t consumer);
+
+    // Any task, false if the command had to be dropped
+    bool post(const AudioCommand& command);
+
+    // Consumer: false if there is nothing to do
+    bool receive(AudioCommand& command);
+
+    // Consumer: whether the next command is a jump
+    bool jumpPending() const;
+
+    static void trace(Trace posted, Trace received);
+
+   private:
+    struct Slot {
+        // The position the slot is free for, plus one once the command for that position has been written
+        std::atomic<uint32_t> sequence;
+        AudioCommand command;
+    };
+
+    bool push(const AudioCommand& command);
+
+    bool isReady(uint32_t position) const;
+
+    // Consumer: a play follows the command at the tail
+    bool playFollows() const;
+
+    void notify();
+
+   private:
+    Slot slots[CAPACITY];
+
+    std::atomic<uint32_t> head{0};
+
+    // Consumer only
+    uint32_t tail{0};
+
+    // A command of the type is in the ring
+    std::atomic<bool> merging[AudioCommand::cmdCount];
+    std::atomic<int32_t> volumeSteps{0};
+
+    // Written before the flag is set, only the power module stops the audio
+    AudioCommand shutdownCommand;
+    std::atomic<bool> shutdown{false};
+    std::atomic<TaskHandle_t> consumer{nullptr};
+
+   private:
+    CommandBus(const CommandBus&) = delete;
+
+    CommandBus(CommandBus&&) = delete;
+
+    CommandBus& operator=(const CommandBus&) = delete;
+
+    CommandBus& operator=(CommandBus&&) = delete;
+};
+
+#endif  // COMMAND_BUS_HXX
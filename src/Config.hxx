@@ -1,15 +1,33 @@
 #ifndef CONFIG_HXX
 #define CONFIG_HXX
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include "Command.hxx"
+#include "Equalizer.hxx"
+#include "RfidMap.hxx"
 
 class Config {
    public:
-    virtual const Command::Command& commandForRfid(const std::string& uid) = 0;
+    // nullptr if the card is not mapped
+    virtual const Command::Command* commandForRfid(const RfidMap::Uid& uid) = 0;
 
-    virtual bool isRfidMapped(const std::string& uid) = 0;
+    // Every card that is mapped, once the config has been loaded
+    virtual const RfidMap& rfidMappings() = 0;
+
+    // Albums that are transcoded to PCM in the background
+    virtual const std::vector<std::string>& transcodeAlbums() = 0;
+
+    // Playback speed of an album in percent, 100 if it is played at normal speed
+    virtual uint32_t playbackSpeed(const std::string& album) = 0;
+
+    // Bands of the speaker EQ
+    virtual const std::vector<Equalizer::Band>& equalizerBands() = 0;
+
+    // Bass boost in dB at the lowest volume, 0 if there is no loudness compensation
+    virtual float loudnessCompensation() = 0;
 
    protected:
     Config() = default;
@@ -0,0 +1,152 @@
+#include "CueSheet.hxx"
+
+#include <strings.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "Guard.hxx"
+#include "Log.hxx"
+
+#define TAG "cue"
+
+namespace {
+
+constexpr size_t LINE_SIZE = 512;
+constexpr uint32_t FRAMES_PER_SECOND = 75;
+
+char* skipSpace(char* s) {
+    while (*s == ' ' || *s == '\t') s++;
+
+    return s;
+}
+
+// Case insensitive match of a command at the start of the line
+bool isCommand(const char* line, const char* command, char*& arguments) {
+    size_t len = strlen(command);
+
+    if (strncasecmp(line, command, len) != 0 || (line[len] != ' ' && line[len] != '\t')) return false;
+
+    arguments = skipSpace(const_cast<char*>(line + len));
+
+    return true;
+}
+
+// A quoted string or everything up to the next whitespace
+void readArgument(const char* arguments, char* target) {
+    bool quoted = *arguments == '"';
+    const char* s = quoted ? arguments + 1 : arguments;
+    char* out = target;
+
+    while (*s && out < target + CueSheet::Track::FIELD_SIZE - 1) {
+        if (quoted ? *s == '"' : (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')) break;
+
+        *(out++) = static_cast<uint8_t>(*s) < 0x20 ? ' ' : *s;
+        s++;
+    }
+
+    *out = 0;
+}
+
+// mm:ss:ff with 75 frames per second, minutes may exceed 99 for long files
+bool parseTime(const char* s, uint32_t& milliseconds) {
+    char* end;
+    uint32_t minutes = strtoul(s, &end, 10);
+    if (end == s || *end != ':') return false;
+
+    s = end + 1;
+    uint32_t seconds = strtoul(s, &end, 10);
+    if (end == s || *end != ':') return false;
+
+    s = end + 1;
+    uint32_t frames = strtoul(s, &end, 10);
+    if (end == s || seconds >= 60 || frames >= FRAMES_PER_SECOND) return false;
+
+    milliseconds = (minutes * 60 + seconds) * 1000 + frames * 1000 / FRAMES_PER_SECOND;
+
+    return true;
+}
+
+}  // namespace
+
+bool CueSheet::read(const char* path, const TrackCallback& callback) {
+    FILE* file = fopen(path, "r");
+    if (!file) return false;
+
+    // Too large for the stack of the audio task: the sheet defaults, the track that is being parsed
+    // and the previous track that waits for the start of its successor as its end
+    Track* tracks = new Track[3]();
+
+    Guard guard([=]() {
+        delete[] tracks;
+        fclose(file);
+    });
+
+    Track& sheet = tracks[0];
+    Track* current = &tracks[1];
+    Track* previous = &tracks[2];
+
+    bool inTrack = false, hasIndex = false, hasPrevious = false;
+    uint32_t count = 0;
+
+    auto finishTrack = [&]() {
+        if (inTrack && hasIndex) {
+            if (hasPrevious) {
+                bool sameFile = strcmp(previous->file, current->file) == 0 && current->start > previous->start;
+
+                previous->end = sameFile ? current->start : 0;
+                callback(*previous);
+                count++;
+            }
+
+            std::swap(current, previous);
+            hasPrevious = true;
+        }
+
+        inTrack = hasIndex = false;
+    };
+
+    char line[LINE_SIZE];
+    char* arguments;
+
+    while (fgets(line, sizeof(line), file)) {
+        char* s = skipSpace(line);
+
+        // UTF-8 byte order mark
+        if (memcmp(s, "\xef\xbb\xbf", 3) == 0) s = skipSpace(s + 3);
+
+        if (isCommand(s, "FILE", arguments)) {
+            finishTrack();
+            readArgument(arguments, sheet.file);
+        } else if (isCommand(s, "TRACK", arguments)) {
+            finishTrack();
+
+            *current = sheet;
+            current->title[0] = 0;
+            inTrack = sheet.file[0] != 0;
+        } else if (isCommand(s, "TITLE", arguments)) {
+            readArgument(arguments, inTrack ? current->title : sheet.album);
+        } else if (isCommand(s, "PERFORMER", arguments)) {
+            readArgument(arguments, inTrack ? current->performer : sheet.performer);
+        } else if (isCommand(s, "INDEX", arguments) && inTrack) {
+            char* time;
+            uint32_t number = strtoul(arguments, &time, 10);
+
+            if (number == 1 && parseTime(skipSpace(time), current->start)) hasIndex = true;
+        }
+    }
+
+    finishTrack();
+
+    if (hasPrevious) {
+        previous->end = 0;
+        callback(*previous);
+        count++;
+    }
+
+    LOG_DEBUG(TAG, "read %u tracks from %s", count, path);
+
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef CUE_SHEET_HXX
+#define CUE_SHEET_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace CueSheet {
+
+struct Track {
+    static constexpr size_t FIELD_SIZE = 128;
+
+    // Audio file relative to the directory of the cue sheet
+    char file[FIELD_SIZE];
+
+    char title[FIELD_SIZE];
+    char performer[FIELD_SIZE];
+    char album[FIELD_SIZE];
+
+    // milliseconds from the start of the file, end is 0 for the last track of a file
+    uint32_t start;
+    uint32_t end;
+};
+
+using TrackCallback = std::function<void(const Track&)>;
+
+/**
+ * Calls back for every track that has an INDEX 01, in the order of the sheet. The sheet title and
+ * performer are the defaults for album and performer of each track. Text is passed through as is,
+ * only control characters are replaced so the fields can go into the index.
+ */
+bool read(const char* path, const TrackCallback& callback);
+
+}  // namespace CueSheet
+
+#endif  // CUE_SHEET_HXX
@@ -0,0 +1,16 @@
+#include "Decoder.hxx"
+
+#include <strings.h>
+
+#include <cstring>
+
+bool Decoder::isSupported(const char* path) {
+    return hasExtension(path, "mp3") || hasExtension(path, "mp2") || hasExtension(path, "wav") ||
+           hasExtension(path, "flac");
+}
+
+bool Decoder::hasExtension(const char* path, const char* extension) {
+    const char* dot = strrchr(path, '.');
+
+    return dot && strcasecmp(dot + 1, extension) == 0;
+}
@@ -0,0 +1,68 @@
+#ifndef DECODER_HXX
+#define DECODER_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+/**
+ * Audio source producing interleaved 16 bit stereo samples at 44.1 kHz. Decoders are only ever
+ * driven in blocks, so the virtual dispatch is paid once per call and never per sample.
+ */
+class Decoder {
+   public:
+    virtual ~Decoder() = default;
+
+    virtual bool open(const char* path) = 0;
+
+    // Returns less than count samples only once the end of the stream has been reached
+    virtual uint32_t decode(int16_t* buffer, uint32_t count) = 0;
+
+    virtual bool isFinished() const = 0;
+
+    virtual void close() = 0;
+
+    // Samples decoded since the last open / rewind / seek
+    virtual uint32_t getPosition() const = 0;
+
+    // milliseconds, 0 if unknown
+    virtual uint32_t getDuration() = 0;
+
+    virtual void rewind() = 0;
+
+    // Corrupt frames that were skipped since the last open
+    virtual uint32_t getErrors() const { return 0; }
+
+    // Opaque, decoder specific position that can be stored and passed to seekTo later
+    virtual size_t getSeekPosition() = 0;
+    virtual void seekTo(uint32_t position) = 0;
+
+    // Samples from the start of the stream, used to play tracks that cover only part of a file. MP3 is frame
+    // accurate at best, both directions go through a seek table and never decode the skipped frames.
+    virtual uint32_t getStreamPosition() = 0;
+    virtual void seekToSample(uint32_t sample) = 0;
+
+    /**
+     * Serialize the complete decoder state so that a freshly opened decoder continues at exactly
+     * the same sample after restoreSnapshot. Only decoders whose seekTo is not sample accurate
+     * implement this, the others return false and are restored via seekTo.
+     */
+    virtual bool saveSnapshot(FILE*) { return false; }
+    virtual bool restoreSnapshot(FILE*) { return false; }
+
+    // Whether there is a decoder for the file type of path
+    static bool isSupported(const char* path);
+
+    // Case insensitive comparison of the extension without the dot
+    static bool hasExtension(const char* path, const char* extension);
+
+   protected:
+    Decoder() = default;
+    Decoder(const Decoder&) = default;
+    Decoder(Decoder&&) = default;
+
+    Decoder& operator=(const Decoder&) = default;
+    Decoder& operator=(Decoder&&) = default;
+};
+
+#endif  // DECODER_HXX
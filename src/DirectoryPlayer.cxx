@@ -1,12 +1,51 @@
 #include "DirectoryPlayer.hxx"
 
+#include <algorithm>
+#include <cstring>
+
+#include "Log.hxx"
+#include "config.h"
+
+#define TAG "player"
+
+namespace {
+
+uint32_t samplesFor(uint32_t milliseconds) { return static_cast<uint64_t>(milliseconds) * SAMPLE_RATE / 1000; }
+
+}  // namespace
+
 DirectoryPlayer::DirectoryPlayer() {}
 
 bool DirectoryPlayer::open(const char* dirname, uint32_t track) {
-    valid = false;
+    prefix = Prefix();
+    this->dirname = dirname;
+
+    return openDirectory(track);
+}
+
+bool DirectoryPlayer::openWithPrefix(const char* dirname, const int16_t* samples, uint32_t count,
+                                     uint32_t headStart) {
+    if (count == 0) return open(dirname);
+
+    directoryReader.close();
+    closeTrack();
+
     this->dirname = dirname;
+    trackIndex = 0;
+    valid = true;
+
+    prefix = Prefix();
+    prefix.samples = samples;
+    prefix.count = count;
+    prefix.headStart = headStart;
+
+    return true;
+}
+
+bool DirectoryPlayer::openDirectory(uint32_t track) {
+    valid = false;
 
-    if (directoryReader.open(dirname) && directoryReader.getLength() > 0) {
+    if (directoryReader.open(dirname.c_str()) && directoryReader.getLength() > 0) {
         trackIndex = track < directoryReader.getLength() ? track : 0;
         openTrack(trackIndex);
 
@@ -19,12 +58,18 @@ bool DirectoryPlayer::open(const char* dirname, uint32_t track) {
 bool DirectoryPlayer::isValid() const { return valid; }
 
 void DirectoryPlayer::rewind() {
+    dropPrefix();
+
+    if (directoryReader.getLength() == 0) return;
+
     trackIndex = 0;
 
     openTrack(trackIndex);
 }
 
 void DirectoryPlayer::previousTrack() {
+    dropPrefix();
+
     if (directoryReader.getLength() == 0) return;
 
     if (trackIndex == 0) {
@@ -36,6 +81,8 @@ void DirectoryPlayer::previousTrack() {
 }
 
 void DirectoryPlayer::nextTrack() {
+    dropPrefix();
+
     if (directoryReader.getLength() == 0) return;
 
     trackIndex = (trackIndex + 1) % directoryReader.getLength();
@@ -44,6 +91,8 @@ void DirectoryPlayer::nextTrack() {
 }
 
 bool DirectoryPlayer::goToTrack(uint32_t index) {
+    dropPrefix();
+
     if (index >= directoryReader.getLength()) return false;
 
     trackIndex = index;
@@ -54,21 +103,77 @@ bool DirectoryPlayer::goToTrack(uint32_t index) {
 }
 
 uint32_t DirectoryPlayer::decode(int16_t* buffer, uint32_t count) {
+    return prefix.samples ? decodePrefix(buffer, count) : decodeTracks(buffer, count);
+}
+
+uint32_t DirectoryPlayer::decodePrefix(int16_t* buffer, uint32_t count) {
+    uint32_t decodedSamples = std::min(count, prefix.count - prefix.position);
+
+    memcpy(buffer, prefix.samples + 2 * prefix.position, 4 * decodedSamples);
+    prefix.position += decodedSamples;
+
+    // The queue has been filled from the prefix, so we can afford to block on the SD now
+    if (!prefix.opened && (prefix.position >= prefix.headStart || prefix.position == prefix.count)) {
+        prefix.opened = true;
+
+        if (!openDirectory(0)) {
+            LOG_WARN(TAG, "failed to open %s after playing cached prefix", dirname.c_str());
+
+            prefix = Prefix();
+            return decodedSamples;
+        }
+    }
+
+    if (!prefix.opened) return decodedSamples;
+
+    // Decode and discard until the decoder has reached the sample that is currently playing. Once the prefix
+    // is exhausted this is no longer throttled.
+    uint32_t budget = prefix.position < prefix.count ? CATCH_UP_FACTOR * count : prefix.position;
+
+    bool albumFinished = false;
+
+    while (budget > 0 && prefix.decoderPosition < prefix.position) {
+        uint32_t skipped = decodeTracks(scratch, std::min(std::min(budget, prefix.position - prefix.decoderPosition),
+                                                          static_cast<uint32_t>(SCRATCH_SIZE)));
+        if (skipped == 0) {
+            albumFinished = true;
+            break;
+        }
+
+        prefix.decoderPosition += skipped;
+        budget -= skipped;
+    }
+
+    if (prefix.decoderPosition < prefix.position && !albumFinished) return decodedSamples;
+
+    LOG_DEBUG(TAG, "decoder took over from cached prefix after %u samples", prefix.position);
+
+    prefix = Prefix();
+
+    return decodedSamples + decodeTracks(buffer + 2 * decodedSamples, count - decodedSamples);
+}
+
+uint32_t DirectoryPlayer::decodeTracks(int16_t* buffer, uint32_t count) {
     uint32_t decodedSamples = 0;
 
-    while (decodedSamples < count && !isFinished()) {
-        if (!decoder.isFinished()) {
-            uint32_t decoded = decoder.decode(buffer, count - decodedSamples);
+    while (decodedSamples < count && trackIndex < directoryReader.getLength()) {
+        if (!isTrackFinished()) {
+            uint32_t n = count - decodedSamples;
+
+            // A virtual track ends at the exact sample, the next one may continue right there
+            if (trackEnd > 0) n = std::min(n, trackEnd - decoder->getStreamPosition());
+
+            uint32_t decoded = decoder->decode(buffer, n);
 
             buffer += 2 * decoded;
             decodedSamples += decoded;
         }
 
-        if (decoder.isFinished()) {
+        if (isTrackFinished()) {
             if (++trackIndex < directoryReader.getLength()) {
-                openTrack(trackIndex);
+                if (!continueTrack(trackIndex)) openTrack(trackIndex);
             } else {
-                decoder.close();
+                closeTrack();
             }
         }
     }
@@ -77,19 +182,126 @@ uint32_t DirectoryPlayer::decode(int16_t* buffer, uint32_t count) {
 }
 
 void DirectoryPlayer::close() {
+    prefix = Prefix();
+
     directoryReader.close();
-    decoder.close();
+    closeTrack();
+}
+
+std::string DirectoryPlayer::transcodedPath(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+
+    return (dot == std::string::npos ? path : path.substr(0, dot)) + ".pcm";
 }
 
 void DirectoryPlayer::openTrack(uint32_t index) {
-    std::string path = dirname + "/" + directoryReader.getTrack(trackIndex);
-    decoder.open(path.c_str());
+    closeTrack();
+
+    const DirectoryReader::TrackInfo* info = directoryReader.getTrackInfo(index);
+    std::string path = dirname + "/" + info->name;
+
+    // Prefer PCM that has been transcoded ahead of time, it plays at a fraction of the CPU cost
+    std::string pcmPath = transcodedPath(path);
+
+    if (wavDecoder.open(pcmPath.c_str())) {
+        decoder = &wavDecoder;
+        path = pcmPath;
+    } else {
+        if (Decoder::hasExtension(path.c_str(), "wav"))
+            decoder = &wavDecoder;
+        else if (Decoder::hasExtension(path.c_str(), "flac"))
+            decoder = &flacDecoder;
+        else
+            decoder = &madDecoder;
+
+        if (!decoder->open(path.c_str())) {
+            LOG_WARN(TAG, "failed to open %s", path.c_str());
+            return;
+        }
+    }
+
+    trackStart = samplesFor(info->start);
+    trackEnd = samplesFor(info->end);
+
+    if (trackStart > 0) decoder->seekToSample(trackStart);
+
+    LOG_INFO(TAG, "now playing %s from %u ms", path.c_str(), info->start);
+}
+
+bool DirectoryPlayer::continueTrack(uint32_t index) {
+    const DirectoryReader::TrackInfo* info = directoryReader.getTrackInfo(index);
+    const DirectoryReader::TrackInfo* previous = directoryReader.getTrackInfo(index - 1);
+
+    if (trackEnd == 0 || decoder->isFinished() || strcmp(info->name, previous->name) != 0 ||
+        samplesFor(info->start) != decoder->getStreamPosition())
+        return false;
+
+    trackStart = samplesFor(info->start);
+    trackEnd = samplesFor(info->end);
+
+    LOG_INFO(TAG, "now playing %s from %u ms", info->name, info->start);
+
+    return true;
 }
 
-void DirectoryPlayer::rewindTrack() { return decoder.rewind(); }
+void DirectoryPlayer::closeTrack() {
+    madDecoder.close();
+    wavDecoder.close();
+    flacDecoder.close();
 
-uint32_t DirectoryPlayer::getTrackPosition() const { return decoder.getPosition(); }
+    trackStart = trackEnd = 0;
+}
+
+bool DirectoryPlayer::isTrackFinished() const {
+    return decoder->isFinished() || (trackEnd > 0 && decoder->getStreamPosition() >= trackEnd);
+}
+
+void DirectoryPlayer::dropPrefix() {
+    if (!prefix.samples) return;
+
+    bool opened = prefix.opened;
+    prefix = Prefix();
+
+    if (!opened) openDirectory(0);
+}
+
+void DirectoryPlayer::rewindTrack() {
+    dropPrefix();
+
+    if (trackStart > 0)
+        decoder->seekToSample(trackStart);
+    else
+        decoder->rewind();
+}
+
+uint32_t DirectoryPlayer::getTrackPosition() const {
+    if (prefix.samples) return prefix.position;
 
-void DirectoryPlayer::seekTo(size_t frame) { decoder.seekTo(frame); }
+    // Counted from the start of the file rather than from the last seek, virtual tracks from their start
+    uint32_t position = decoder->getStreamPosition();
 
-size_t DirectoryPlayer::getSeekPosition() { return decoder.getSeekPosition(); }
+    return position > trackStart ? position - trackStart : 0;
+}
+
+void DirectoryPlayer::seekToTrackPosition(uint32_t position) {
+    dropPrefix();
+
+    decoder->seekToSample(trackStart + position);
+}
+
+void DirectoryPlayer::seekTo(size_t frame) {
+    dropPrefix();
+
+    decoder->seekTo(frame);
+}
+
+size_t DirectoryPlayer::getSeekPosition() { return decoder->getSeekPosition(); }
+
+// While the prefix is playing the decoder is still catching up, so its state is not the one that is heard
+bool DirectoryPlayer::saveSnapshot(FILE* file) { return !prefix.samples && decoder->saveSnapshot(file); }
+
+bool DirectoryPlayer::restoreSnapshot(FILE* file) {
+    dropPrefix();
+
+    return decoder->restoreSnapshot(file);
+}
@@ -2,22 +2,37 @@
 #define DIRECTORY_PLAYER_HXX
 
 #include <cstdint>
+#include <cstdio>
 #include <string>
 
+#include "Decoder.hxx"
 #include "DirectoryReader.hxx"
+#include "FlacDecoder.hxx"
 #include "MadDecoder.hxx"
+#include "WavDecoder.hxx"
 
 class DirectoryPlayer {
+   public:
+    static constexpr uint32_t CATCH_UP_FACTOR = 2;
+    static constexpr uint32_t SCRATCH_SIZE = 256;
+
    public:
     DirectoryPlayer();
 
     bool open(const char* directory, uint32_t track = 0);
 
+    /**
+     * Start playback from already decoded PCM for the beginning of the album. The directory
+     * is opened once headStart samples have been played from the prefix, and the decoder
+     * then catches up in the background and takes over at the exact sample.
+     */
+    bool openWithPrefix(const char* directory, const int16_t* samples, uint32_t count, uint32_t headStart);
+
     bool isValid() const;
 
     uint32_t decode(int16_t* buffer, uint32_t count);
 
-    bool isFinished() { return trackIndex >= directoryReader.getLength(); }
+    bool isFinished() { return !prefix.samples && trackIndex >= directoryReader.getLength(); }
 
     void rewind();
 
@@ -29,27 +44,78 @@ class DirectoryPlayer {
 
     bool goToTrack(uint32_t index);
     uint32_t getTrack() { return trackIndex; }
+    const DirectoryReader::TrackInfo* getTrackInfo() { return directoryReader.getTrackInfo(trackIndex); }
 
     void seekTo(size_t seekPosition);
     size_t getSeekPosition();
 
+    // Snapshot of the current decoder, restoring requires the same track to be open
+    bool saveSnapshot(FILE* file);
+    bool restoreSnapshot(FILE* file);
+
+    // Samples from the start of the track, also after a seek and whether the MP3 or its PCM is played
     uint32_t getTrackPosition() const;
+    void seekToTrackPosition(uint32_t position);
+
+    // Corrupt frames skipped in the current file
+    uint32_t getDecoderErrors() const { return decoder->getErrors(); }
+
+    // PCM needs no decoding, so playing it is cheap
+    bool isPlayingPcm() const { return decoder == &wavDecoder && !prefix.samples; }
 
     void close();
 
+    static std::string transcodedPath(const std::string& path);
+
+   private:
+    struct Prefix {
+        const int16_t* samples{nullptr};
+        uint32_t count{0};
+        uint32_t position{0};
+        uint32_t headStart{0};
+
+        bool opened{false};
+        uint32_t decoderPosition{0};
+    };
+
    private:
     void openTrack(uint32_t index);
 
+    // Continues with the next virtual track of the same file without a seek if it starts where the current one ended
+    bool continueTrack(uint32_t index);
+
+    void closeTrack();
+
+    bool isTrackFinished() const;
+
+    bool openDirectory(uint32_t track);
+
+    uint32_t decodeTracks(int16_t* buffer, uint32_t count);
+
+    uint32_t decodePrefix(int16_t* buffer, uint32_t count);
+
+    void dropPrefix();
+
    private:
     std::string dirname;
 
-    MadDecoder decoder;
+    MadDecoder madDecoder;
+    WavDecoder wavDecoder;
+    FlacDecoder flacDecoder;
+    Decoder* decoder{&madDecoder};
 
     DirectoryReader directoryReader;
 
     bool valid{false};
 
     uint32_t trackIndex{0};
+
+    // Samples from the start of the file for virtual tracks, 0 for the whole file
+    uint32_t trackStart{0};
+    uint32_t trackEnd{0};
+
+    Prefix prefix;
+    int16_t scratch[2 * SCRATCH_SIZE];
 };
 
 #endif  // DIRECTORY_PLAYER_HXX
@@ -5,22 +5,21 @@
 #include <algorithm>
 #include <cstring>
 #include <string>
+#include <vector>
 
+#include "CueSheet.hxx"
+#include "Decoder.hxx"
 #include "Guard.hxx"
 #include "Log.hxx"
+#include "Tag.hxx"
+#include "WavDecoder.hxx"
 
 #define TAG "reader"
 
-namespace {
-bool isMp3(const char* name) {
-    const char* dot = strrchr(name, '.');
-
-    if (!dot || (strlen(name) - (dot - name)) != 4) return false;
-    if (toupper(dot[1]) != 'M' || toupper(dot[2]) != 'P' || dot[3] != '3') return false;
-
-    return true;
-}
+#define INDEX_HEADER "#phonytony index v7"
+#define INDEX_FIELDS 9
 
+namespace {
 bool compareFilenames(const char* n1, const char* n2) {
     char* l1;
     char* l2;
@@ -35,6 +34,79 @@ bool compareFilenames(const char* n1, const char* n2) {
     return i1 < i2;
 }
 
+// Virtual tracks of the same file are ordered by their start
+bool compareTracks(const DirectoryReader::TrackInfo& t1, const DirectoryReader::TrackInfo& t2) {
+    if (strcmp(t1.name, t2.name) == 0) return t1.start < t2.start;
+
+    return compareFilenames(t1.name, t2.name);
+}
+
+int16_t parseGain(const char* field) {
+    return field[0] ? static_cast<int16_t>(strtol(field, nullptr, 10)) : DirectoryReader::NO_GAIN;
+}
+
+// name \t title \t artist \t album \t duration \t start \t end \t track gain \t album gain
+void parseIndexLine(char* line, DirectoryReader::TrackInfo& track) {
+    char* fields[INDEX_FIELDS] = {line};
+    uint32_t i = 1;
+
+    for (; i < INDEX_FIELDS; i++) {
+        char* tab = strchr(fields[i - 1], '\t');
+        if (!tab) break;
+
+        *tab = 0;
+        fields[i] = tab + 1;
+    }
+
+    for (; i < INDEX_FIELDS; i++) fields[i] = fields[i - 1] + strlen(fields[i - 1]);
+
+    track = {.name = fields[0],
+             .title = fields[1],
+             .artist = fields[2],
+             .album = fields[3],
+             .duration = static_cast<uint32_t>(strtoul(fields[4], nullptr, 10)),
+             .start = static_cast<uint32_t>(strtoul(fields[5], nullptr, 10)),
+             .end = static_cast<uint32_t>(strtoul(fields[6], nullptr, 10)),
+             .trackGain = parseGain(fields[7]),
+             .albumGain = parseGain(fields[8])};
+}
+
+// Gains that are unknown are written as empty fields
+bool writeIndexLine(FILE* index, const char* name, const char* title, const char* artist, const char* album,
+                    uint32_t duration, uint32_t start, uint32_t end, int16_t trackGain = DirectoryReader::NO_GAIN,
+                    int16_t albumGain = DirectoryReader::NO_GAIN) {
+    char gains[2][8] = {"", ""};
+
+    if (trackGain != DirectoryReader::NO_GAIN) snprintf(gains[0], sizeof(gains[0]), "%d", trackGain);
+    if (albumGain != DirectoryReader::NO_GAIN) snprintf(gains[1], sizeof(gains[1]), "%d", albumGain);
+
+    return fprintf(index, "%s\t%s\t%s\t%s\t%u\t%u\t%u\t%s\t%s\r\n", name, title, artist, album, duration, start, end,
+                   gains[0], gains[1]) >= 0;
+}
+
+// WAV carries no tags we understand, but we can at least tell the duration
+void readTrackMetadata(const std::string& path, Tag::Metadata& metadata) {
+    metadata.title[0] = metadata.artist[0] = metadata.album[0] = 0;
+    metadata.duration = 0;
+
+    if (Decoder::hasExtension(path.c_str(), "wav")) {
+        WavDecoder decoder;
+        if (decoder.open(path.c_str())) metadata.duration = decoder.getDuration();
+
+        return;
+    }
+
+    FILE* track = fopen(path.c_str(), "r");
+    if (!track) return;
+
+    if (Decoder::hasExtension(path.c_str(), "flac"))
+        Tag::readFlacMetadata(track, metadata);
+    else
+        Tag::readMetadata(track, metadata);
+
+    fclose(track);
+}
+
 bool isDir(const std::string& name) {
     DIR* dir = opendir(name.c_str());
 
@@ -45,6 +117,21 @@ bool isDir(const std::string& name) {
     return true;
 }
 
+// Moves the index that was written to tmpPath over path, or drops it if writing failed, so a reader never sees a
+// partial index
+bool replaceIndex(const std::string& tmpPath, const char* path, bool written) {
+    // FATFS can not rename over an existing file
+    if (written) remove(path);
+
+    if (written && rename(tmpPath.c_str(), path) == 0) return true;
+
+    remove(tmpPath.c_str());
+
+    LOG_WARN(TAG, "failed to write %s", path);
+
+    return false;
+}
+
 }  // namespace
 
 DirectoryReader::DirectoryReader() {}
@@ -55,32 +142,25 @@ bool DirectoryReader::open(const char* dirname) {
     close();
 
     std::string indexPath = std::string(dirname) + "/index";
-    FILE* index = fopen(indexPath.c_str(), "r");
 
-    if (index) {
-        Guard guard([=]() { fclose(index); });
+    if (readIndex(indexPath.c_str())) return true;
 
-        if (!readIndex(index)) return false;
-    } else {
-        DIR* root = opendir(dirname);
-        if (!root) return false;
+    if (!scanDirectory(dirname)) return false;
 
-        Guard guard([=]() { closedir(root); });
+    LOG_INFO(TAG, "building index for %s", dirname);
 
-        if (!scanDirectory(root, dirname)) return false;
+    if (!writeIndex(indexPath.c_str(), dirname)) return true;
 
-        writeIndex(indexPath.c_str());
-    }
-
-    if (length > 0) std::sort(playlist, playlist + length, compareFilenames);
+    close();
 
-    return true;
+    return readIndex(indexPath.c_str()) || scanDirectory(dirname);
 }
 
-bool DirectoryReader::scanDirectory(DIR* root, const char* dirname) {
-    if (!root) {
-        return false;
-    }
+bool DirectoryReader::scanDirectory(const char* dirname) {
+    DIR* root = opendir(dirname);
+    if (!root) return false;
+
+    Guard guard([=]() { closedir(root); });
 
     size_t bufferSize = 0;
     struct dirent* entry;
@@ -88,7 +168,7 @@ bool DirectoryReader::scanDirectory(DIR* root, const char* dirname) {
     while ((entry = readdir(root))) {
         if (isDir(std::string(dirname) + "/" + std::string(entry->d_name))) continue;
 
-        if (!isMp3(entry->d_name)) continue;
+        if (!Decoder::isSupported(entry->d_name)) continue;
 
         bufferSize += (strlen(entry->d_name) + 1);
         length++;
@@ -99,26 +179,43 @@ bool DirectoryReader::scanDirectory(DIR* root, const char* dirname) {
     rewinddir(root);
 
     buffer = (char*)ps_malloc(bufferSize);
-    playlist = (char**)ps_malloc(length * sizeof(char*));
+    playlist = (TrackInfo*)ps_malloc(length * sizeof(TrackInfo));
 
     char* buf = buffer;
     uint32_t i = 0;
 
-    while ((entry = readdir(root))) {
+    while ((entry = readdir(root)) && i < length) {
         if (isDir(std::string(dirname) + "/" + std::string(entry->d_name))) continue;
 
-        if (!isMp3(entry->d_name)) continue;
+        if (!Decoder::isSupported(entry->d_name)) continue;
 
         strcpy(buf, entry->d_name);
 
-        playlist[i++] = buf;
+        playlist[i++] = {.name = buf,
+                         .title = "",
+                         .artist = "",
+                         .album = "",
+                         .duration = 0,
+                         .start = 0,
+                         .end = 0,
+                         .trackGain = NO_GAIN,
+                         .albumGain = NO_GAIN};
         buf += (strlen(entry->d_name) + 1);
     }
 
+    length = i;
+
+    std::sort(playlist, playlist + length, compareTracks);
+
     return true;
 }
 
-bool DirectoryReader::readIndex(FILE* index) {
+bool DirectoryReader::readIndex(const char* path) {
+    FILE* index = fopen(path, "r");
+    if (!index) return false;
+
+    Guard guard([=]() { fclose(index); });
+
     fseek(index, 0, SEEK_END);
     size_t bufferSize = ftell(index) + 1;
     fseek(index, 0, SEEK_SET);
@@ -144,31 +241,150 @@ bool DirectoryReader::readIndex(FILE* index) {
         lastChar = buffer[i];
     }
 
+    if (length == 0 || strcmp(buffer, INDEX_HEADER) != 0) {
+        LOG_INFO(TAG, "index %s is outdated", path);
+
+        close();
+        return false;
+    }
+
+    // the header is no track
+    length--;
+
     if (length == 0) return true;
 
-    playlist = (char**)ps_malloc(length * sizeof(char*));
+    playlist = (TrackInfo*)ps_malloc(length * sizeof(TrackInfo));
     uint32_t iTrack = 0;
-    lastChar = 0;
 
-    for (size_t i = 0; i < bufferSize; i++) {
-        if (buffer[i] != 0 && lastChar == 0) playlist[iTrack++] = &buffer[i];
+    for (size_t i = strlen(INDEX_HEADER); i < bufferSize; i++) {
+        if (buffer[i] == 0) continue;
 
-        lastChar = buffer[i];
+        char* line = &buffer[i];
+        i += strlen(line);
+
+        parseIndexLine(line, playlist[iTrack++]);
     }
 
+    std::sort(playlist, playlist + length, compareTracks);
+
     return true;
 }
 
-void DirectoryReader::writeIndex(const char* path) const {
-    FILE* index = fopen(path, "w");
-    if (!index) return;
+bool DirectoryReader::writeIndex(const char* path, const char* dirname) const {
+    std::string tmpPath = std::string(path) + ".tmp";
+    FILE* index = fopen(tmpPath.c_str(), "w");
+    if (!index) return false;
+
+    bool success = writeIndexLines(index, dirname);
+    success = (fclose(index) == 0) && success;
+
+    return replaceIndex(tmpPath, path, success);
+}
+
+bool DirectoryReader::writeIndexLines(FILE* index, const char* dirname) const {
+    Tag::Metadata metadata;
+
+    if (fputs(INDEX_HEADER "\r\n", index) < 0) return false;
+
+    // Files that are split by a cue sheet are only listed through their tracks
+    std::vector<std::string> splitFiles;
+    std::vector<std::string> cueSheets;
+
+    DIR* dir = opendir(dirname);
+    struct dirent* entry;
+
+    while (dir && (entry = readdir(dir))) {
+        if (Decoder::hasExtension(entry->d_name, "cue")) cueSheets.push_back(entry->d_name);
+    }
+
+    if (dir) closedir(dir);
+
+    bool success = true;
+
+    for (auto& cueSheet : cueSheets) {
+        std::string file;
+        uint32_t fileDuration = 0;
+
+        CueSheet::read((std::string(dirname) + "/" + cueSheet).c_str(), [&](const CueSheet::Track& track) {
+            if (!isInPlaylist(track.file)) return;
+
+            if (file != track.file) {
+                file = track.file;
+                readTrackMetadata(std::string(dirname) + "/" + file, metadata);
+                fileDuration = metadata.duration;
+
+                if (std::find(splitFiles.begin(), splitFiles.end(), file) == splitFiles.end())
+                    splitFiles.push_back(file);
+            }
+
+            uint32_t end = track.end > 0 ? track.end : fileDuration;
+
+            success = writeIndexLine(index, track.file, track.title, track.performer, track.album,
+                                     end > track.start ? end - track.start : 0, track.start, track.end) &&
+                      success;
+        });
+    }
+
+    for (uint32_t i = 0; i < length && success; i++) {
+        if (std::find(splitFiles.begin(), splitFiles.end(), playlist[i].name) != splitFiles.end()) continue;
+
+        std::string trackPath = std::string(dirname) + "/" + playlist[i].name;
+        uint32_t chapters = 0;
+
+        readTrackMetadata(trackPath, metadata);
+
+        if (Decoder::hasExtension(playlist[i].name, "mp3")) {
+            FILE* track = fopen(trackPath.c_str(), "r");
+
+            if (track) {
+                Tag::readChapters(track, [&](const Tag::Chapter& chapter) {
+                    success = writeIndexLine(index, playlist[i].name, chapter.title[0] ? chapter.title : metadata.title,
+                                             metadata.artist, metadata.album, chapter.end - chapter.start,
+                                             chapter.start, chapter.end) &&
+                              success;
+                    chapters++;
+                });
+
+                fclose(track);
+            }
+        }
+
+        if (chapters == 0)
+            success = writeIndexLine(index, playlist[i].name, metadata.title, metadata.artist, metadata.album,
+                                     metadata.duration, 0, 0);
+    }
+
+    return success;
+}
+
+bool DirectoryReader::writeGains(const char* dirname, const int16_t* trackGains, int16_t albumGain) {
+    std::string path = std::string(dirname) + "/index";
+    std::string tmpPath = path + ".tmp";
+    FILE* index = fopen(tmpPath.c_str(), "w");
+    if (!index) return false;
+
+    bool success = fputs(INDEX_HEADER "\r\n", index) >= 0;
+
+    for (uint32_t i = 0; i < length && success; i++) {
+        TrackInfo& track = playlist[i];
 
-    for (uint32_t i = 0; i < length; i++) {
-        fputs(playlist[i], index);
-        fputs("\r\n", index);
+        track.trackGain = trackGains[i];
+        track.albumGain = albumGain;
+
+        success = writeIndexLine(index, track.name, track.title, track.artist, track.album, track.duration,
+                                 track.start, track.end, track.trackGain, track.albumGain);
     }
 
-    fclose(index);
+    success = (fclose(index) == 0) && success;
+
+    return replaceIndex(tmpPath, path.c_str(), success);
+}
+
+bool DirectoryReader::isInPlaylist(const char* name) const {
+    for (uint32_t i = 0; i < length; i++)
+        if (strcmp(playlist[i].name, name) == 0) return true;
+
+    return false;
 }
 
 void DirectoryReader::close() {
@@ -7,6 +7,28 @@
 #include <cstdio>
 
 class DirectoryReader {
+   public:
+    struct TrackInfo {
+        const char* name;
+        const char* title;
+        const char* artist;
+        const char* album;
+
+        // milliseconds
+        uint32_t duration;
+
+        // Chapters of a cue sheet or ID3 CHAP frames are virtual tracks covering only part of a file. Both are
+        // milliseconds, end is 0 for the end of the file.
+        uint32_t start;
+        uint32_t end;
+
+        // Hundredths of a dB that normalize the loudness of the track and of its album, NO_GAIN if not analyzed
+        int16_t trackGain;
+        int16_t albumGain;
+    };
+
+    static constexpr int16_t NO_GAIN = INT16_MIN;
+
    public:
     DirectoryReader();
 
@@ -16,22 +38,33 @@ class DirectoryReader {
 
     void close();
 
-    const char* getTrack(uint32_t index) { return index < length ? playlist[index] : nullptr; }
+    const char* getTrack(uint32_t index) { return index < length ? playlist[index].name : nullptr; }
+
+    const TrackInfo* getTrackInfo(uint32_t index) { return index < length ? &playlist[index] : nullptr; }
 
     uint32_t getLength() const { return length; }
 
+    // Rewrites the index of the open directory with the gains from a loudness analysis, in playlist order. The old
+    // index stays in place if writing fails.
+    bool writeGains(const char* dirname, const int16_t* trackGains, int16_t albumGain);
+
    private:
     char* buffer{nullptr};
 
-    char** playlist{nullptr};
+    TrackInfo* playlist{nullptr};
 
     uint32_t length{0};
 
-    bool scanDirectory(DIR* root, const char* dirname);
+    bool scanDirectory(const char* dirname);
+
+    bool readIndex(const char* path);
+
+    // Written next to the index first and renamed once complete
+    bool writeIndex(const char* path, const char* dirname) const;
 
-    bool readIndex(FILE* index);
+    bool writeIndexLines(FILE* index, const char* dirname) const;
 
-    void writeIndex(const char* path) const;
+    bool isInPlaylist(const char* name) const;
 
    private:
     DirectoryReader(const DirectoryReader&) = delete;
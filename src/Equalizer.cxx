@@ -0,0 +1,179 @@
+#include "Equalizer.hxx"
+
+#include <cmath>
+#include <cstring>
+
+#include "Log.hxx"
+#include "config.h"
+
+#define TAG "eq"
+
+namespace {
+
+// Bands below this gain are considered flat
+constexpr float FLAT_GAIN = 0.05f;
+
+// Q28 holds [-8, 8)
+constexpr double COEFFICIENT_LIMIT = 1 << (31 - Equalizer::COEFFICIENT_SHIFT);
+
+inline bool fitsFixed(double coefficient) {
+    return coefficient >= -COEFFICIENT_LIMIT && coefficient < COEFFICIENT_LIMIT;
+}
+
+inline int32_t toFixed(double coefficient) { return lround(coefficient * (1 << Equalizer::COEFFICIENT_SHIFT)); }
+
+inline int16_t saturate(int32_t sample) {
+    return sample > INT16_MAX ? INT16_MAX : (sample < INT16_MIN ? INT16_MIN : sample);
+}
+
+}  // namespace
+
+// Audio EQ cookbook (R. Bristow-Johnson)
+bool Equalizer::design(const Band& band, Biquad& biquad) {
+    if (fabsf(band.gain) < FLAT_GAIN || band.frequency <= 0 || band.frequency >= SAMPLE_RATE / 2 || band.q <= 0)
+        return false;
+
+    double a = pow(10., band.gain / 40.);
+    double w0 = 2. * M_PI * band.frequency / SAMPLE_RATE;
+    double alpha = sin(w0) / (2. * band.q);
+    double c = cos(w0);
+    double b0, b1, b2, a0, a1, a2;
+
+    switch (band.type) {
+        case Band::lowShelf:
+            b0 = a * ((a + 1) - (a - 1) * c + 2 * sqrt(a) * alpha);
+            b1 = 2 * a * ((a - 1) - (a + 1) * c);
+            b2 = a * ((a + 1) - (a - 1) * c - 2 * sqrt(a) * alpha);
+            a0 = (a + 1) + (a - 1) * c + 2 * sqrt(a) * alpha;
+            a1 = -2 * ((a - 1) + (a + 1) * c);
+            a2 = (a + 1) + (a - 1) * c - 2 * sqrt(a) * alpha;
+            break;
+
+        case Band::highShelf:
+            b0 = a * ((a + 1) + (a - 1) * c + 2 * sqrt(a) * alpha);
+            b1 = -2 * a * ((a - 1) + (a + 1) * c);
+            b2 = a * ((a + 1) + (a - 1) * c - 2 * sqrt(a) * alpha);
+            a0 = (a + 1) - (a - 1) * c + 2 * sqrt(a) * alpha;
+            a1 = 2 * ((a - 1) - (a + 1) * c);
+            a2 = (a + 1) - (a - 1) * c - 2 * sqrt(a) * alpha;
+            break;
+
+        default:
+            b0 = 1 + alpha * a;
+            b1 = -2 * c;
+            b2 = 1 - alpha * a;
+            a0 = 1 + alpha / a;
+            a1 = -2 * c;
+            a2 = 1 - alpha / a;
+    }
+
+    if (!(fitsFixed(b0 / a0) && fitsFixed(b1 / a0) && fitsFixed(b2 / a0) && fitsFixed(a1 / a0) && fitsFixed(a2 / a0))) {
+        LOG_WARN(TAG, "band at %.0f Hz with %.1f dB does not fit into fixed point, dropped", band.frequency, band.gain);
+        return false;
+    }
+
+    biquad = {.b0 = toFixed(b0 / a0),
+              .b1 = toFixed(b1 / a0),
+              .b2 = toFixed(b2 / a0),
+              .a1 = toFixed(a1 / a0),
+              .a2 = toFixed(a2 / a0)};
+
+    return true;
+}
+
+void Equalizer::initialize(const std::vector<Band>& bands, float loudnessGain) {
+    bandCount = 0;
+
+    for (const Band& band : bands) {
+        if (bandCount == MAX_BANDS) {
+            LOG_WARN(TAG, "only %u bands are supported", MAX_BANDS);
+            break;
+        }
+
+        if (design(band, biquads[bandCount])) bandCount++;
+    }
+
+    loudnessActive = false;
+
+    for (uint32_t level = 0; level < LOUDNESS_LEVELS; level++) {
+        Band shelf = {.type = Band::lowShelf,
+                      .frequency = LOUDNESS_FREQUENCY,
+                      .gain = loudnessGain * (LOUDNESS_LEVELS - 1 - level) / (LOUDNESS_LEVELS - 1),
+                      .q = 0.7071f};
+
+        loudnessFlat[level] = !design(shelf, loudness[level]);
+        loudnessActive = loudnessActive || !loudnessFlat[level];
+    }
+
+    memset(states, 0, sizeof(states));
+    memset(loudnessState, 0, sizeof(loudnessState));
+
+    LOG_INFO(TAG, "%u bands, loudness compensation %s", bandCount, loudnessActive ? "on" : "off");
+}
+
+// A flat shelf passes the signal through, so its history follows the signal to start without a click once it is needed
+template <typename T>
+void Equalizer::bypassLoudness(const T* samples, uint32_t count) {
+    if (!loudnessActive || count < 2) return;
+
+    for (uint32_t channel = 0; channel < 2; channel++) {
+        int32_t x1 = samples[2 * (count - 1) + channel], x2 = samples[2 * (count - 2) + channel];
+
+        loudnessState[channel] = {.x1 = x1, .x2 = x2, .y1 = x1, .y2 = x2, .error = 0};
+    }
+}
+
+void Equalizer::process(int16_t* samples, uint32_t count, int32_t volume) {
+    if (!isActive()) return;
+
+    if (count > MAX_SAMPLES) count = MAX_SAMPLES;
+
+    int32_t level = volume * static_cast<int32_t>(LOUDNESS_LEVELS - 1) / VOLUME_LIMIT;
+    level = level < 0 ? 0 : (level >= static_cast<int32_t>(LOUDNESS_LEVELS) ? LOUDNESS_LEVELS - 1 : level);
+
+    bool shelf = loudnessActive && !loudnessFlat[level];
+
+    if (bandCount == 0 && !shelf) {
+        bypassLoudness(samples, count);
+        return;
+    }
+
+    for (uint32_t i = 0; i < 2 * count; i++) scratch[i] = samples[i];
+
+    for (uint32_t band = 0; band < bandCount; band++) filter(biquads[band], states[band], count);
+
+    if (shelf)
+        filter(loudness[level], loudnessState, count);
+    else
+        bypassLoudness(scratch, count);
+
+    for (uint32_t i = 0; i < 2 * count; i++) samples[i] = saturate(scratch[i]);
+}
+
+// One band over the whole chunk, so the coefficients stay in registers. Poles close to DC amplify the
+// truncation of the output a lot, so the truncated fraction is fed back into the next sample.
+void Equalizer::filter(const Biquad& biquad, State* state, uint32_t count) {
+    for (uint32_t channel = 0; channel < 2; channel++) {
+        State s = state[channel];
+        int32_t* sample = scratch + channel;
+
+        for (uint32_t i = 0; i < count; i++, sample += 2) {
+            int32_t x = *sample;
+            int64_t accumulator = static_cast<int64_t>(biquad.b0) * x + static_cast<int64_t>(biquad.b1) * s.x1 +
+                                  static_cast<int64_t>(biquad.b2) * s.x2 - static_cast<int64_t>(biquad.a1) * s.y1 -
+                                  static_cast<int64_t>(biquad.a2) * s.y2 + s.error;
+            int32_t y = accumulator >> COEFFICIENT_SHIFT;
+
+            s.error = accumulator & ((1 << COEFFICIENT_SHIFT) - 1);
+
+            s.x2 = s.x1;
+            s.x1 = x;
+            s.y2 = s.y1;
+            s.y1 = y;
+
+            *sample = y;
+        }
+
+        state[channel] = s;
+    }
+}
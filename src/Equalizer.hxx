@@ -0,0 +1,95 @@
+#ifndef EQUALIZER_HXX
+#define EQUALIZER_HXX
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Parametric EQ for the speaker as a cascade of fixed-point biquads (Q28 coefficients, 64 bit
+ * accumulators, direct form I). An optional low shelf adds bass at low volume to compensate for
+ * the hearing curve. All coefficients are computed once from the configuration, a chunk only
+ * picks the loudness shelf for the current volume. Bands that are flat are dropped, and the
+ * whole stage is bypassed if nothing is left.
+ */
+class Equalizer {
+   public:
+    struct Band {
+        enum Type : uint8_t { lowShelf, peaking, highShelf };
+
+        Type type;
+
+        // Hz, dB
+        float frequency;
+        float gain;
+        float q;
+    };
+
+    static constexpr uint32_t MAX_BANDS = 5;
+    static constexpr uint32_t MAX_SAMPLES = 256;
+
+    static constexpr uint32_t COEFFICIENT_SHIFT = 28;
+
+    // Configured bands are clamped to these. A shelf boosts its coefficients by its gain, past 12 dB they may not fit
+    // into Q28 any more.
+    static constexpr float MAX_GAIN = 12.f;
+    static constexpr float MIN_Q = 0.1f;
+    static constexpr float MAX_Q = 10.f;
+
+    // The loudness shelf boosts by the configured gain at volume 0 and fades out towards VOLUME_LIMIT
+    static constexpr float LOUDNESS_FREQUENCY = 120.f;
+    static constexpr uint32_t LOUDNESS_LEVELS = 11;
+
+   public:
+    Equalizer() = default;
+
+    // loudness is the bass boost in dB at the lowest volume, 0 disables it
+    void initialize(const std::vector<Band>& bands, float loudness);
+
+    bool isActive() const { return bandCount > 0 || loudnessActive; }
+
+    void process(int16_t* samples, uint32_t count, int32_t volume);
+
+   private:
+    struct Biquad {
+        int32_t b0, b1, b2, a1, a2;
+    };
+
+    struct State {
+        int32_t x1, x2, y1, y2;
+
+        // The fraction that was cut off the last output
+        int32_t error;
+    };
+
+   private:
+    static bool design(const Band& band, Biquad& biquad);
+
+    void filter(const Biquad& biquad, State* state, uint32_t count);
+
+    template <typename T>
+    void bypassLoudness(const T* samples, uint32_t count);
+
+   private:
+    Biquad biquads[MAX_BANDS];
+    State states[MAX_BANDS][2];
+    uint32_t bandCount{0};
+
+    // One shelf per volume step, flat levels are not filtered
+    Biquad loudness[LOUDNESS_LEVELS];
+    bool loudnessFlat[LOUDNESS_LEVELS];
+    State loudnessState[2];
+    bool loudnessActive{false};
+
+    int32_t scratch[2 * MAX_SAMPLES];
+
+   private:
+    Equalizer(const Equalizer&) = delete;
+
+    Equalizer(Equalizer&&) = delete;
+
+    Equalizer& operator=(const Equalizer&) = delete;
+
+    Equalizer& operator=(Equalizer&&) = delete;
+};
+
+#endif  // EQUALIZER_HXX
@@ -0,0 +1,664 @@
+#include "FlacDecoder.hxx"
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "Log.hxx"
+#include "config.h"
+
+#define TAG "flac"
+
+namespace {
+
+constexpr uint32_t FLAC_MARKER = 0x664c6143;  // "fLaC"
+
+constexpr uint32_t BLOCK_STREAMINFO = 0;
+constexpr uint32_t BLOCK_SEEKTABLE = 3;
+constexpr uint32_t STREAMINFO_SIZE = 34;
+constexpr uint32_t SEEK_POINT_SIZE = 18;
+constexpr uint32_t PLACEHOLDER_POINT = 0xffffffff;
+
+constexpr uint32_t MAX_FRAME_HEADER_SIZE = 16;
+constexpr uint32_t MAX_LPC_ORDER = 32;
+constexpr uint32_t MAX_BITS_PER_SAMPLE = 24;
+
+constexpr uint32_t CHANNELS_LEFT_SIDE = 8;
+constexpr uint32_t CHANNELS_RIGHT_SIDE = 9;
+constexpr uint32_t CHANNELS_MID_SIDE = 10;
+
+// Without a seek table we guess the offset from the average bitrate and start this much earlier
+constexpr size_t SEEK_ESTIMATE_MARGIN = 0x10000;
+
+const uint32_t SAMPLE_SIZES[8] = {0, 8, 12, 0, 16, 20, 24, 0};
+
+uint8_t crc8(const uint8_t* data, size_t len) {
+    uint8_t crc = 0;
+
+    while (len--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+
+    return crc;
+}
+
+// Codes 6 and 7 are stored at the end of the header and handled by the caller
+uint32_t blockSizeForCode(uint32_t code) {
+    if (code == 1) return 192;
+    if (code >= 2 && code <= 5) return 576 << (code - 2);
+    if (code >= 8) return 256 << (code - 8);
+
+    return 0;
+}
+
+}  // namespace
+
+FlacDecoder::FlacDecoder() {}
+
+FlacDecoder::~FlacDecoder() {
+    close();
+
+    free(blockBuffer);
+    free(seekTable);
+}
+
+bool FlacDecoder::allocateBuffers() {
+    if (blockBuffer) return true;
+
+    blockBuffer = (int32_t*)ps_malloc(2 * MAX_BLOCK_SIZE * sizeof(int32_t));
+    seekTable = (SeekPoint*)ps_malloc(MAX_SEEK_POINTS * sizeof(SeekPoint));
+
+    if (!blockBuffer || !seekTable) {
+        LOG_WARN(TAG, "failed to allocate FLAC buffers");
+
+        free(blockBuffer);
+        free(seekTable);
+        blockBuffer = nullptr;
+        seekTable = nullptr;
+
+        return false;
+    }
+
+    channelSamples[0] = blockBuffer;
+    channelSamples[1] = blockBuffer + MAX_BLOCK_SIZE;
+
+    return true;
+}
+
+bool FlacDecoder::open(const char* path) {
+    close();
+
+    if (!allocateBuffers()) return false;
+
+    file = fopen(path, "r");
+    if (!file) return false;
+
+    fseek(file, 0, SEEK_END);
+    fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    filePosition = inputLength = inputPosition = 0;
+    cache = 0;
+    cacheBits = 0;
+    endOfInput = false;
+    seekPointCount = 0;
+    errors = 0;
+
+    if (!readMetadata()) {
+        LOG_WARN(TAG, "unsupported FLAC file %s", path);
+
+        close();
+        return false;
+    }
+
+    rewind();
+
+    return true;
+}
+
+bool FlacDecoder::readMetadata() {
+    if (readBits(32) != FLAC_MARKER) return false;
+
+    bool hasStreamInfo = false;
+    bool last = false;
+
+    while (!last) {
+        last = readBits(1);
+        uint32_t type = readBits(7);
+        uint32_t length = readBits(24);
+
+        if (endOfInput) return false;
+
+        if (type == BLOCK_STREAMINFO && length >= STREAMINFO_SIZE) {
+            readBits(16);
+            maxBlockSize = readBits(16);
+            readBits(24);
+            readBits(24);
+
+            uint32_t sampleRate = readBits(20);
+            channels = readBits(3) + 1;
+            bitsPerSample = readBits(5) + 1;
+
+            // We only keep 32 bits of the sample count, that is good for 27 hours
+            uint32_t totalSamplesHigh = readBits(4);
+            totalSamples = totalSamplesHigh ? 0xffffffff : readBits(32);
+
+            // MD5 signature
+            setBytePosition(bytePosition() + 16 + length - STREAMINFO_SIZE);
+
+            if (sampleRate != SAMPLE_RATE || channels > 2 || bitsPerSample > MAX_BITS_PER_SAMPLE ||
+                maxBlockSize > MAX_BLOCK_SIZE)
+                return false;
+
+            hasStreamInfo = true;
+        } else if (type == BLOCK_SEEKTABLE) {
+            readSeekTable(length);
+        } else {
+            setBytePosition(bytePosition() + length);
+        }
+    }
+
+    firstFrame = bytePosition();
+
+    return hasStreamInfo && !endOfInput;
+}
+
+void FlacDecoder::readSeekTable(uint32_t length) {
+    uint32_t points = length / SEEK_POINT_SIZE;
+
+    // Oversized tables are thinned out, resuming then takes a bit longer
+    uint32_t stride = (points + MAX_SEEK_POINTS - 1) / MAX_SEEK_POINTS;
+
+    for (uint32_t i = 0; i < points; i++) {
+        uint32_t sampleHigh = readBits(32);
+        uint32_t sample = readBits(32);
+        uint32_t offsetHigh = readBits(32);
+        uint32_t offset = readBits(32);
+        readBits(16);
+
+        if (sampleHigh == PLACEHOLDER_POINT || sampleHigh != 0 || offsetHigh != 0) continue;
+        if (i % stride != 0 || seekPointCount >= MAX_SEEK_POINTS) continue;
+
+        seekTable[seekPointCount++] = {.sample = sample, .offset = offset};
+    }
+
+    setBytePosition(bytePosition() + length % SEEK_POINT_SIZE);
+}
+
+uint32_t FlacDecoder::decode(int16_t* buffer, uint32_t count) {
+    if (finished) return 0;
+
+    uint32_t decodedSamples = 0;
+
+    while (decodedSamples < count) {
+        if (blockPosition >= blockSize && !decodeFrame()) {
+            finished = true;
+
+            LOG_DEBUG(TAG, "decoding finished after %u samples", streamPosition);
+            break;
+        }
+
+        uint32_t n = std::min(count - decodedSamples, blockSize - blockPosition);
+
+        const int32_t* left = channelSamples[0] + blockPosition;
+        const int32_t* right = channelSamples[channels - 1] + blockPosition;
+        int16_t* out = buffer + 2 * decodedSamples;
+
+        if (blockBitsPerSample >= 16) {
+            uint32_t shift = blockBitsPerSample - 16;
+
+            for (uint32_t i = 0; i < n; i++) {
+                out[2 * i] = left[i] >> shift;
+                out[2 * i + 1] = right[i] >> shift;
+            }
+        } else {
+            int32_t scale = 1 << (16 - blockBitsPerSample);
+
+            for (uint32_t i = 0; i < n; i++) {
+                out[2 * i] = left[i] * scale;
+                out[2 * i + 1] = right[i] * scale;
+            }
+        }
+
+        blockPosition += n;
+        streamPosition += n;
+        decodedSamples += n;
+    }
+
+    position += decodedSamples;
+
+    return decodedSamples;
+}
+
+bool FlacDecoder::decodeFrame() {
+    FrameHeader header;
+
+    while (readFrameHeader(header)) {
+        size_t headerEnd = bytePosition();
+        bool success = true;
+
+        for (uint32_t channel = 0; channel < channels && success; channel++) {
+            bool isSide = (header.channelAssignment == CHANNELS_LEFT_SIDE && channel == 1) ||
+                          (header.channelAssignment == CHANNELS_RIGHT_SIDE && channel == 0) ||
+                          (header.channelAssignment == CHANNELS_MID_SIDE && channel == 1);
+
+            success = decodeSubframe(channelSamples[channel], header.blockSize, header.bitsPerSample + isSide);
+        }
+
+        if (endOfInput) return false;
+
+        if (success) {
+            // We rely on the header CRC and the sanity checks while decoding and skip the frame CRC
+            alignToByte();
+            readBits(16);
+
+            decorrelate(header.channelAssignment, header.blockSize);
+
+            blockSize = header.blockSize;
+            blockPosition = 0;
+            blockBitsPerSample = header.bitsPerSample;
+            streamPosition = header.firstSample;
+
+            return true;
+        }
+
+        LOG_DEBUG(TAG, "skipping corrupt frame at sample %u", header.firstSample);
+        errors++;
+
+        setBytePosition(headerEnd);
+    }
+
+    return false;
+}
+
+bool FlacDecoder::readFrameHeader(FrameHeader& header) {
+    uint8_t raw[MAX_FRAME_HEADER_SIZE];
+
+    while (true) {
+        alignToByte();
+
+        size_t start = bytePosition();
+        frameStart = start;
+
+        raw[0] = readBits(8);
+        if (endOfInput) return false;
+        if (raw[0] != 0xff) continue;
+
+        raw[1] = readBits(8);
+        raw[2] = readBits(8);
+        raw[3] = readBits(8);
+
+        uint32_t len = 4;
+        uint32_t blockSizeCode = raw[2] >> 4;
+        uint32_t sampleRateCode = raw[2] & 0x0f;
+        uint32_t sampleSizeCode = (raw[3] >> 1) & 0x07;
+
+        header.channelAssignment = raw[3] >> 4;
+
+        bool valid = (raw[1] & 0xfe) == 0xf8 && blockSizeCode != 0 && sampleRateCode != 0x0f &&
+                     header.channelAssignment <= CHANNELS_MID_SIDE && (raw[3] & 0x01) == 0 &&
+                     SAMPLE_SIZES[sampleSizeCode] <= MAX_BITS_PER_SAMPLE &&
+                     (sampleSizeCode == 0 || SAMPLE_SIZES[sampleSizeCode] != 0) &&
+                     (header.channelAssignment < CHANNELS_LEFT_SIDE ? header.channelAssignment + 1 : 2) == channels;
+
+        // UTF-8 style coded frame or sample number
+        uint64_t number = 0;
+
+        if (valid) {
+            uint8_t first = raw[len++] = readBits(8);
+            uint32_t leadingOnes = 0;
+
+            while (leadingOnes < 7 && (first & (0x80 >> leadingOnes))) leadingOnes++;
+
+            // 0xxxxxxx for a single byte, 110xxxxx 10xxxxxx for two and so on
+            valid = leadingOnes != 1 && leadingOnes < 7;
+            number = first & (0xff >> (leadingOnes + 1));
+
+            uint32_t extraBytes = leadingOnes ? leadingOnes - 1 : 0;
+
+            for (uint32_t i = 0; i < extraBytes && valid; i++) {
+                uint8_t byte = raw[len++] = readBits(8);
+
+                valid = (byte & 0xc0) == 0x80;
+                number = (number << 6) | (byte & 0x3f);
+            }
+        }
+
+        if (valid) {
+            header.blockSize = blockSizeForCode(blockSizeCode);
+
+            if (blockSizeCode == 6) {
+                raw[len++] = readBits(8);
+                header.blockSize = raw[len - 1] + 1;
+            } else if (blockSizeCode == 7) {
+                raw[len++] = readBits(8);
+                raw[len++] = readBits(8);
+                header.blockSize = ((raw[len - 2] << 8) | raw[len - 1]) + 1;
+            }
+
+            if (sampleRateCode == 12) {
+                raw[len++] = readBits(8);
+            } else if (sampleRateCode == 13 || sampleRateCode == 14) {
+                raw[len++] = readBits(8);
+                raw[len++] = readBits(8);
+            }
+
+            valid = readBits(8) == crc8(raw, len) && header.blockSize <= MAX_BLOCK_SIZE;
+        }
+
+        if (endOfInput) return false;
+
+        if (!valid) {
+            setBytePosition(start + 1);
+            continue;
+        }
+
+        header.bitsPerSample = sampleSizeCode ? SAMPLE_SIZES[sampleSizeCode] : bitsPerSample;
+        header.firstSample = (raw[1] & 0x01) ? number : number * maxBlockSize;
+
+        return true;
+    }
+}
+
+bool FlacDecoder::decodeSubframe(int32_t* samples, uint32_t blockSize, uint32_t bitsPerSample) {
+    if (readBits(1) != 0) return false;
+
+    uint32_t type = readBits(6);
+    uint32_t wastedBits = readBits(1) ? readUnary() + 1 : 0;
+
+    if (wastedBits >= bitsPerSample) return false;
+    bitsPerSample -= wastedBits;
+
+    if (type == 0) {
+        std::fill(samples, samples + blockSize, readSigned(bitsPerSample));
+    } else if (type == 1) {
+        for (uint32_t i = 0; i < blockSize; i++) samples[i] = readSigned(bitsPerSample);
+    } else if (type >= 8 && type <= 12) {
+        uint32_t order = type - 8;
+        if (order > blockSize) return false;
+
+        for (uint32_t i = 0; i < order; i++) samples[i] = readSigned(bitsPerSample);
+
+        if (!decodeResidual(samples, blockSize, order)) return false;
+
+        switch (order) {
+            case 1:
+                for (uint32_t i = 1; i < blockSize; i++) samples[i] += samples[i - 1];
+                break;
+
+            case 2:
+                for (uint32_t i = 2; i < blockSize; i++) samples[i] += 2 * samples[i - 1] - samples[i - 2];
+                break;
+
+            case 3:
+                for (uint32_t i = 3; i < blockSize; i++)
+                    samples[i] += 3 * (samples[i - 1] - samples[i - 2]) + samples[i - 3];
+                break;
+
+            case 4:
+                for (uint32_t i = 4; i < blockSize; i++)
+                    samples[i] += 4 * (samples[i - 1] + samples[i - 3]) - 6 * samples[i - 2] - samples[i - 4];
+                break;
+        }
+    } else if (type >= 32) {
+        uint32_t order = type - 31;
+        if (order > blockSize) return false;
+
+        for (uint32_t i = 0; i < order; i++) samples[i] = readSigned(bitsPerSample);
+
+        uint32_t precision = readBits(4) + 1;
+        int32_t shift = readSigned(5);
+        if (precision > 15 || shift < 0) return false;
+
+        int32_t coefficients[MAX_LPC_ORDER];
+        for (uint32_t i = 0; i < order; i++) coefficients[i] = readSigned(precision);
+
+        if (!decodeResidual(samples, blockSize, order)) return false;
+
+        // 64 bit accumulation is only required if the sum may overflow
+        if (bitsPerSample + precision + (32 - __builtin_clz(order)) <= 32) {
+            for (uint32_t i = order; i < blockSize; i++) {
+                int32_t sum = 0;
+                for (uint32_t j = 0; j < order; j++) sum += coefficients[j] * samples[i - 1 - j];
+
+                samples[i] += sum >> shift;
+            }
+        } else {
+            for (uint32_t i = order; i < blockSize; i++) {
+                int64_t sum = 0;
+                for (uint32_t j = 0; j < order; j++) sum += static_cast<int64_t>(coefficients[j]) * samples[i - 1 - j];
+
+                samples[i] += sum >> shift;
+            }
+        }
+    } else {
+        return false;
+    }
+
+    if (wastedBits)
+        for (uint32_t i = 0; i < blockSize; i++) samples[i] *= 1 << wastedBits;
+
+    return !endOfInput;
+}
+
+bool FlacDecoder::decodeResidual(int32_t* samples, uint32_t blockSize, uint32_t order) {
+    uint32_t method = readBits(2);
+    if (method > 1) return false;
+
+    uint32_t parameterBits = method == 0 ? 4 : 5;
+    uint32_t escapeCode = method == 0 ? 0x0f : 0x1f;
+
+    uint32_t partitionOrder = readBits(4);
+    uint32_t partitionSize = blockSize >> partitionOrder;
+
+    if ((partitionSize << partitionOrder) != blockSize || partitionSize < order) return false;
+
+    int32_t* out = samples + order;
+
+    for (uint32_t partition = 0; partition < (1u << partitionOrder); partition++) {
+        uint32_t count = partition == 0 ? partitionSize - order : partitionSize;
+        uint32_t parameter = readBits(parameterBits);
+
+        if (parameter == escapeCode) {
+            uint32_t bits = readBits(5);
+            for (uint32_t i = 0; i < count; i++) *out++ = readSigned(bits);
+        } else {
+            uint64_t mask = (static_cast<uint64_t>(1) << parameter) - 1;
+
+            for (uint32_t i = 0; i < count; i++) {
+                if (cacheBits < 32) fill();
+
+                // Fast path for codes that are completely in the cache, which is almost all of them
+                uint64_t aligned = cacheBits ? cache << (64 - cacheBits) : 0;
+                uint32_t zeros = aligned ? __builtin_clzll(aligned) : 64;
+                uint32_t value;
+
+                if (zeros + 1 + parameter <= cacheBits) {
+                    cacheBits -= zeros + 1 + parameter;
+                    value = (zeros << parameter) | ((cache >> cacheBits) & mask);
+                } else {
+                    value = (readUnary() << parameter) | readBits(parameter);
+                }
+
+                *out++ = static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 0x01);
+            }
+        }
+
+        if (endOfInput) return false;
+    }
+
+    return true;
+}
+
+void FlacDecoder::decorrelate(uint32_t channelAssignment, uint32_t blockSize) {
+    int32_t* left = channelSamples[0];
+    int32_t* right = channelSamples[1];
+
+    switch (channelAssignment) {
+        case CHANNELS_LEFT_SIDE:
+            for (uint32_t i = 0; i < blockSize; i++) right[i] = left[i] - right[i];
+            break;
+
+        case CHANNELS_RIGHT_SIDE:
+            for (uint32_t i = 0; i < blockSize; i++) left[i] += right[i];
+            break;
+
+        case CHANNELS_MID_SIDE:
+            for (uint32_t i = 0; i < blockSize; i++) {
+                int32_t side = right[i];
+                int32_t mid = left[i] * 2 | (side & 0x01);
+
+                left[i] = (mid + side) >> 1;
+                right[i] = (mid - side) >> 1;
+            }
+            break;
+    }
+}
+
+bool FlacDecoder::fill() {
+    while (cacheBits <= 56) {
+        if (inputPosition == inputLength) {
+            inputLength = fread(input, 1, INPUT_SIZE, file);
+            inputPosition = 0;
+
+            filePosition += inputLength;
+
+            if (inputLength == 0) return cacheBits > 0;
+        }
+
+        cache = (cache << 8) | input[inputPosition++];
+        cacheBits += 8;
+    }
+
+    return true;
+}
+
+uint32_t FlacDecoder::readBits(uint32_t count) {
+    if (count == 0) return 0;
+
+    if (cacheBits < count && (!fill() || cacheBits < count)) {
+        endOfInput = true;
+        cacheBits = 0;
+
+        return 0;
+    }
+
+    cacheBits -= count;
+
+    return (cache >> cacheBits) & ((static_cast<uint64_t>(1) << count) - 1);
+}
+
+int32_t FlacDecoder::readSigned(uint32_t count) {
+    if (count == 0) return 0;
+
+    return static_cast<int32_t>(readBits(count) << (32 - count)) >> (32 - count);
+}
+
+uint32_t FlacDecoder::readUnary() {
+    uint32_t zeros = 0;
+
+    while (true) {
+        if (cacheBits == 0 && !fill()) {
+            endOfInput = true;
+            return 0;
+        }
+
+        uint64_t aligned = cache << (64 - cacheBits);
+
+        if (aligned) {
+            uint32_t leadingZeros = __builtin_clzll(aligned);
+            cacheBits -= leadingZeros + 1;
+
+            return zeros + leadingZeros;
+        }
+
+        zeros += cacheBits;
+        cacheBits = 0;
+    }
+}
+
+void FlacDecoder::setBytePosition(size_t offset) {
+    size_t bufferStart = filePosition - inputLength;
+
+    cache = 0;
+    cacheBits = 0;
+    endOfInput = false;
+
+    if (offset >= bufferStart && offset <= filePosition) {
+        inputPosition = offset - bufferStart;
+        return;
+    }
+
+    fseek(file, offset, SEEK_SET);
+
+    filePosition = offset;
+    inputLength = inputPosition = 0;
+}
+
+void FlacDecoder::close() {
+    if (file) {
+        LOG_DEBUG(TAG, "decoder closed at offset %u", filePosition);
+
+        fclose(file);
+        file = nullptr;
+    }
+
+    finished = true;
+    blockSize = blockPosition = 0;
+    position = streamPosition = 0;
+}
+
+uint32_t FlacDecoder::getDuration() {
+    return file ? static_cast<uint64_t>(totalSamples) * 1000 / SAMPLE_RATE : 0;
+}
+
+void FlacDecoder::rewind() { seekTo(0); }
+
+void FlacDecoder::seekTo(uint32_t sample) {
+    if (!file) return;
+
+    size_t offset = firstFrame;
+    uint32_t startSample = 0;
+
+    for (uint32_t i = 0; i < seekPointCount && seekTable[i].sample <= sample; i++) {
+        offset = firstFrame + seekTable[i].offset;
+        startSample = seekTable[i].sample;
+    }
+
+    if (seekPointCount == 0 && sample > 0 && totalSamples > 0 && fileSize > firstFrame) {
+        size_t estimate = static_cast<uint64_t>(fileSize - firstFrame) * std::min(sample, totalSamples) / totalSamples;
+
+        offset = firstFrame + (estimate > SEEK_ESTIMATE_MARGIN ? estimate - SEEK_ESTIMATE_MARGIN : 0);
+    }
+
+    setBytePosition(offset);
+
+    blockSize = blockPosition = 0;
+    position = 0;
+    streamPosition = startSample;
+    finished = !skipToFrame(sample);
+}
+
+bool FlacDecoder::skipToFrame(uint32_t sample) {
+    FrameHeader header;
+
+    // Frames are skipped by scanning for the next sync code, which is much cheaper than decoding them
+    while (readFrameHeader(header)) {
+        if (header.firstSample + header.blockSize <= sample) continue;
+
+        setBytePosition(frameStart);
+        if (!decodeFrame()) return false;
+
+        // Without an exact seek point we may have landed behind the target
+        if (streamPosition < sample) {
+            blockPosition = std::min(sample - streamPosition, blockSize);
+            streamPosition += blockPosition;
+        }
+
+        return true;
+    }
+
+    return false;
+}
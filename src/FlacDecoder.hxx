@@ -0,0 +1,140 @@
+#ifndef FLAC_DECODER_HXX
+#define FLAC_DECODER_HXX
+
+#include <cstdint>
+#include <cstdio>
+
+#include "Decoder.hxx"
+
+/**
+ * Integer FLAC decoder for 44.1 kHz streams with one or two channels and up to 24 bits per sample. Frame
+ * and seek table buffers are allocated in PSRAM on the first open and reused for every subsequent file. The
+ * seek position is the absolute sample number, seekTo uses the SEEKTABLE to find a nearby frame.
+ */
+class FlacDecoder : public Decoder {
+   public:
+    // Largest block size of the streamable subset at 44.1 kHz
+    static constexpr uint32_t MAX_BLOCK_SIZE = 4608;
+    static constexpr uint32_t MAX_SEEK_POINTS = 1024;
+    static constexpr uint32_t INPUT_SIZE = 0x800;
+
+   public:
+    FlacDecoder();
+
+    ~FlacDecoder() override;
+
+    bool open(const char* path) override;
+
+    uint32_t decode(int16_t* buffer, uint32_t count) override;
+
+    bool isFinished() const override { return finished; };
+
+    void close() override;
+
+    uint32_t getPosition() const override { return position; }
+
+    uint32_t getDuration() override;
+
+    void rewind() override;
+
+    size_t getSeekPosition() override { return file ? streamPosition : 0; }
+    void seekTo(uint32_t sample) override;
+
+    uint32_t getErrors() const override { return errors; }
+
+    uint32_t getStreamPosition() override { return streamPosition; }
+    void seekToSample(uint32_t sample) override { seekTo(sample); }
+
+   private:
+    struct SeekPoint {
+        uint32_t sample;
+        uint32_t offset;
+    };
+
+    struct FrameHeader {
+        uint32_t firstSample;
+        uint32_t blockSize;
+        uint32_t channelAssignment;
+        uint32_t bitsPerSample;
+    };
+
+   private:
+    bool allocateBuffers();
+
+    bool readMetadata();
+
+    void readSeekTable(uint32_t length);
+
+    bool decodeFrame();
+
+    bool readFrameHeader(FrameHeader& header);
+
+    bool skipToFrame(uint32_t sample);
+
+    bool decodeSubframe(int32_t* samples, uint32_t blockSize, uint32_t bitsPerSample);
+
+    bool decodeResidual(int32_t* samples, uint32_t blockSize, uint32_t order);
+
+    void decorrelate(uint32_t channelAssignment, uint32_t blockSize);
+
+    bool fill();
+
+    uint32_t readBits(uint32_t count);
+
+    int32_t readSigned(uint32_t count);
+
+    uint32_t readUnary();
+
+    void alignToByte() { cacheBits -= cacheBits % 8; }
+
+    size_t bytePosition() const { return filePosition - (inputLength - inputPosition) - cacheBits / 8; }
+
+    void setBytePosition(size_t offset);
+
+   private:
+    FILE* file{nullptr};
+
+    uint8_t input[INPUT_SIZE];
+    size_t inputLength{0};
+    size_t inputPosition{0};
+    size_t filePosition{0};
+
+    uint64_t cache{0};
+    uint32_t cacheBits{0};
+    bool endOfInput{false};
+
+    uint32_t channels{0};
+    uint32_t bitsPerSample{0};
+    uint32_t maxBlockSize{0};
+    uint32_t totalSamples{0};
+    size_t fileSize{0};
+    size_t firstFrame{0};
+    size_t frameStart{0};
+
+    int32_t* blockBuffer{nullptr};
+    int32_t* channelSamples[2]{nullptr, nullptr};
+
+    SeekPoint* seekTable{nullptr};
+    uint32_t seekPointCount{0};
+
+    uint32_t blockSize{0};
+    uint32_t blockPosition{0};
+    uint32_t blockBitsPerSample{0};
+
+    uint32_t position{0};
+    uint32_t streamPosition{0};
+    uint32_t errors{0};
+
+    bool finished{true};
+
+   private:
+    FlacDecoder(const FlacDecoder&) = delete;
+
+    FlacDecoder(FlacDecoder&&) = delete;
+
+    FlacDecoder& operator=(const FlacDecoder&) = delete;
+
+    FlacDecoder& operator=(FlacDecoder&&) = delete;
+};
+
+#endif  // FLAC_DECODER_HXX
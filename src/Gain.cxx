@@ -0,0 +1,77 @@
+#include "Gain.hxx"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "config.h"
+
+namespace {
+
+inline int16_t clamp(int32_t sample) {
+    return sample > INT16_MAX ? INT16_MAX : (sample < INT16_MIN ? INT16_MIN : sample);
+}
+
+// sin^2 + cos^2 = 1 keeps the power constant while uncorrelated signals are mixed
+inline int16_t mix(int32_t in, int32_t out, int32_t inWeight, int32_t outWeight) {
+    return clamp((in * inWeight + out * outWeight) >> Gain::GAIN_SHIFT);
+}
+
+}  // namespace
+
+void Gain::initialize() {
+    for (uint32_t i = 0; i < CROSSFADE_SAMPLES; i++)
+        curve[i] = lroundf(sinf(static_cast<float>(M_PI) / 2 * (i + 0.5f) / CROSSFADE_SAMPLES) * (UNITY - 1));
+
+    gain = 0;
+    silence = false;
+    crossfadeLength = 0;
+}
+
+void Gain::setNormalization(int32_t gain) {
+    normalization = lroundf(UNITY * powf(10.f, gain / 2000.f));
+}
+
+void Gain::fadeOut() { silence = true; }
+
+void Gain::startCrossfade(const int16_t* samples, uint32_t count) {
+    if (count == 0) return;
+
+    // At the end of the stream the old position fades out from silence
+    count = count < CROSSFADE_SAMPLES ? count : CROSSFADE_SAMPLES;
+
+    memcpy(crossfade, samples, 4 * count);
+    memset(crossfade + 2 * count, 0, 4 * (CROSSFADE_SAMPLES - count));
+
+    crossfadeLength = CROSSFADE_SAMPLES;
+}
+
+void Gain::apply(int16_t* samples, uint32_t count, int32_t volume) {
+    if (count == 0) return;
+
+    int32_t target = silence ? 0 : std::min(volume * normalization / VOLUME_FULL, static_cast<int32_t>(MAX_GAIN));
+    int32_t step = (target - gain) / static_cast<int32_t>(count);
+    int32_t g = gain;
+
+    uint32_t fade = crossfadeLength < count ? crossfadeLength : count;
+
+    for (uint32_t i = 0; i < fade; i++) {
+        int32_t in = curve[i], out = curve[CROSSFADE_SAMPLES - 1 - i];
+
+        g += step;
+
+        samples[2 * i] = clamp((mix(samples[2 * i], crossfade[2 * i], in, out) * g) >> GAIN_SHIFT);
+        samples[2 * i + 1] = clamp((mix(samples[2 * i + 1], crossfade[2 * i + 1], in, out) * g) >> GAIN_SHIFT);
+    }
+
+    for (uint32_t i = fade; i < count; i++) {
+        g += step;
+
+        samples[2 * i] = clamp((samples[2 * i] * g) >> GAIN_SHIFT);
+        samples[2 * i + 1] = clamp((samples[2 * i + 1] * g) >> GAIN_SHIFT);
+    }
+
+    gain = target;
+    silence = false;
+    crossfadeLength = 0;
+}
@@ -0,0 +1,63 @@
+#ifndef GAIN_HXX
+#define GAIN_HXX
+
+#include <cstdint>
+
+/**
+ * Applies the volume to the output chunks and ramps it linearly across a chunk whenever it changes,
+ * so that volume steps, pauses and resumes do not click. The ramp step is computed once per chunk, the
+ * samples are only multiplied and shifted. A jump within the stream can be smoothed with a short equal
+ * power crossfade from samples of the old position into the first samples after the jump.
+ */
+class Gain {
+   public:
+    // Q15
+    static constexpr uint32_t GAIN_SHIFT = 15;
+    static constexpr int32_t UNITY = 1 << GAIN_SHIFT;
+
+    // Loudness normalization boosts quiet tracks by at most 6 dB, the output saturates
+    static constexpr int32_t MAX_GAIN = 2 * UNITY;
+
+    // 6 ms at 44.1 kHz
+    static constexpr uint32_t CROSSFADE_SAMPLES = 256;
+
+   public:
+    Gain() = default;
+
+    // Builds the crossfade curve, output starts silent and fades in
+    void initialize();
+
+    // The next chunk ramps down to silence, the one after that fades in again
+    void fadeOut();
+
+    // The next chunk is crossfaded from these samples (interleaved stereo, at most CROSSFADE_SAMPLES)
+    void startCrossfade(const int16_t* samples, uint32_t count);
+
+    // Hundredths of a dB from the loudness analysis in the album index, folded into the volume
+    void setNormalization(int32_t gain);
+
+    // Ramps from the current gain to volume (0 - VOLUME_FULL) across the chunk
+    void apply(int16_t* samples, uint32_t count, int32_t volume);
+
+   private:
+    int32_t gain{0};
+    int32_t normalization{UNITY};
+    bool silence{false};
+
+    // sin(pi / 2 * t) in Q15, the fade out is the same curve backwards
+    int16_t curve[CROSSFADE_SAMPLES];
+
+    int16_t crossfade[2 * CROSSFADE_SAMPLES];
+    uint32_t crossfadeLength{0};
+
+   private:
+    Gain(const Gain&) = delete;
+
+    Gain(Gain&&) = delete;
+
+    Gain& operator=(const Gain&) = delete;
+
+    Gain& operator=(Gain&&) = delete;
+};
+
+#endif  // GAIN_HXX
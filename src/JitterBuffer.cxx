@@ -0,0 +1,179 @@
+#include "JitterBuffer.hxx"
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "Log.hxx"
+
+#define TAG "jitter"
+
+namespace {
+
+// Precedes the blocks in a snapshot
+struct Header {
+    uint32_t count;
+    uint32_t offset;
+};
+
+}  // namespace
+
+JitterBuffer::JitterBuffer() {}
+
+JitterBuffer::~JitterBuffer() {
+    if (blocks) free(blocks);
+}
+
+void JitterBuffer::initialize(uint32_t minimumDepth, uint32_t capacity) {
+    if (blocks) return;
+
+    blocks = (Block*)ps_malloc(capacity * sizeof(Block));
+
+    if (!blocks) {
+        LOG_WARN(TAG, "no PSRAM for %u blocks, falling back to %u", capacity, minimumDepth);
+
+        capacity = minimumDepth;
+        blocks = (Block*)malloc(capacity * sizeof(Block));
+    }
+
+    if (!blocks) {
+        LOG_ERROR(TAG, "failed to allocate jitter buffer");
+        capacity = 0;
+    }
+
+    this->capacity = capacity;
+    this->minimumDepth = std::min(minimumDepth, capacity);
+
+    target = this->minimumDepth;
+
+    space = xSemaphoreCreateBinary();
+    data = xSemaphoreCreateBinary();
+}
+
+bool JitterBuffer::hasSpace() const {
+    return getDepth() < std::min(target.load(std::memory_order_relaxed), capacity);
+}
+
+void JitterBuffer::push() {
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+    xSemaphoreGive(data);
+}
+
+void JitterBuffer::waitForSpace() { xSemaphoreTake(space, portMAX_DELAY); }
+
+void JitterBuffer::wake() { xSemaphoreGive(space); }
+
+bool JitterBuffer::isEmpty() const { return getDepth() == 0; }
+
+bool JitterBuffer::waitForData(TickType_t ticksToWait) {
+    // A give without a wait leaves the semaphore taken, so it may be stale
+    if (!isEmpty()) return true;
+
+    return xSemaphoreTake(data, ticksToWait) == pdTRUE || !isEmpty();
+}
+
+uint32_t JitterBuffer::read(int16_t* buffer, uint32_t count, Tag& played, bool& completed) {
+    uint32_t samplesRead = 0;
+
+    completed = false;
+
+    while (samplesRead < count) {
+        uint32_t position = tail.load(std::memory_order_relaxed);
+        uint32_t depth = head.load(std::memory_order_acquire) - position;
+
+        if (depth == 0) break;
+
+        const Block& block = blocks[position % capacity];
+        uint32_t n = std::min(count - samplesRead, block.count - offset);
+
+        memcpy(buffer + 2 * samplesRead, block.samples + 2 * offset, 4 * n);
+        samplesRead += n;
+        offset += n;
+
+        if (offset < block.count) break;
+
+        played = block.tag;
+        completed = true;
+
+        adapt(depth);
+
+        offset = 0;
+        tail.store(position + 1, std::memory_order_release);
+
+        xSemaphoreGive(space);
+
+        if (played.end) break;
+    }
+
+    return samplesRead;
+}
+
+void JitterBuffer::adapt(uint32_t depth) {
+    uint32_t current = target.load(std::memory_order_relaxed);
+
+    // Above the target after a flush or while the buffer is drained down to a lower target is not a drain
+    peak = std::min(std::max(peak, depth), current);
+
+    uint32_t drain = peak - std::min(peak, depth);
+
+    if (2 * drain > current) {
+        target.store(std::min(2 * drain, capacity), std::memory_order_relaxed);
+        calm = 0;
+
+        LOG_DEBUG(TAG, "drained by %u blocks, target depth %u", drain, target.load(std::memory_order_relaxed));
+    } else if (++calm >= DECAY_INTERVAL && current > minimumDepth) {
+        target.store(current - 1, std::memory_order_relaxed);
+        calm = 0;
+    }
+}
+
+void JitterBuffer::reportUnderrun() {
+    peak = calm = 0;
+    target.store(capacity, std::memory_order_relaxed);
+}
+
+void JitterBuffer::flush() {
+    tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+
+    offset = peak = 0;
+
+    xSemaphoreGive(space);
+}
+
+uint32_t JitterBuffer::getDepth() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+bool JitterBuffer::save(FILE* file) const {
+    uint32_t position = tail.load(std::memory_order_relaxed);
+    Header header = {.count = getDepth(), .offset = offset};
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1) return false;
+
+    for (uint32_t i = 0; i < header.count; i++)
+        if (fwrite(&blocks[(position + i) % capacity], sizeof(Block), 1, file) != 1) return false;
+
+    return true;
+}
+
+bool JitterBuffer::restore(FILE* file, const DirectoryReader::TrackInfo* info) {
+    Header header;
+
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.count > capacity) return false;
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        Block& block = back();
+
+        if (fread(&block, sizeof(Block), 1, file) != 1 || block.count > BLOCK_SAMPLES) return false;
+        if (i == 0 && header.offset > block.count) return false;
+
+        block.tag.info = info;
+        push();
+    }
+
+    offset = header.count > 0 ? header.offset : 0;
+
+    return true;
+}
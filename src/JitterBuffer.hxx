@@ -0,0 +1,133 @@
+#ifndef JITTER_BUFFER_HXX
+#define JITTER_BUFFER_HXX
+
+// clang-format off
+#include <freertos/FreeRTOS.h>
+// clang-format on
+
+#include <freertos/semphr.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include "DirectoryReader.hxx"
+#include "config.h"
+
+/**
+ * Decoded music in PSRAM between the decoder task (producer) and the audio task (consumer), so a stalling SD
+ * card only holds up the decoder. The decoder runs ahead by the target depth, which adapts to how far the
+ * buffer has been drained: it grows to twice the deepest drain seen, and to the full capacity at once if the
+ * buffer did run dry. While nothing is drained it slowly shrinks back to the minimum depth, the card keeps its
+ * habits across tracks and albums, so flushing does not forget what has been learned.
+ *
+ * The producer owns the head and the consumer the tail and the target. Flushing moves the tail back to the head
+ * and must not race with the producer, the caller has to make sure that nothing is pushed meanwhile.
+ */
+class JitterBuffer {
+   public:
+    static constexpr uint32_t BLOCK_SAMPLES = PLAYBACK_CHUNK_SIZE / 4;
+
+    // Blocks without a drain before the target shrinks by one block, about a second
+    static constexpr uint32_t DECAY_INTERVAL = SAMPLE_RATE / BLOCK_SAMPLES;
+
+    // The decoder state after the block, which is what is heard once the block has been played
+    struct Tag {
+        uint32_t track;
+        size_t position;
+
+        // Samples since the start of the track
+        uint32_t trackPosition;
+
+        const DirectoryReader::TrackInfo* info;
+
+        // The last block of the album, it may be empty
+        bool end;
+    };
+
+    struct Block {
+        Tag tag;
+
+        uint32_t count;
+        int16_t samples[2 * BLOCK_SAMPLES];
+    };
+
+   public:
+    JitterBuffer();
+
+    ~JitterBuffer();
+
+    // In blocks, without PSRAM only the minimum depth is allocated
+    void initialize(uint32_t minimumDepth, uint32_t capacity);
+
+    // Producer: whether the depth is below the target
+    bool hasSpace() const;
+
+    // Producer: the block to fill next, only valid while there is space
+    Block& back() { return blocks[head.load(std::memory_order_relaxed) % capacity]; }
+
+    void push();
+
+    // Producer: blocks until the consumer has taken a block or someone wakes the producer
+    void waitForSpace();
+
+    void wake();
+
+    bool isEmpty() const;
+
+    // Consumer: false if nothing has been pushed within the timeout
+    bool waitForData(TickType_t ticksToWait);
+
+    /**
+     * Consumer: copies up to count interleaved samples and returns how many there were. Reading stops after the
+     * last block of the album. If a block has been read completely, its tag is returned in played.
+     */
+    uint32_t read(int16_t* buffer, uint32_t count, Tag& played, bool& completed);
+
+    // Consumer: the buffer ran dry, so the decoder has to run ahead as far as it can
+    void reportUnderrun();
+
+    // Consumer: drops everything that has not been read
+    void flush();
+
+    uint32_t getDepth() const;
+    uint32_t getTarget() const { return target.load(std::memory_order_relaxed); }
+
+    // The blocks that have not been read, for the decoder snapshot. The track info is not valid after a restart,
+    // so restoring sets the given one.
+    bool save(FILE* file) const;
+    bool restore(FILE* file, const DirectoryReader::TrackInfo* info);
+
+   private:
+    void adapt(uint32_t depth);
+
+   private:
+    Block* blocks{nullptr};
+    uint32_t capacity{0};
+    uint32_t minimumDepth{0};
+
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+    std::atomic<uint32_t> target{0};
+
+    // Consumer only, the samples already read from the block at the tail, the depth the drain is measured from and
+    // the blocks since the target last changed
+    uint32_t offset{0};
+    uint32_t peak{0};
+    uint32_t calm{0};
+
+    SemaphoreHandle_t space{nullptr};
+    SemaphoreHandle_t data{nullptr};
+
+   private:
+    JitterBuffer(const JitterBuffer&) = delete;
+
+    JitterBuffer(JitterBuffer&&) = delete;
+
+    JitterBuffer& operator=(const JitterBuffer&) = delete;
+
+    JitterBuffer& operator=(JitterBuffer&&) = delete;
+};
+
+#endif  // JITTER_BUFFER_HXX
@@ -4,7 +4,9 @@
 #include <ArduinoJson.h>
 #include <StreamUtils.h>
 
+#include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <memory>
 
 #include "Log.hxx"
@@ -16,8 +18,6 @@ using std::string;
 
 namespace {
 
-Command::Command emptyCommand(Command::Command::none());
-
 class SPIRamAllocator {
    public:
     void* allocate(size_t n) { return ps_malloc(n); }
@@ -25,12 +25,24 @@ class SPIRamAllocator {
     void deallocate(void* p) { free(p); }
 };
 
+float clamp(float value, float min, float max) { return value < min ? min : (value > max ? max : value); }
+
+// The album of a play command, nullptr for other commands
+const char* albumForDefinition(const JsonVariant& definition) {
+    if (definition.is<const char*>()) return definition.as<const char*>();
+
+    if (definition["type"] == "play" && definition["album"].is<const char*>())
+        return definition["album"].as<const char*>();
+
+    return nullptr;
+}
+
 }  // namespace
 
 using SPIRamJsonDocument = BasicJsonDocument<SPIRamAllocator>;
 
 bool JsonConfig::load() {
-    File configFile = VFS.open("/sdcard/config.json", "r");
+    File configFile = VFS.open(SD_MOUNT_POINT "/config.json", "r");
     if (!configFile) {
         LOG_WARN(TAG, "config.json not found");
         return false;
@@ -51,29 +63,110 @@ bool JsonConfig::load() {
 
     auto rfidMapping = configJson["rfidMapping"];
 
-    rfidMap.clear();
-
     if (!rfidMapping.is<JsonObject>()) {
+        rfidMap.reset(0, 0);
+
         LOG_WARN(TAG, "config contains no RFID mappings");
     } else {
-        rfidMap.reserve(rfidMapping.as<JsonObject>().size());
+        JsonObject mappings = rfidMapping.as<JsonObject>();
+        size_t arenaSize = 0;
+
+        // The albums are copied into the arena of the map, which is sized up front
+        for (auto mapping : mappings) {
+            const char* album = albumForDefinition(mapping.value());
+            if (album) arenaSize += strlen(album) + 1;
+        }
 
-        for (auto mapping : rfidMapping.as<JsonObject>()) {
-            if (!processCommandDefinition(mapping.key().c_str(), mapping.value())) {
+        rfidMap.reset(mappings.size(), arenaSize);
+
+        for (auto mapping : mappings) {
+            RfidMap::Uid uid;
+
+            if (!(RfidMap::Uid::parse(mapping.key().c_str(), uid) && processCommandDefinition(uid, mapping.value())))
                 LOG_WARN(TAG, "invalid mapping definition for UID %s", mapping.key().c_str());
-            }
         }
     }
 
+    auto transcodeList = configJson["transcode"];
+
+    transcode.clear();
+
+    if (transcodeList.is<JsonArray>()) {
+        for (auto album : transcodeList.as<JsonArray>()) {
+            if (album.is<const char*>())
+                transcode.emplace_back(album.as<const char*>());
+            else
+                LOG_WARN(TAG, "invalid album in transcode list");
+        }
+    }
+
+    // Factors like 1.25, stored as percent
+    auto speedMapping = configJson["playbackSpeed"];
+
+    speeds.clear();
+
+    if (speedMapping.is<JsonObject>()) {
+        for (auto speed : speedMapping.as<JsonObject>()) {
+            if (speed.value().is<float>())
+                speeds[speed.key().c_str()] = static_cast<uint32_t>(speed.value().as<float>() * 100 + 0.5f);
+            else
+                LOG_WARN(TAG, "invalid playback speed for album %s", speed.key().c_str());
+        }
+    }
+
+    auto equalizer = configJson["equalizer"];
+
+    bands.clear();
+    loudness = equalizer["loudness"] | 0.f;
+
+    if (loudness < 0 || loudness > Equalizer::MAX_GAIN) {
+        LOG_WARN(TAG, "loudness compensation clamped to 0 to %.0f dB", Equalizer::MAX_GAIN);
+        loudness = clamp(loudness, 0, Equalizer::MAX_GAIN);
+    }
+
+    if (equalizer["bands"].is<JsonArray>()) {
+        for (auto band : equalizer["bands"].as<JsonArray>())
+            if (!processBandDefinition(band)) LOG_WARN(TAG, "invalid equalizer band");
+    }
+
     return true;
 }
 
-bool JsonConfig::processCommandDefinition(const char* uid, const JsonVariant& definition) {
-    if (definition.is<const char*>()) {
-        rfidMap.emplace(uid, Command::Command::play(definition.as<const char*>()));
-        return true;
+// {"type": "lowShelf" | "peaking" | "highShelf", "frequency": Hz, "gain": dB, "q": 0.7}
+bool JsonConfig::processBandDefinition(const JsonVariant& definition) {
+    if (!(definition["type"].is<const char*>() && definition["frequency"].is<float>() &&
+          definition["gain"].is<float>()))
+        return false;
+
+    string typeKey(definition["type"].as<const char*>());
+    Equalizer::Band band = {.type = Equalizer::Band::peaking,
+                            .frequency = definition["frequency"].as<float>(),
+                            .gain = definition["gain"].as<float>(),
+                            .q = definition["q"] | 0.7071f};
+
+    if (fabsf(band.gain) > Equalizer::MAX_GAIN || band.q < Equalizer::MIN_Q || band.q > Equalizer::MAX_Q) {
+        LOG_WARN(TAG, "equalizer band at %.0f Hz clamped to +-%.0f dB and Q %.1f to %.0f", band.frequency,
+                 Equalizer::MAX_GAIN, Equalizer::MIN_Q, Equalizer::MAX_Q);
+
+        band.gain = clamp(band.gain, -Equalizer::MAX_GAIN, Equalizer::MAX_GAIN);
+        band.q = clamp(band.q, Equalizer::MIN_Q, Equalizer::MAX_Q);
     }
 
+    if (typeKey == "lowShelf")
+        band.type = Equalizer::Band::lowShelf;
+    else if (typeKey == "highShelf")
+        band.type = Equalizer::Band::highShelf;
+    else if (typeKey != "peaking")
+        return false;
+
+    bands.push_back(band);
+
+    return true;
+}
+
+bool JsonConfig::processCommandDefinition(const RfidMap::Uid& uid, const JsonVariant& definition) {
+    if (definition.is<const char*>()) return rfidMap.insert(uid, Command::Command::play(definition.as<const char*>()));
+
     if (!(definition.is<JsonObject>() && definition["type"].is<const char*>())) return false;
 
     string typeKey(definition["type"].as<const char*>());
@@ -81,29 +174,25 @@ bool JsonConfig::processCommandDefinition(const char* uid, const JsonVariant& de
     if (typeKey == "play") {
         if (!definition["album"].is<const char*>()) return false;
 
-        rfidMap.emplace(uid, Command::Command::play(definition["album"].as<const char*>()));
-        return true;
+        return rfidMap.insert(uid, Command::Command::play(definition["album"].as<const char*>()));
 
     } else if (typeKey == "dbgSetVoltage") {
         if (!definition["voltage"].is<uint32_t>()) return false;
 
-        rfidMap.emplace(uid, Command::Command::dbgSetVoltage(definition["voltage"].as<uint32_t>()));
-        return true;
+        return rfidMap.insert(uid, Command::Command::dbgSetVoltage(definition["voltage"].as<uint32_t>()));
 
     } else if (typeKey == "startNet") {
-        rfidMap.emplace(uid, Command::Command::startNet());
-        return true;
+        return rfidMap.insert(uid, Command::Command::startNet());
 
     } else if (typeKey == "stopNet") {
-        rfidMap.emplace(uid, Command::Command::stopNet());
-        return true;
+        return rfidMap.insert(uid, Command::Command::stopNet());
     }
 
     return false;
 }
 
-bool JsonConfig::isRfidMapped(const string& uid) { return rfidMap.find(uid) != rfidMap.end(); }
+uint32_t JsonConfig::playbackSpeed(const string& album) {
+    auto speed = speeds.find(album);
 
-const Command::Command& JsonConfig::commandForRfid(const std::string& uid) {
-    return isRfidMapped(uid) ? rfidMap.at(uid) : emptyCommand;
+    return speed != speeds.end() ? speed->second : 100;
 }
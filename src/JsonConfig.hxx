@@ -5,9 +5,11 @@
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "Command.hxx"
 #include "Config.hxx"
+#include "RfidMap.hxx"
 
 class JsonConfig : public Config {
    public:
@@ -15,14 +17,28 @@ class JsonConfig : public Config {
 
     bool load();
 
-    const Command::Command& commandForRfid(const std::string& uid) override;
+    const Command::Command* commandForRfid(const RfidMap::Uid& uid) override { return rfidMap.find(uid); }
 
-    bool isRfidMapped(const std::string& uid) override;
+    const RfidMap& rfidMappings() override { return rfidMap; }
+
+    const std::vector<std::string>& transcodeAlbums() override { return transcode; }
+
+    uint32_t playbackSpeed(const std::string& album) override;
+
+    const std::vector<Equalizer::Band>& equalizerBands() override { return bands; }
+
+    float loudnessCompensation() override { return loudness; }
 
    private:
-    std::unordered_map<std::string, Command::Command> rfidMap;
+    RfidMap rfidMap;
+    std::vector<std::string> transcode;
+    std::unordered_map<std::string, uint32_t> speeds;
+    std::vector<Equalizer::Band> bands;
+    float loudness{0};
+
+    bool processCommandDefinition(const RfidMap::Uid& uid, const JsonVariant& definition);
 
-    bool processCommandDefinition(const char* uid, const JsonVariant& definition);
+    bool processBandDefinition(const JsonVariant& definition);
 };
 
 #endif  // JSON_CONFIG_HXX
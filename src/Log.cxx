@@ -14,7 +14,7 @@
 #include "config.h"
 
 #define TAG "log"
-#define LOGFILE "/sdcard/log.txt"
+#define LOGFILE SD_MOUNT_POINT "/log.txt"
 #define BUFFER_SIZE 256
 #define INITIAL_LOG_BUFFER_SIZE 4096
 #define LOG_TO_SD_QUEUE_SIZE 4
@@ -0,0 +1,120 @@
+#include "Loudness.hxx"
+
+#include <cmath>
+
+namespace {
+
+constexpr double ABSOLUTE_GATE = -70.;
+constexpr double RELATIVE_GATE = -10.;
+
+double loudnessOf(double meanSquare) { return -0.691 + 10. * log10(meanSquare); }
+
+}  // namespace
+
+double Loudness::Biquad::process(double x, uint32_t channel) {
+    double y = b0 * x + z1[channel];
+
+    z1[channel] = b1 * x - a1 * y + z2[channel];
+    z2[channel] = b2 * x - a2 * y;
+
+    return y;
+}
+
+// The filter coefficients of BS.1770 are given for 48 kHz, so they are derived from the analog prototype
+Loudness::Loudness(uint32_t sampleRate) : subBlockLength(sampleRate / 10) {
+    double k = tan(M_PI * 1681.974450955533 / sampleRate);
+    double q = 0.7071752369554196;
+    double vh = pow(10., 3.999843853973347 / 20.);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1. + k / q + k * k;
+
+    shelf = {.b0 = (vh + vb * k / q + k * k) / a0,
+             .b1 = 2. * (k * k - vh) / a0,
+             .b2 = (vh - vb * k / q + k * k) / a0,
+             .a1 = 2. * (k * k - 1.) / a0,
+             .a2 = (1. - k / q + k * k) / a0,
+             .z1 = {0, 0},
+             .z2 = {0, 0}};
+
+    k = tan(M_PI * 38.13547087602444 / sampleRate);
+    q = 0.5003270373238773;
+    a0 = 1. + k / q + k * k;
+
+    highPass = {.b0 = 1.,
+                .b1 = -2.,
+                .b2 = 1.,
+                .a1 = 2. * (k * k - 1.) / a0,
+                .a2 = (1. - k / q + k * k) / a0,
+                .z1 = {0, 0},
+                .z2 = {0, 0}};
+}
+
+void Loudness::add(const int16_t* samples, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        for (uint32_t channel = 0; channel < 2; channel++) {
+            double y = highPass.process(shelf.process(samples[2 * i + channel] / 32768., channel), channel);
+
+            subBlocks[subBlockCount % 4] += y * y;
+        }
+
+        if (++subBlockPosition < subBlockLength) continue;
+
+        subBlockPosition = 0;
+        subBlockCount++;
+
+        if (subBlockCount >= 4)
+            blocks.push_back((subBlocks[0] + subBlocks[1] + subBlocks[2] + subBlocks[3]) / (4. * subBlockLength));
+
+        subBlocks[subBlockCount % 4] = 0;
+    }
+}
+
+void Loudness::add(const Loudness& other) { blocks.insert(blocks.end(), other.blocks.begin(), other.blocks.end()); }
+
+void Loudness::reset() {
+    shelf.z1[0] = shelf.z1[1] = shelf.z2[0] = shelf.z2[1] = 0;
+    highPass.z1[0] = highPass.z1[1] = highPass.z2[0] = highPass.z2[1] = 0;
+
+    subBlockPosition = subBlockCount = 0;
+    subBlocks[0] = subBlocks[1] = subBlocks[2] = subBlocks[3] = 0;
+
+    blocks.clear();
+}
+
+double Loudness::integrated() const {
+    double sum = 0;
+    uint32_t count = 0;
+
+    for (double block : blocks) {
+        if (loudnessOf(block) <= ABSOLUTE_GATE) continue;
+
+        sum += block;
+        count++;
+    }
+
+    if (count == 0) return -INFINITY;
+
+    double threshold = loudnessOf(sum / count) + RELATIVE_GATE;
+
+    sum = 0;
+    count = 0;
+
+    for (double block : blocks) {
+        if (loudnessOf(block) <= ABSOLUTE_GATE || loudnessOf(block) <= threshold) continue;
+
+        sum += block;
+        count++;
+    }
+
+    return count > 0 ? loudnessOf(sum / count) : -INFINITY;
+}
+
+int32_t Loudness::gain() const {
+    double loudness = integrated();
+
+    if (std::isinf(loudness)) return 0;
+
+    int32_t gain = lround((REFERENCE - loudness) * 100.);
+
+    return gain < MIN_GAIN ? MIN_GAIN : (gain > MAX_GAIN ? MAX_GAIN : gain);
+}
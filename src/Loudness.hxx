@@ -0,0 +1,60 @@
+#ifndef LOUDNESS_HXX
+#define LOUDNESS_HXX
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Integrated loudness of 16 bit stereo PCM as defined by ITU-R BS.1770 / EBU R128: K-weighting,
+ * 400 ms blocks with 75% overlap, an absolute gate at -70 LUFS and a relative gate 10 LU below the
+ * ungated loudness. This decodes and filters every sample in floating point, so it is meant to run
+ * offline and not during playback.
+ */
+class Loudness {
+   public:
+    // ReplayGain 2 reference level, LUFS
+    static constexpr double REFERENCE = -18.;
+
+    // Hundredths of a dB
+    static constexpr int32_t MIN_GAIN = -2400;
+    static constexpr int32_t MAX_GAIN = 1200;
+
+   public:
+    Loudness(uint32_t sampleRate);
+
+    void add(const int16_t* samples, uint32_t count);
+
+    // Merges the blocks of a track into the blocks of an album
+    void add(const Loudness& other);
+
+    void reset();
+
+    // LUFS, -infinity if everything is gated
+    double integrated() const;
+
+    // Hundredths of a dB that bring the loudness to REFERENCE
+    int32_t gain() const;
+
+   private:
+    struct Biquad {
+        double b0, b1, b2, a1, a2;
+        double z1[2], z2[2];
+
+        double process(double x, uint32_t channel);
+    };
+
+   private:
+    Biquad shelf;
+    Biquad highPass;
+
+    // Blocks are built from four 100 ms sub-blocks
+    const uint32_t subBlockLength;
+    uint32_t subBlockPosition{0};
+    double subBlocks[4]{};
+    uint32_t subBlockCount{0};
+
+    // Mean square per block
+    std::vector<double> blocks;
+};
+
+#endif  // LOUDNESS_HXX
@@ -2,12 +2,41 @@
 
 #include <Arduino.h>
 
+#include <algorithm>
 #include <iostream>
 
 #include "Log.hxx"
+#include "Tag.hxx"
 
 #define TAG "mp3"
 
+namespace {
+
+constexpr uint32_t SNAPSHOT_MAGIC = 0x4d414432;
+
+struct Snapshot {
+    uint32_t magic;
+
+    // File offset of the frame following the one that is currently synthesized
+    uint32_t frameOffset;
+    uint32_t totalSamples;
+    uint32_t streamOffset;
+
+    uint16_t ns;
+    uint16_t nsMax;
+    uint16_t sampleNo;
+    uint16_t sampleCount;
+    uint16_t mainDataLength;
+    uint16_t channels;
+
+    unsigned long freerate;
+    unsigned int phase;
+    int options;
+    mad_header header;
+};
+
+}  // namespace
+
 MadDecoder::MadDecoder() {}
 
 MadDecoder::~MadDecoder() { close(); }
@@ -19,7 +48,11 @@ bool MadDecoder::open(const char* path) {
 
     if (!file) return false;
 
-    LOG_INFO(TAG, "now playing %s", path);
+    durationKnown = seekTableKnown = false;
+    errors = 0;
+
+    dataEnd = Tag::trailingTagsStart(file);
+    dataStart = std::min(Tag::leadingTagsEnd(file), dataEnd);
 
     if (!reset()) {
         close();
@@ -49,13 +82,15 @@ bool MadDecoder::reset(size_t seekPosition) {
     iBufferGuard = 0;
     leadInSamples = 0;
     totalSamples = 0;
+    streamOffset = 0;
 
     initialized = true;
     finished = false;
     leadIn = true;
     eof = false;
 
-    fseek(file, seekPosition, SEEK_SET);
+    filePosition = std::max(seekPosition, dataStart);
+    fseek(file, filePosition, SEEK_SET);
 
     return bufferChunk();
 }
@@ -76,12 +111,16 @@ bool MadDecoder::bufferChunk() {
 
     size_t bytesRead = 0;
     while (!eof && bytesRead < bytesToRead) {
-        size_t r = fread(target + bytesRead, 1, bytesToRead - bytesRead, file);
+        size_t r = filePosition < dataEnd
+                       ? fread(target + bytesRead, 1, std::min(bytesToRead - bytesRead, dataEnd - filePosition), file)
+                       : 0;
 
         if (r == 0)
             eof = true;
-        else
+        else {
             bytesRead += r;
+            filePosition += r;
+        }
     }
 
     if (eof) {
@@ -108,7 +147,10 @@ uint32_t MadDecoder::decode(int16_t* buffer, uint32_t count) {
         leadIn = leadIn && buffer[2 * decodedSamples] == 0 && buffer[2 * decodedSamples + 1] == 0 &&
                  leadInSamples++ < MAX_LEAD_IN_SAMPLES;
 
-        if (!leadIn) decodedSamples++;
+        if (!leadIn)
+            decodedSamples++;
+        else
+            streamOffset++;
     }
 
     if (decodedSamples < count) {
@@ -137,6 +179,13 @@ bool MadDecoder::decodeOne(int16_t& sampleL, int16_t& sampleR) {
                         return false;
                 }
 
+                // The frame is valid but its main data starts before the point we have seeked to
+                if (stream.error == MAD_ERROR_BADDATAPTR) streamOffset += 32 * MAD_NSBSAMPLES(&frame.header);
+
+                // Any other recoverable error is a corrupt frame, unless the sync is lost before the first frame
+                // after a reset or seek
+                if (MAD_RECOVERABLE(stream.error) && stream.error != MAD_ERROR_BADDATAPTR && nsMax > 0) errors++;
+
                 if (!MAD_RECOVERABLE(stream.error)) {
                     LOG_DEBUG(TAG, "decoding failed with mad error");
                     LOG_DEBUG(TAG, "%s", mad_stream_errorstr(&stream));
@@ -184,9 +233,10 @@ void MadDecoder::deinit() {
 
 void MadDecoder::close() {
     if (file) {
-        LOG_DEBUG(TAG, "decoder closed after decoding %du bytes", file.position());
+        LOG_DEBUG(TAG, "decoder closed after decoding %u bytes", filePosition - dataStart);
 
         fclose(file);
+        file = nullptr;
     }
 
     deinit();
@@ -198,6 +248,166 @@ void MadDecoder::rewind() { reset(); }
 
 uint32_t MadDecoder::getPosition() const { return totalSamples; }
 
-size_t MadDecoder::getSeekPosition() { return file ? ftell(file) : 0; }
+uint32_t MadDecoder::getDuration() {
+    if (!file) return 0;
+
+    // Scanning for the first frame costs SD reads, so this is only done on demand
+    if (!durationKnown) {
+        duration = Tag::estimateDuration(file, dataStart, dataEnd);
+        durationKnown = true;
+
+        fseek(file, filePosition, SEEK_SET);
+    }
+
+    return duration;
+}
+
+size_t MadDecoder::getSeekPosition() { return file ? filePosition : 0; }
+
+void MadDecoder::seekTo(uint32_t seekPosition) {
+    size_t offset = seekPosition > CHUNK_SIZE ? seekPosition - CHUNK_SIZE : 0;
+    bool estimate = loadSeekTable();
+
+    if (!reset(offset)) return;
+
+    // Only an estimate, the decoder resyncs to the next frame after the offset
+    if (estimate) streamOffset = Tag::frameAt(seekTable, offset) * seekTable.samplesPerFrame;
+}
+
+void MadDecoder::seekToSample(uint32_t sample) {
+    if (!file) return;
+
+    if (sample == 0 || !loadSeekTable()) {
+        if (sample > 0) LOG_WARN(TAG, "no seek table, rewinding instead of seeking to sample %u", sample);
+
+        reset();
+        return;
+    }
+
+    uint32_t targetFrame = sample / seekTable.samplesPerFrame;
+    uint32_t firstFrame = targetFrame > SEEK_PREROLL_FRAMES ? targetFrame - SEEK_PREROLL_FRAMES : 0;
+    size_t offset = Tag::frameOffset(seekTable, firstFrame);
+
+    if (!reset(offset > SEEK_MARGIN ? offset - SEEK_MARGIN : 0)) return;
+
+    leadIn = false;
+    streamOffset = firstFrame * seekTable.samplesPerFrame;
+
+    // At most the preroll and one frame are decoded and thrown away
+    int16_t sampleL, sampleR;
+
+    while (streamOffset < sample) {
+        if (!decodeOne(sampleL, sampleR)) {
+            finished = true;
+            break;
+        }
+
+        streamOffset++;
+    }
 
-void MadDecoder::seekTo(uint32_t seekPosition) { reset(seekPosition > CHUNK_SIZE ? seekPosition - CHUNK_SIZE : 0); }
+    LOG_DEBUG(TAG, "seeked to sample %u at offset %u", streamOffset, offset);
+}
+
+bool MadDecoder::loadSeekTable() {
+    if (!file) return false;
+
+    if (!seekTableKnown) {
+        seekTableValid = Tag::readSeekTable(file, dataStart, dataEnd, seekTable);
+        seekTableKnown = true;
+
+        fseek(file, filePosition, SEEK_SET);
+    }
+
+    return seekTableValid;
+}
+
+bool MadDecoder::saveSnapshot(FILE* out) {
+    // The guard bytes appended at the end of the file have no file offset
+    if (!initialized || finished || eof) return false;
+
+    uint16_t channels = nsMax > 0 ? MAD_NCHANNELS(&frame.header) : 0;
+
+    Snapshot snapshot = {.magic = SNAPSHOT_MAGIC,
+                         .frameOffset = static_cast<uint32_t>(filePosition - (stream.bufend - stream.next_frame)),
+                         .totalSamples = totalSamples,
+                         .streamOffset = streamOffset,
+                         .ns = static_cast<uint16_t>(ns),
+                         .nsMax = static_cast<uint16_t>(nsMax),
+                         .sampleNo = static_cast<uint16_t>(sampleNo),
+                         .sampleCount = static_cast<uint16_t>(sampleCount),
+                         .mainDataLength = static_cast<uint16_t>(stream.md_len),
+                         .channels = channels,
+                         .freerate = stream.freerate,
+                         .phase = synth.phase,
+                         .options = frame.options,
+                         .header = frame.header};
+
+    if (fwrite(&snapshot, sizeof(snapshot), 1, out) != 1) return false;
+    if (stream.md_len > 0 && fwrite(stream.main_data, stream.md_len, 1, out) != 1) return false;
+
+    uint32_t slots = nsMax - ns;
+
+    // Both channels of the filter history are kept, a mono frame may be followed by a stereo frame
+    if (fwrite(frame.overlap, sizeof(frame.overlap), 1, out) != 1 ||
+        fwrite(synth.filter, sizeof(synth.filter), 1, out) != 1 ||
+        fwrite(synth.pcm.samples, sizeof(synth.pcm.samples), 1, out) != 1)
+        return false;
+
+    for (uint32_t ch = 0; ch < channels && slots > 0; ch++) {
+        if (fwrite(frame.sbsample[ch][ns], sizeof(frame.sbsample[ch][0]), slots, out) != slots) return false;
+    }
+
+    LOG_DEBUG(TAG, "saved snapshot at frame offset %u, slot %u of %u", snapshot.frameOffset, ns, nsMax);
+
+    return true;
+}
+
+bool MadDecoder::restoreSnapshot(FILE* in) {
+    Snapshot snapshot;
+
+    if (fread(&snapshot, sizeof(snapshot), 1, in) != 1 || snapshot.magic != SNAPSHOT_MAGIC ||
+        snapshot.mainDataLength > MAD_BUFFER_MDLEN || snapshot.channels > 2 || snapshot.nsMax > 36 ||
+        snapshot.ns > snapshot.nsMax || snapshot.sampleCount > 32 || snapshot.sampleNo > snapshot.sampleCount ||
+        snapshot.frameOffset < dataStart || snapshot.frameOffset >= dataEnd)
+        return false;
+
+    // The snapshot is only valid if the file still has a frame where it was taken
+    if (!reset(snapshot.frameOffset) || stream.bufend - stream.buffer < 2 || stream.buffer[0] != 0xff ||
+        (stream.buffer[1] & 0xe0) != 0xe0)
+        return false;
+
+    bool success = snapshot.mainDataLength == 0 || fread(stream.main_data, snapshot.mainDataLength, 1, in) == 1;
+    uint32_t slots = snapshot.nsMax - snapshot.ns;
+
+    success = success && fread(frame.overlap, sizeof(frame.overlap), 1, in) == 1 &&
+              fread(synth.filter, sizeof(synth.filter), 1, in) == 1 &&
+              fread(synth.pcm.samples, sizeof(synth.pcm.samples), 1, in) == 1;
+
+    for (uint32_t ch = 0; success && ch < snapshot.channels && slots > 0; ch++)
+        success = fread(frame.sbsample[ch][snapshot.ns], sizeof(frame.sbsample[ch][0]), slots, in) == slots;
+
+    if (!success) {
+        reset(snapshot.frameOffset);
+
+        return false;
+    }
+
+    stream.md_len = snapshot.mainDataLength;
+    stream.freerate = snapshot.freerate;
+    frame.header = snapshot.header;
+    frame.options = snapshot.options;
+    synth.phase = snapshot.phase;
+    synth.pcm.length = snapshot.sampleCount;
+
+    ns = snapshot.ns;
+    nsMax = snapshot.nsMax;
+    sampleNo = snapshot.sampleNo;
+    sampleCount = snapshot.sampleCount;
+    totalSamples = snapshot.totalSamples;
+    streamOffset = snapshot.streamOffset;
+    leadIn = false;
+
+    LOG_DEBUG(TAG, "restored snapshot at frame offset %u, slot %u of %u", snapshot.frameOffset, ns, nsMax);
+
+    return true;
+}
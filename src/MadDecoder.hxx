@@ -5,34 +5,54 @@
 #include <cstdio>
 #include <string>
 
+#include "Decoder.hxx"
+#include "Tag.hxx"
+
 // clang-format off
 #include <mad.h>
 // clang-format on
 
-class MadDecoder {
+class MadDecoder : public Decoder {
    public:
     static constexpr int CHUNK_SIZE = 0x600;
     static constexpr int MAX_LEAD_IN_SAMPLES = 3000;
 
+    // Frames decoded before the target of a seek to refill the bit reservoir and the synthesis filter
+    static constexpr uint32_t SEEK_PREROLL_FRAMES = 3;
+
+    // Seek table offsets may be off by a byte, so we start a little early and resync to the frame header
+    static constexpr size_t SEEK_MARGIN = 8;
+
    public:
     MadDecoder();
 
-    ~MadDecoder();
+    ~MadDecoder() override;
+
+    bool open(const char* file) override;
+
+    uint32_t decode(int16_t* buffer, uint32_t count) override;
+
+    bool isFinished() const override { return finished || !initialized; };
 
-    bool open(const char* file);
+    void close() override;
 
-    uint32_t decode(int16_t* buffer, uint32_t count);
+    uint32_t getPosition() const override;
 
-    bool isFinished() const { return finished || !initialized; };
+    uint32_t getDuration() override;
 
-    void close();
+    void rewind() override;
 
-    uint32_t getPosition() const;
+    size_t getSeekPosition() override;
+    void seekTo(uint32_t position) override;
 
-    void rewind();
+    uint32_t getErrors() const override { return errors; }
 
-    size_t getSeekPosition();
-    void seekTo(uint32_t position);
+    uint32_t getStreamPosition() override { return streamOffset + totalSamples; }
+    void seekToSample(uint32_t sample) override;
+
+    // Bit reservoir, IMDCT overlap, synthesis filter and the not yet synthesized part of the current frame
+    bool saveSnapshot(FILE* file) override;
+    bool restoreSnapshot(FILE* file) override;
 
    private:
     bool bufferChunk();
@@ -43,10 +63,23 @@ class MadDecoder {
 
     void deinit();
 
+    bool loadSeekTable();
+
    private:
     FILE* file{nullptr};
     uint8_t buffer[CHUNK_SIZE];
 
+    size_t dataStart{0};
+    size_t dataEnd{0};
+    size_t filePosition{0};
+
+    uint32_t duration{0};
+    bool durationKnown{false};
+
+    Tag::SeekTable seekTable;
+    bool seekTableKnown{false};
+    bool seekTableValid{false};
+
     mad_stream stream;
     mad_frame frame;
     mad_synth synth;
@@ -55,10 +88,15 @@ class MadDecoder {
     uint32_t sampleCount{0};
     uint32_t totalSamples{0};
 
+    // Stream position of the first sample after a reset plus skipped lead-in samples and frames that were lost
+    // to an empty bit reservoir
+    uint32_t streamOffset{0};
+
     uint32_t ns{0};
     uint32_t nsMax{0};
     uint32_t iBufferGuard{0};
     uint32_t leadInSamples{0};
+    uint32_t errors{0};
 
     bool initialized{false};
     bool finished{true};
@@ -0,0 +1,61 @@
+#include "Mixer.hxx"
+
+#include <cstring>
+
+namespace {
+
+inline int16_t saturate(int32_t sample) {
+    return sample > INT16_MAX ? INT16_MAX : (sample < INT16_MIN ? INT16_MIN : sample);
+}
+
+}  // namespace
+
+bool Mixer::addSource(Source& source, Role role) {
+    if (channelCount == MAX_SOURCES) return false;
+
+    channels[channelCount++] = {.source = &source, .role = role, .gain = UNITY};
+
+    return true;
+}
+
+bool Mixer::mix(int16_t* output, uint32_t count) {
+    if (count > MAX_SAMPLES) count = MAX_SAMPLES;
+
+    bool ducking = false;
+    bool active = false;
+
+    for (uint32_t i = 0; i < channelCount; i++)
+        ducking = ducking || (channels[i].role == foreground && channels[i].source->isActive());
+
+    memset(output, 0, 4 * count);
+
+    for (uint32_t i = 0; i < channelCount; i++) {
+        Channel& channel = channels[i];
+        int32_t target = channel.role == background && ducking ? DUCKED : UNITY;
+
+        // A source that starts later starts at its target gain
+        if (!channel.source->isActive()) {
+            channel.gain = target;
+            continue;
+        }
+
+        uint32_t rendered = channel.source->render(scratch, count);
+        if (rendered == 0) continue;
+
+        active = true;
+
+        int32_t step = (target - channel.gain) / static_cast<int32_t>(rendered);
+        int32_t g = channel.gain;
+
+        for (uint32_t j = 0; j < 2 * rendered; j += 2) {
+            g += step;
+
+            output[j] = saturate(output[j] + ((scratch[j] * g) >> GAIN_SHIFT));
+            output[j + 1] = saturate(output[j + 1] + ((scratch[j + 1] * g) >> GAIN_SHIFT));
+        }
+
+        channel.gain = target;
+    }
+
+    return active;
+}
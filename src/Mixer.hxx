@@ -0,0 +1,68 @@
+#ifndef MIXER_HXX
+#define MIXER_HXX
+
+#include <cstdint>
+
+/**
+ * Mixes a fixed number of sources into the output chunk. Each source renders into a shared scratch
+ * buffer and is added with its own gain and saturation, so a chunk costs at most one render and one
+ * pass per source. While a foreground source (e.g. a UI cue) is active, background sources (music)
+ * are ducked, and the gain is ramped across a chunk to avoid clicks.
+ */
+class Mixer {
+   public:
+    class Source {
+       public:
+        // Sources that are not active are not rendered
+        virtual bool isActive() const = 0;
+
+        // Returns less than count samples if the source ran out, the rest of the chunk stays silent
+        virtual uint32_t render(int16_t* buffer, uint32_t count) = 0;
+
+       protected:
+        ~Source() = default;
+    };
+
+    enum Role : uint8_t { background, foreground };
+
+    static constexpr uint32_t MAX_SOURCES = 4;
+    static constexpr uint32_t MAX_SAMPLES = 256;
+
+    // Q15, background sources are attenuated by 12 dB while a foreground source plays
+    static constexpr uint32_t GAIN_SHIFT = 15;
+    static constexpr int32_t UNITY = 1 << GAIN_SHIFT;
+    static constexpr int32_t DUCKED = UNITY / 4;
+
+   public:
+    Mixer() = default;
+
+    bool addSource(Source& source, Role role);
+
+    // Returns false if no source was active and the chunk is silent
+    bool mix(int16_t* output, uint32_t count);
+
+   private:
+    struct Channel {
+        Source* source;
+        Role role;
+
+        int32_t gain;
+    };
+
+   private:
+    Channel channels[MAX_SOURCES];
+    uint32_t channelCount{0};
+
+    int16_t scratch[2 * MAX_SAMPLES];
+
+   private:
+    Mixer(const Mixer&) = delete;
+
+    Mixer(Mixer&&) = delete;
+
+    Mixer& operator=(const Mixer&) = delete;
+
+    Mixer& operator=(Mixer&&) = delete;
+};
+
+#endif  // MIXER_HXX
@@ -0,0 +1,103 @@
+#include "PcmCache.hxx"
+
+#include <Arduino.h>
+
+#include <cstring>
+
+#include "Log.hxx"
+
+#define TAG "cache"
+
+PcmCache::PcmCache(size_t budget, uint32_t entrySamples) : budget(budget), entrySamples(entrySamples) {}
+
+PcmCache::~PcmCache() {
+    delete[] entries;
+
+    if (pool) free(pool);
+}
+
+void PcmCache::initialize() {
+    if (pool || entrySamples == 0) return;
+
+    entryCount = budget / (4 * entrySamples);
+    if (entryCount == 0) return;
+
+    pool = (int16_t*)ps_malloc(4 * entrySamples * entryCount);
+
+    if (!pool) {
+        LOG_WARN(TAG, "failed to allocate %u bytes for the PCM cache", 4 * entrySamples * entryCount);
+
+        entryCount = 0;
+        return;
+    }
+
+    entries = new Entry[entryCount];
+    for (uint32_t i = 0; i < entryCount; i++) entries[i].samples = pool + 2 * entrySamples * i;
+
+    LOG_INFO(TAG, "PCM cache holds %u albums", entryCount);
+}
+
+bool PcmCache::lookup(const char* album, const int16_t*& samples, uint32_t& count) {
+    Entry* entry = findEntry(album);
+    if (!entry || entry == recording || entry->count == 0) return false;
+
+    entry->lastUse = ++useCounter;
+    samples = entry->samples;
+    count = entry->count;
+
+    return true;
+}
+
+void PcmCache::startRecording(const char* album) {
+    stopRecording();
+
+    if (entryCount == 0) return;
+
+    Entry* entry = findEntry(album);
+
+    for (uint32_t i = 0; i < entryCount && !entry; i++)
+        if (entries[i].count == 0) entry = &entries[i];
+
+    if (!entry) {
+        entry = &entries[0];
+
+        for (uint32_t i = 1; i < entryCount; i++)
+            if (entries[i].lastUse < entry->lastUse) entry = &entries[i];
+
+        LOG_DEBUG(TAG, "evicting %s", entry->album.c_str());
+    }
+
+    entry->album = album;
+    entry->count = 0;
+    entry->lastUse = ++useCounter;
+
+    recording = entry;
+}
+
+void PcmCache::record(const int16_t* samples, uint32_t count) {
+    if (!recording) return;
+
+    count = std::min(count, entrySamples - recording->count);
+
+    memcpy(recording->samples + 2 * recording->count, samples, 4 * count);
+    recording->count += count;
+
+    if (recording->count == entrySamples) {
+        LOG_DEBUG(TAG, "cached start of %s", recording->album.c_str());
+
+        recording = nullptr;
+    }
+}
+
+void PcmCache::stopRecording() {
+    if (recording && recording->count == 0) recording->album.clear();
+
+    recording = nullptr;
+}
+
+PcmCache::Entry* PcmCache::findEntry(const char* album) {
+    for (uint32_t i = 0; i < entryCount; i++)
+        if (entries[i].album == album) return &entries[i];
+
+    return nullptr;
+}
@@ -0,0 +1,63 @@
+#ifndef PCM_CACHE_HXX
+#define PCM_CACHE_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Keeps the decoded PCM for the first moments of recently played albums in PSRAM.
+ * Entries are recorded while an album plays from the start and evicted in LRU order
+ * once the budget is exhausted.
+ */
+class PcmCache {
+   public:
+    PcmCache(size_t budget, uint32_t entrySamples);
+
+    ~PcmCache();
+
+    void initialize();
+
+    bool lookup(const char* album, const int16_t*& samples, uint32_t& count);
+
+    void startRecording(const char* album);
+
+    void record(const int16_t* samples, uint32_t count);
+
+    void stopRecording();
+
+   private:
+    struct Entry {
+        std::string album;
+
+        int16_t* samples{nullptr};
+        uint32_t count{0};
+
+        uint32_t lastUse{0};
+    };
+
+   private:
+    Entry* findEntry(const char* album);
+
+   private:
+    const size_t budget;
+    const uint32_t entrySamples;
+
+    int16_t* pool{nullptr};
+    Entry* entries{nullptr};
+    uint32_t entryCount{0};
+
+    Entry* recording{nullptr};
+    uint32_t useCounter{0};
+
+   private:
+    PcmCache(const PcmCache&) = delete;
+
+    PcmCache(PcmCache&&) = delete;
+
+    PcmCache& operator=(const PcmCache&) = delete;
+
+    PcmCache& operator=(PcmCache&&) = delete;
+};
+
+#endif  // PCM_CACHE_HXX
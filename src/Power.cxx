@@ -19,6 +19,7 @@
 #include "Lock.hxx"
 #include "Log.hxx"
 #include "Rfid.hxx"
+#include "Transcoder.hxx"
 #include "config.h"
 #include "net/Net.hxx"
 
@@ -151,6 +152,7 @@ void shutdownTask(void*) {
     LOG_INFO(TAG, "entering deep sleep now");
 
     Audio::stop();
+    Transcoder::stop();
     Led::stop();
     Rfid::stop();
     Net::prepareSleep();
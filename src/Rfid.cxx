@@ -10,8 +10,6 @@
 #include <freertos/task.h>
 
 #include <atomic>
-#include <iomanip>
-#include <sstream>
 
 #include "Audio.hxx"
 #include "Command.hxx"
@@ -19,6 +17,7 @@
 #include "Gpio.hxx"
 #include "Log.hxx"
 #include "MFRC522/MFRC522.h"
+#include "RfidMap.hxx"
 #include "config.h"
 
 #define TAG "rfid"
@@ -55,12 +54,17 @@ void initMfrc522() {
     mfrc522->PCD_SetAntennaGain(0x70);
 }
 
-void handleRfid(std::string uid) {
-    if (config->isRfidMapped(uid)) {
-        Command::dispatch(config->commandForRfid(uid));
+void handleRfid(const RfidMap::Uid& uid) {
+    const Command::Command* command = config->commandForRfid(uid);
+
+    if (command) {
+        Command::dispatch(*command);
     } else {
+        char formatted[RfidMap::Uid::FORMATTED_SIZE];
+        uid.format(formatted);
+
         Audio::signalError();
-        LOG_INFO(TAG, "scanned unmapped RFID %s", uid.c_str());
+        LOG_INFO(TAG, "scanned unmapped RFID %s", formatted);
     }
 }
 
@@ -109,16 +113,9 @@ void _rfidTask() {
         MFRC522::StatusCode piccHaltStatus = mfrc522->PICC_HaltA();
 
         if (readSerialStatus == MFRC522::STATUS_OK) {
-            std::stringstream sstream;
-
-            for (uint8_t i = 0; i < uid.size; i++) {
-                sstream << std::setw(2) << std::setfill('0') << std::hex << (int)uid.uidByte[i];
-                if (i != uid.size - 1) sstream << ":";
-            }
-
             if (stopNow) return;
 
-            handleRfid(sstream.str());
+            handleRfid(RfidMap::Uid::fromBytes(uid.uidByte, uid.size));
         } else {
             LOG_INFO(TAG, "RFID: failed to read UID: %i", (int)readSerialStatus);
         }
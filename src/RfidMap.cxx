@@ -0,0 +1,161 @@
+#include "RfidMap.hxx"
+
+#include <Arduino.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "Log.hxx"
+
+#define TAG "rfid"
+
+namespace {
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+
+    return -1;
+}
+
+}  // namespace
+
+RfidMap::Uid RfidMap::Uid::fromBytes(const uint8_t* bytes, uint8_t size) {
+    if (size > MAX_SIZE) size = MAX_SIZE;
+
+    Uid uid = {.low = 0, .high = static_cast<uint32_t>(size) << 24};
+
+    for (uint8_t i = 0; i < size && i < 8; i++) uid.low |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+    for (uint8_t i = 8; i < size; i++) uid.high |= static_cast<uint32_t>(bytes[i]) << (8 * (i - 8));
+
+    return uid;
+}
+
+bool RfidMap::Uid::parse(const char* text, Uid& uid) {
+    uint8_t bytes[MAX_SIZE];
+    uint8_t size = 0;
+
+    while (true) {
+        int high = hexDigit(text[0]);
+        int low = high < 0 ? -1 : hexDigit(text[1]);
+
+        if (low < 0 || size == MAX_SIZE) return false;
+
+        bytes[size++] = (high << 4) | low;
+        text += 2;
+
+        if (*text == '\0') break;
+        if (*text++ != ':') return false;
+    }
+
+    uid = fromBytes(bytes, size);
+
+    return true;
+}
+
+void RfidMap::Uid::format(char* buffer) const {
+    buffer[0] = '\0';
+
+    for (uint8_t i = 0; i < size(); i++) {
+        uint8_t byte = i < 8 ? low >> (8 * i) : high >> (8 * (i - 8));
+
+        if (i == 0)
+            snprintf(buffer, 3, "%02x", byte);
+        else
+            snprintf(buffer + 3 * i - 1, 4, ":%02x", byte);
+    }
+}
+
+RfidMap::~RfidMap() { release(); }
+
+bool RfidMap::reset(uint32_t count, size_t arenaSize) {
+    release();
+
+    capacity = 4;
+    while (capacity < 2 * count) capacity *= 2;
+
+    // The slots and the arena are one block, the slots first as they are aligned
+    size_t size = capacity * sizeof(Slot) + arenaSize;
+    void* block = ps_malloc(size);
+    if (!block) block = malloc(size);
+
+    if (!block) {
+        LOG_ERROR(TAG, "failed to allocate %u bytes for %u RFID mappings", static_cast<unsigned>(size), count);
+
+        capacity = 0;
+        return false;
+    }
+
+    slots = static_cast<Slot*>(block);
+    for (uint32_t i = 0; i < capacity; i++) slots[i].uid = {.low = 0, .high = 0};
+
+    mask = capacity - 1;
+
+    shift = 64;
+    for (uint32_t i = capacity; i > 1; i /= 2) shift--;
+
+    arena = reinterpret_cast<char*>(slots + capacity);
+    this->arenaSize = arenaSize;
+
+    return true;
+}
+
+bool RfidMap::insert(const Uid& uid, const Command::Command& command) {
+    // Keeps at least half of the slots empty, so probes stay short and a miss ends at an empty slot
+    if (2 * (this->count + 1) > capacity) return false;
+
+    uint32_t index = hash(uid);
+
+    while (slots[index].uid.high != 0) {
+        if (slots[index].uid == uid) return false;
+
+        index = (index + 1) & mask;
+    }
+
+    Slot& slot = slots[index];
+
+    slot.command = command;
+
+    if (command.type == Command::Command::Type::play) {
+        size_t length = strlen(command.payload.track) + 1;
+        if (arenaUsed + length > arenaSize) return false;
+
+        slot.command.payload.track = static_cast<const char*>(memcpy(arena + arenaUsed, command.payload.track, length));
+        arenaUsed += length;
+        albumCount++;
+    }
+
+    slot.uid = uid;
+    count++;
+
+    return true;
+}
+
+const Command::Command* RfidMap::find(const Uid& uid) const {
+    if (count == 0) return nullptr;
+
+    for (uint32_t index = hash(uid); slots[index].uid.high != 0; index = (index + 1) & mask)
+        if (slots[index].uid == uid) return &slots[index].command;
+
+    return nullptr;
+}
+
+// Fibonacci hashing: only the top bits of a product depend on every bit of the key, so the index is taken from
+// them. The first product folds all of the low word into its top bits before the high word is mixed in.
+uint32_t RfidMap::hash(const Uid& uid) const {
+    constexpr uint64_t MULTIPLIER = 0x9e3779b97f4a7c15ull;
+
+    uint64_t key = (uid.low * MULTIPLIER) ^ uid.high;
+
+    return (key * MULTIPLIER) >> shift;
+}
+
+void RfidMap::release() {
+    if (slots) free(slots);
+
+    slots = nullptr;
+    arena = nullptr;
+    mask = capacity = count = albumCount = shift = 0;
+    arenaSize = arenaUsed = 0;
+}
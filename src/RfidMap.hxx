@@ -0,0 +1,94 @@
+#ifndef RFID_MAP_HXX
+#define RFID_MAP_HXX
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Command.hxx"
+
+/**
+ * Maps card UIDs to commands. The table is built once from the config, with open addressing and linear probing in
+ * a power of two of slots that is at most half full, and the album names of the play commands are copied into one
+ * arena next to it. A lookup compares packed UIDs and allocates nothing, the commands it returns stay valid until
+ * the map is reset.
+ */
+class RfidMap {
+   public:
+    // ISO 14443 UIDs have 4, 7 or 10 bytes
+    struct Uid {
+        static constexpr uint8_t MAX_SIZE = 10;
+
+        // "04:a2:..." including the terminator
+        static constexpr size_t FORMATTED_SIZE = 3 * MAX_SIZE;
+
+        // Bytes 0 to 7, then bytes 8 and 9 and the size in the top byte, so a UID is never all zeros
+        uint64_t low;
+        uint32_t high;
+
+        static Uid fromBytes(const uint8_t* bytes, uint8_t size);
+
+        // The hex bytes separated by colons, as they are written in config.json
+        static bool parse(const char* text, Uid& uid);
+
+        void format(char* buffer) const;
+
+        uint8_t size() const { return high >> 24; }
+
+        bool operator==(const Uid& other) const { return low == other.low && high == other.high; }
+    };
+
+   public:
+    RfidMap() = default;
+
+    ~RfidMap();
+
+    // Drops all mappings and makes room for count mappings with albums of up to arenaSize bytes in total
+    bool reset(uint32_t count, size_t arenaSize);
+
+    // False if the map or the arena is full or the UID is mapped already
+    bool insert(const Uid& uid, const Command::Command& command);
+
+    // nullptr if the UID is not mapped
+    const Command::Command* find(const Uid& uid) const;
+
+    uint32_t size() const { return count; }
+
+    // Play mappings and the bytes of their albums, at least as many as there are distinct albums
+    uint32_t albums() const { return albumCount; }
+    size_t albumBytes() const { return arenaUsed; }
+
+   private:
+    struct Slot {
+        // Empty if all zeros
+        Uid uid;
+        Command::Command command;
+    };
+
+    // The slot a probe for uid starts at
+    uint32_t hash(const Uid& uid) const;
+
+    void release();
+
+   private:
+    Slot* slots{nullptr};
+    uint32_t mask{0};
+    uint8_t shift{0};
+    uint32_t capacity{0};
+    uint32_t count{0};
+    uint32_t albumCount{0};
+
+    char* arena{nullptr};
+    size_t arenaSize{0};
+    size_t arenaUsed{0};
+
+   private:
+    RfidMap(const RfidMap&) = delete;
+
+    RfidMap(RfidMap&&) = delete;
+
+    RfidMap& operator=(const RfidMap&) = delete;
+
+    RfidMap& operator=(RfidMap&&) = delete;
+};
+
+#endif  // RFID_MAP_HXX
@@ -0,0 +1,79 @@
+#ifndef SEQLOCK_HXX
+#define SEQLOCK_HXX
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * Publishes a small value from a single writer to any number of readers. The writer never waits. A reader retries
+ * while a write is in progress or if one happened during its read, so readers must not run at a higher priority
+ * on the writer's core. The value is copied in words through relaxed atomics, which keeps torn reads defined.
+ */
+template <typename T>
+class Seqlock {
+    static_assert(std::is_trivially_copyable<T>::value, "a seqlock copies its value");
+    static_assert(sizeof(T) % sizeof(uint32_t) == 0, "a seqlock copies its value in words");
+
+   public:
+    explicit Seqlock(const T& value) {
+        uint32_t buffer[WORDS];
+        memcpy(buffer, &value, sizeof(T));
+
+        for (size_t i = 0; i < WORDS; i++) words[i].store(buffer[i], std::memory_order_relaxed);
+    }
+
+    // The writer only
+    void write(const T& value) {
+        uint32_t buffer[WORDS];
+        memcpy(buffer, &value, sizeof(T));
+
+        uint32_t current = sequence.load(std::memory_order_relaxed);
+
+        sequence.store(current + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < WORDS; i++) words[i].store(buffer[i], std::memory_order_relaxed);
+
+        sequence.store(current + 2, std::memory_order_release);
+    }
+
+    T read() const {
+        uint32_t buffer[WORDS];
+        uint32_t before, after;
+
+        do {
+            before = sequence.load(std::memory_order_acquire);
+
+            for (size_t i = 0; i < WORDS; i++) buffer[i] = words[i].load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        T value;
+        memcpy(&value, buffer, sizeof(T));
+
+        return value;
+    }
+
+   private:
+    static constexpr size_t WORDS = sizeof(T) / sizeof(uint32_t);
+
+    // Odd while a write is in progress
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<uint32_t> words[WORDS];
+
+   private:
+    Seqlock(const Seqlock&) = delete;
+
+    Seqlock(Seqlock&&) = delete;
+
+    Seqlock& operator=(const Seqlock&) = delete;
+
+    Seqlock& operator=(Seqlock&&) = delete;
+};
+
+#endif  // SEQLOCK_HXX
@@ -1,108 +1,216 @@
 #include "Signal.hxx"
 
+#include <Arduino.h>
+
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <string>
 
-#include "Lock.hxx"
+#include "Log.hxx"
+#include "WavDecoder.hxx"
+#include "config.h"
 
-#define SAMPLE_RATE 44100
-#define _PI 3.1415926535897932384626433832795f
+#define TAG "signal"
 #define AMPLITUDE 0x0fff
 
 namespace {
 
-const Signal::Step signalCommandReceived[] = {{.note = 0, .duration = 50, .amplitude = 0},
-                                              {.note = 36, .duration = 100, .amplitude = AMPLITUDE},
-                                              {.note = 0, .duration = 50, .amplitude = 0},
-                                              {.note = 0, .duration = 0, .amplitude = 0}};
+constexpr uint32_t WAVETABLE_SHIFT = 8;
+constexpr uint32_t WAVETABLE_SIZE = 1 << WAVETABLE_SHIFT;
+
+constexpr uint32_t samplesFor(uint32_t duration) { return duration * SAMPLE_RATE / 1000; }
+
+// Phase increment per sample for a full turn of 2^32
+constexpr uint32_t increment(double frequency) {
+    return static_cast<uint32_t>(frequency * 4294967296.0 / SAMPLE_RATE + 0.5);
+}
+
+const Signal::Step signalCommandReceived[] = {{.note = 0, .samples = samplesFor(50), .amplitude = 0},
+                                              {.note = 36, .samples = samplesFor(100), .amplitude = AMPLITUDE},
+                                              {.note = 0, .samples = samplesFor(50), .amplitude = 0},
+                                              {.note = 0, .samples = 0, .amplitude = 0}};
 
-const Signal::Step signalError[] = {{.note = 0, .duration = 100, .amplitude = 0},
-                                    {.note = 34, .duration = 200, .amplitude = AMPLITUDE},
-                                    {.note = 22, .duration = 200, .amplitude = AMPLITUDE},
-                                    {.note = 0, .duration = 100, .amplitude = 0},
-                                    {.note = 0, .duration = 0, .amplitude = 0}};
+const Signal::Step signalError[] = {{.note = 0, .samples = samplesFor(100), .amplitude = 0},
+                                    {.note = 34, .samples = samplesFor(200), .amplitude = AMPLITUDE},
+                                    {.note = 22, .samples = samplesFor(200), .amplitude = AMPLITUDE},
+                                    {.note = 0, .samples = samplesFor(100), .amplitude = 0},
+                                    {.note = 0, .samples = 0, .amplitude = 0}};
 
 const Signal::Step* signals[] = {signalCommandReceived, signalError};
 
-const float frequencyFactors[49] = {0.,
-                                    130.8127826502992f * 2.f * _PI / SAMPLE_RATE,
-                                    138.59131548843592f * 2.f * _PI / SAMPLE_RATE,
-                                    146.83238395870364f * 2.f * _PI / SAMPLE_RATE,
-                                    155.56349186104035f * 2.f * _PI / SAMPLE_RATE,
-                                    164.81377845643485f * 2.f * _PI / SAMPLE_RATE,
-                                    174.6141157165018f * 2.f * _PI / SAMPLE_RATE,
-                                    184.9972113558171f * 2.f * _PI / SAMPLE_RATE,
-                                    195.99771799087452f * 2.f * _PI / SAMPLE_RATE,
-                                    207.65234878997245f * 2.f * _PI / SAMPLE_RATE,
-                                    219.9999999999999f * 2.f * _PI / SAMPLE_RATE,
-                                    233.08188075904485f * 2.f * _PI / SAMPLE_RATE,
-                                    246.94165062806195f * 2.f * _PI / SAMPLE_RATE,
-                                    261.6255653005985f * 2.f * _PI / SAMPLE_RATE,
-                                    277.18263097687196f * 2.f * _PI / SAMPLE_RATE,
-                                    293.66476791740746f * 2.f * _PI / SAMPLE_RATE,
-                                    311.12698372208087f * 2.f * _PI / SAMPLE_RATE,
-                                    329.62755691286986f * 2.f * _PI / SAMPLE_RATE,
-                                    349.22823143300377f * 2.f * _PI / SAMPLE_RATE,
-                                    369.9944227116344f * 2.f * _PI / SAMPLE_RATE,
-                                    391.99543598174927f * 2.f * _PI / SAMPLE_RATE,
-                                    415.30469757994507f * 2.f * _PI / SAMPLE_RATE,
-                                    440.f * 2.f * _PI / SAMPLE_RATE,
-                                    466.1637615180899f * 2.f * _PI / SAMPLE_RATE,
-                                    493.8833012561241f * 2.f * _PI / SAMPLE_RATE,
-                                    523.2511306011974f * 2.f * _PI / SAMPLE_RATE,
-                                    554.3652619537443f * 2.f * _PI / SAMPLE_RATE,
-                                    587.3295358348153f * 2.f * _PI / SAMPLE_RATE,
-                                    622.253967444162f * 2.f * _PI / SAMPLE_RATE,
-                                    659.2551138257401f * 2.f * _PI / SAMPLE_RATE,
-                                    698.456462866008f * 2.f * _PI / SAMPLE_RATE,
-                                    739.9888454232691f * 2.f * _PI / SAMPLE_RATE,
-                                    783.9908719634989f * 2.f * _PI / SAMPLE_RATE,
-                                    830.6093951598906f * 2.f * _PI / SAMPLE_RATE,
-                                    880.0000000000005f * 2.f * _PI / SAMPLE_RATE,
-                                    932.3275230361803f * 2.f * _PI / SAMPLE_RATE,
-                                    987.7666025122487f * 2.f * _PI / SAMPLE_RATE,
-                                    1046.5022612023952f * 2.f * _PI / SAMPLE_RATE,
-                                    1108.730523907489f * 2.f * _PI / SAMPLE_RATE,
-                                    1174.659071669631f * 2.f * _PI / SAMPLE_RATE,
-                                    1244.5079348883246f * 2.f * _PI / SAMPLE_RATE,
-                                    1318.5102276514806f * 2.f * _PI / SAMPLE_RATE,
-                                    1396.912925732017f * 2.f * _PI / SAMPLE_RATE,
-                                    1479.977690846539f * 2.f * _PI / SAMPLE_RATE,
-                                    1567.9817439269987f * 2.f * _PI / SAMPLE_RATE,
-                                    1661.218790319782f * 2.f * _PI / SAMPLE_RATE,
-                                    1760.0000000000018f * 2.f * _PI / SAMPLE_RATE,
-                                    1864.6550460723615f * 2.f * _PI / SAMPLE_RATE,
-                                    1975.5332050244986 * 2.f * _PI / SAMPLE_RATE};
+const char* clipNames[] = {"command", "error"};
+
+const uint32_t phaseIncrements[49] = {0,
+                                      increment(130.8127826502992),
+                                      increment(138.59131548843592),
+                                      increment(146.83238395870364),
+                                      increment(155.56349186104035),
+                                      increment(164.81377845643485),
+                                      increment(174.6141157165018),
+                                      increment(184.9972113558171),
+                                      increment(195.99771799087452),
+                                      increment(207.65234878997245),
+                                      increment(219.9999999999999),
+                                      increment(233.08188075904485),
+                                      increment(246.94165062806195),
+                                      increment(261.6255653005985),
+                                      increment(277.18263097687196),
+                                      increment(293.66476791740746),
+                                      increment(311.12698372208087),
+                                      increment(329.62755691286986),
+                                      increment(349.22823143300377),
+                                      increment(369.9944227116344),
+                                      increment(391.99543598174927),
+                                      increment(415.30469757994507),
+                                      increment(440.),
+                                      increment(466.1637615180899),
+                                      increment(493.8833012561241),
+                                      increment(523.2511306011974),
+                                      increment(554.3652619537443),
+                                      increment(587.3295358348153),
+                                      increment(622.253967444162),
+                                      increment(659.2551138257401),
+                                      increment(698.456462866008),
+                                      increment(739.9888454232691),
+                                      increment(783.9908719634989),
+                                      increment(830.6093951598906),
+                                      increment(880.0000000000005),
+                                      increment(932.3275230361803),
+                                      increment(987.7666025122487),
+                                      increment(1046.5022612023952),
+                                      increment(1108.730523907489),
+                                      increment(1174.659071669631),
+                                      increment(1244.5079348883246),
+                                      increment(1318.5102276514806),
+                                      increment(1396.912925732017),
+                                      increment(1479.977690846539),
+                                      increment(1567.9817439269987),
+                                      increment(1661.218790319782),
+                                      increment(1760.0000000000018),
+                                      increment(1864.6550460723615),
+                                      increment(1975.5332050244986)};
+
+// One extra entry so the interpolation does not need to wrap
+int16_t wavetable[WAVETABLE_SIZE + 1];
+
+// Linear interpolation between the two closest entries, Q15
+inline int32_t lookup(uint32_t phase) {
+    uint32_t index = phase >> (32 - WAVETABLE_SHIFT);
+    int32_t fraction = (phase >> (16 - WAVETABLE_SHIFT)) & 0xffff;
+
+    return wavetable[index] + (((wavetable[index + 1] - wavetable[index]) * fraction) >> 16);
+}
+
 }  // namespace
 
+Signal::~Signal() {
+    for (Clip& c : clips)
+        if (c.samples) free(c.samples);
+}
+
+void Signal::initialize() {
+    for (uint32_t i = 0; i <= WAVETABLE_SIZE; i++)
+        wavetable[i] = lroundf(32767.f * sinf(2.f * static_cast<float>(M_PI) * i / WAVETABLE_SIZE));
+
+    for (uint32_t type = 0; type < TYPE_COUNT; type++) {
+        std::string path = std::string(CUE_DIRECTORY) + "/" + clipNames[type] + ".wav";
+
+        if (!clips[type].samples && loadClip(path.c_str(), clips[type]))
+            LOG_INFO(TAG, "loaded %s with %u samples", path.c_str(), clips[type].count);
+    }
+}
+
+bool Signal::loadClip(const char* path, Clip& clip) {
+    WavDecoder decoder;
+
+    if (!decoder.open(path)) return false;
+
+    uint32_t duration = std::min(decoder.getDuration(), static_cast<uint32_t>(CUE_CLIP_LIMIT_MS));
+    uint32_t capacity = samplesFor(duration + 1);
+
+    clip.samples = (int16_t*)ps_malloc(4 * capacity);
+    clip.count = 0;
+
+    if (!clip.samples) {
+        LOG_WARN(TAG, "no memory for %s", path);
+
+        decoder.close();
+        return false;
+    }
+
+    for (uint32_t decoded; clip.count < capacity &&
+                           (decoded = decoder.decode(clip.samples + 2 * clip.count, capacity - clip.count)) > 0;)
+        clip.count += decoded;
+
+    decoder.close();
+
+    if (clip.count == 0) {
+        free(clip.samples);
+        clip.samples = nullptr;
+    }
+
+    return clip.count > 0;
+}
+
 void Signal::start(Type type) {
     active = true;
+
+    clip = clips[type].samples ? &clips[type] : nullptr;
+    clipPosition = 0;
+
     step = signals[type];
-    currentSampleIndex = 0;
+    remaining = step->samples;
+    phase = 0;
 }
 
-uint32_t Signal::play(int16_t* buffer, uint32_t count) {
+uint32_t Signal::render(int16_t* buffer, uint32_t count) {
     if (!active) return 0;
 
+    return clip ? renderClip(buffer, count) : renderSteps(buffer, count);
+}
+
+uint32_t Signal::renderSteps(int16_t* buffer, uint32_t count) {
     uint32_t samplesGenerated = 0;
 
     while (samplesGenerated < count) {
-        if ((1000 * currentSampleIndex) / SAMPLE_RATE > step->duration) {
+        if (remaining == 0) {
             step++;
 
-            if (step->duration == 0) {
+            if (step->samples == 0) {
                 active = false;
                 break;
             }
 
-            currentSampleIndex = 0;
+            remaining = step->samples;
+            phase = 0;
         }
 
-        buffer[0] = buffer[1] = floorf(step->amplitude * sinf(currentSampleIndex * frequencyFactors[step->note]));
+        uint32_t n = std::min(count - samplesGenerated, remaining);
+        uint32_t phaseIncrement = phaseIncrements[step->note];
+        int32_t amplitude = step->amplitude;
+
+        for (uint32_t i = 0; i < n; i++) {
+            buffer[0] = buffer[1] = (lookup(phase) * amplitude) >> 15;
 
-        buffer += 2;
-        currentSampleIndex++;
-        samplesGenerated++;
+            buffer += 2;
+            phase += phaseIncrement;
+        }
+
+        remaining -= n;
+        samplesGenerated += n;
     }
 
     return samplesGenerated;
 }
+
+uint32_t Signal::renderClip(int16_t* buffer, uint32_t count) {
+    uint32_t n = std::min(count, clip->count - clipPosition);
+
+    memcpy(buffer, clip->samples + 2 * clipPosition, 4 * n);
+    clipPosition += n;
+
+    if (clipPosition == clip->count) active = false;
+
+    return n;
+}
@@ -3,31 +3,72 @@
 
 #include <cstdint>
 
-class Signal {
+#include "Mixer.hxx"
+
+/**
+ * Acknowledgement and error cues. Each cue is either a short PCM clip that has been loaded from
+ * CUE_DIRECTORY into PSRAM or, if there is none, a sequence of tones synthesized from a sine
+ * wavetable with an integer phase accumulator.
+ */
+class Signal : public Mixer::Source {
    public:
     enum Type : uint8_t { commandReceived = 0, error = 1 };
 
+    static constexpr uint32_t TYPE_COUNT = 2;
+
     struct Step {
         uint8_t note;
-        uint32_t duration;
+        uint32_t samples;
         int16_t amplitude;
     };
 
    public:
     Signal() = default;
 
+    ~Signal();
+
+    // Builds the wavetable and loads <CUE_DIRECTORY>/command.wav and error.wav if they exist
+    void initialize();
+
     void start(Type type);
 
-    bool isActive() const { return active; }
+    bool isActive() const override { return active; }
 
-    uint32_t play(int16_t* buffer, uint32_t count);
+    uint32_t render(int16_t* buffer, uint32_t count) override;
+
+   private:
+    struct Clip {
+        int16_t* samples;
+        uint32_t count;
+    };
+
+   private:
+    bool loadClip(const char* path, Clip& clip);
+
+    uint32_t renderSteps(int16_t* buffer, uint32_t count);
+
+    uint32_t renderClip(int16_t* buffer, uint32_t count);
 
    private:
     bool active{false};
 
-    const Step* step;
+    const Step* step{nullptr};
+    uint32_t remaining{0};
+    uint32_t phase{0};
+
+    const Clip* clip{nullptr};
+    uint32_t clipPosition{0};
+
+    Clip clips[TYPE_COUNT]{};
+
+   private:
+    Signal(const Signal&) = delete;
+
+    Signal(Signal&&) = delete;
+
+    Signal& operator=(const Signal&) = delete;
 
-    uint32_t currentSampleIndex;
+    Signal& operator=(Signal&&) = delete;
 };
 
 #endif  // SIGNAL_HXX
@@ -0,0 +1,697 @@
+#include "Tag.hxx"
+
+#include <strings.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "Log.hxx"
+
+#define TAG "tag"
+
+namespace {
+
+constexpr size_t ID3V2_HEADER_SIZE = 10;
+constexpr size_t ID3V1_SIZE = 128;
+constexpr size_t APE_FOOTER_SIZE = 32;
+
+constexpr uint8_t ID3V2_FLAG_FOOTER = 0x10;
+constexpr uint8_t ID3V2_FLAG_EXTENDED_HEADER = 0x40;
+constexpr uint32_t APE_FLAG_HAS_HEADER = 0x80000000;
+
+// Text frames are truncated to what fits the target field even if encoded as UTF-16
+constexpr size_t TEXT_FRAME_READ_LIMIT = 2 * Tag::Metadata::FIELD_SIZE + 3;
+
+constexpr uint8_t FLAC_BLOCK_STREAMINFO = 0;
+constexpr uint8_t FLAC_BLOCK_VORBIS_COMMENT = 4;
+constexpr size_t FLAC_STREAMINFO_SIZE = 18;
+constexpr size_t VORBIS_COMMENT_READ_LIMIT = Tag::Metadata::FIELD_SIZE + 8;
+
+constexpr uint32_t XING_FLAG_FRAMES = 0x01;
+constexpr uint32_t XING_FLAG_BYTES = 0x02;
+constexpr uint32_t XING_FLAG_TOC = 0x04;
+
+// Large enough for the element ID, the times and an embedded title frame of a CHAP frame
+constexpr size_t CHAP_READ_LIMIT = 48 + TEXT_FRAME_READ_LIMIT;
+
+constexpr size_t SYNC_SCAN_WINDOW = 192;
+constexpr size_t SYNC_SCAN_LIMIT = 0x4000;
+
+const uint16_t bitrateTable[5][15] = {{0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+                                      {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+                                      {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+                                      {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+                                      {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}};
+
+const uint16_t samplerateTable[3] = {44100, 48000, 32000};
+
+struct FrameHeader {
+    bool mpeg1;
+    bool mono;
+    uint8_t layer;
+    uint32_t bitrate;
+    uint32_t samplerate;
+    uint32_t samplesPerFrame;
+    uint32_t length;
+};
+
+bool readAt(FILE* file, size_t offset, uint8_t* buffer, size_t len) {
+    if (fseek(file, offset, SEEK_SET) != 0) return false;
+
+    size_t bytesRead = 0;
+    while (bytesRead < len) {
+        size_t r = fread(buffer + bytesRead, 1, len - bytesRead, file);
+        if (r == 0) return false;
+
+        bytesRead += r;
+    }
+
+    return true;
+}
+
+uint32_t decodeSyncsafe(const uint8_t* data) {
+    return (data[0] << 21) | (data[1] << 14) | (data[2] << 7) | data[3];
+}
+
+uint32_t decodeLE32(const uint8_t* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+uint32_t decodeBE32(const uint8_t* data) {
+    return (static_cast<uint32_t>(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+uint32_t decodeBE24(const uint8_t* data) { return (data[0] << 16) | (data[1] << 8) | data[2]; }
+
+bool isSyncsafe(const uint8_t* data) { return ((data[0] | data[1] | data[2] | data[3]) & 0x80) == 0; }
+
+// Total size of an ID3v2 header or footer block, or 0 if this is no valid block
+size_t id3v2TagSize(const uint8_t* data, const char* magic) {
+    if (memcmp(data, magic, 3) != 0 || data[3] == 0xff || data[4] == 0xff || !isSyncsafe(data + 6)) return 0;
+
+    return ID3V2_HEADER_SIZE + decodeSyncsafe(data + 6) + ((data[5] & ID3V2_FLAG_FOOTER) ? ID3V2_HEADER_SIZE : 0);
+}
+
+bool decodeFrameHeader(const uint8_t* data, FrameHeader& header) {
+    if (data[0] != 0xff || (data[1] & 0xe0) != 0xe0) return false;
+
+    uint8_t version = (data[1] >> 3) & 0x03;
+    uint8_t layer = 4 - ((data[1] >> 1) & 0x03);
+    uint8_t bitrateIndex = data[2] >> 4;
+    uint8_t samplerateIndex = (data[2] >> 2) & 0x03;
+    uint8_t padding = (data[2] >> 1) & 0x01;
+
+    if (version == 1 || layer == 4 || bitrateIndex == 0 || bitrateIndex == 15 || samplerateIndex == 3) return false;
+
+    header.mpeg1 = version == 3;
+    header.mono = (data[3] >> 6) == 3;
+    header.layer = layer;
+    header.bitrate = bitrateTable[header.mpeg1 ? layer - 1 : (layer == 1 ? 3 : 4)][bitrateIndex] * 1000;
+    header.samplerate = samplerateTable[samplerateIndex] >> (version == 3 ? 0 : (version == 2 ? 1 : 2));
+
+    if (layer == 1) {
+        header.samplesPerFrame = 384;
+        header.length = (12 * header.bitrate / header.samplerate + padding) * 4;
+    } else {
+        header.samplesPerFrame = (layer == 3 && !header.mpeg1) ? 576 : 1152;
+        header.length = header.samplesPerFrame / 8 * header.bitrate / header.samplerate + padding;
+    }
+
+    return true;
+}
+
+struct VbrHeader {
+    uint32_t frames;
+    uint32_t bytes;
+    const uint8_t* toc;
+};
+
+// Frame count, byte count and TOC from a Xing / Info or VBRI header in the first frame, false if there is none
+bool readVbrHeader(const uint8_t* frame, size_t len, const FrameHeader& header, VbrHeader& vbr) {
+    size_t offset = 4 + (header.mpeg1 ? (header.mono ? 17 : 32) : (header.mono ? 9 : 17));
+
+    vbr = {.frames = 0, .bytes = 0, .toc = nullptr};
+
+    if (header.layer == 3 && offset + 8 <= len &&
+        (memcmp(frame + offset, "Xing", 4) == 0 || memcmp(frame + offset, "Info", 4) == 0)) {
+        uint32_t flags = decodeBE32(frame + offset + 4);
+        offset += 8;
+
+        if ((flags & XING_FLAG_FRAMES) && offset + 4 <= len) vbr.frames = decodeBE32(frame + offset);
+        if (flags & XING_FLAG_FRAMES) offset += 4;
+
+        if ((flags & XING_FLAG_BYTES) && offset + 4 <= len) vbr.bytes = decodeBE32(frame + offset);
+        if (flags & XING_FLAG_BYTES) offset += 4;
+
+        if ((flags & XING_FLAG_TOC) && offset + Tag::SeekTable::TOC_SIZE <= len) vbr.toc = frame + offset;
+
+        return true;
+    }
+
+    if (36 + 18 <= len && memcmp(frame + 36, "VBRI", 4) == 0) {
+        vbr.bytes = decodeBE32(frame + 36 + 10);
+        vbr.frames = decodeBE32(frame + 36 + 14);
+
+        return true;
+    }
+
+    return false;
+}
+
+void appendUtf8(char*& target, const char* targetEnd, uint32_t codepoint) {
+    char encoded[4];
+    size_t len;
+
+    if (codepoint < 0x20) codepoint = ' ';
+
+    if (codepoint < 0x80) {
+        encoded[0] = codepoint;
+        len = 1;
+    } else if (codepoint < 0x800) {
+        encoded[0] = 0xc0 | (codepoint >> 6);
+        encoded[1] = 0x80 | (codepoint & 0x3f);
+        len = 2;
+    } else if (codepoint < 0x10000) {
+        encoded[0] = 0xe0 | (codepoint >> 12);
+        encoded[1] = 0x80 | ((codepoint >> 6) & 0x3f);
+        encoded[2] = 0x80 | (codepoint & 0x3f);
+        len = 3;
+    } else {
+        encoded[0] = 0xf0 | (codepoint >> 18);
+        encoded[1] = 0x80 | ((codepoint >> 12) & 0x3f);
+        encoded[2] = 0x80 | ((codepoint >> 6) & 0x3f);
+        encoded[3] = 0x80 | (codepoint & 0x3f);
+        len = 4;
+    }
+
+    if (target + len > targetEnd) return;
+
+    memcpy(target, encoded, len);
+    target += len;
+}
+
+// Decodes an ID3 text payload to UTF-8, replacing control characters and trimming padding
+void decodeText(const uint8_t* data, size_t len, uint8_t encoding, char* target) {
+    char* out = target;
+    const char* outEnd = target + Tag::Metadata::FIELD_SIZE - 1;
+
+    switch (encoding) {
+        case 1:
+        case 2: {
+            bool bigEndian = encoding == 2;
+
+            if (len >= 2 && ((data[0] == 0xfe && data[1] == 0xff) || (data[0] == 0xff && data[1] == 0xfe))) {
+                bigEndian = data[0] == 0xfe;
+                data += 2;
+                len -= 2;
+            }
+
+            for (size_t i = 0; i + 1 < len; i += 2) {
+                uint32_t unit = bigEndian ? (data[i] << 8) | data[i + 1] : data[i] | (data[i + 1] << 8);
+                if (unit == 0) break;
+
+                if (unit >= 0xd800 && unit < 0xdc00 && i + 3 < len) {
+                    uint32_t low = bigEndian ? (data[i + 2] << 8) | data[i + 3] : data[i + 2] | (data[i + 3] << 8);
+
+                    if (low >= 0xdc00 && low < 0xe000) {
+                        unit = 0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00);
+                        i += 2;
+                    }
+                }
+
+                appendUtf8(out, outEnd, unit);
+            }
+
+            break;
+        }
+
+        case 3:
+            for (size_t i = 0; i < len && data[i] != 0 && out < outEnd; i++) *(out++) = data[i] < 0x20 ? ' ' : data[i];
+
+            // Do not leave a truncated multibyte sequence behind
+            if (out > target && (out[-1] & 0x80)) {
+                char* lead = out - 1;
+                while (lead > target && (*lead & 0xc0) == 0x80) lead--;
+
+                size_t expected = (*lead & 0xe0) == 0xc0 ? 2 : ((*lead & 0xf0) == 0xe0 ? 3 : 4);
+                if (static_cast<size_t>(out - lead) < expected) out = lead;
+            }
+
+            break;
+
+        default:
+            for (size_t i = 0; i < len && data[i] != 0; i++) appendUtf8(out, outEnd, data[i]);
+            break;
+    }
+
+    while (out > target && out[-1] == ' ') out--;
+    *out = 0;
+}
+
+char* textFrameTarget(const uint8_t* id, uint8_t majorVersion, Tag::Metadata& metadata) {
+    if (majorVersion == 2) {
+        if (memcmp(id, "TT2", 3) == 0) return metadata.title;
+        if (memcmp(id, "TP1", 3) == 0) return metadata.artist;
+        if (memcmp(id, "TAL", 3) == 0) return metadata.album;
+    } else {
+        if (memcmp(id, "TIT2", 4) == 0) return metadata.title;
+        if (memcmp(id, "TPE1", 4) == 0) return metadata.artist;
+        if (memcmp(id, "TALB", 4) == 0) return metadata.album;
+    }
+
+    return nullptr;
+}
+
+using FrameVisitor = std::function<bool(const uint8_t* id, uint8_t majorVersion, size_t offset, size_t size)>;
+
+// Size of an ID3v2 frame from its header, 0 if the frame is compressed or encrypted and can not be read
+size_t id3v2FrameSize(const uint8_t* header, uint8_t majorVersion, bool& readable) {
+    readable = true;
+
+    if (majorVersion == 2) return decodeBE24(header + 3);
+
+    if (majorVersion == 3) {
+        readable = (header[9] & 0xc0) == 0;
+        return decodeBE32(header + 4);
+    }
+
+    readable = (header[9] & 0x0f) == 0;
+    return decodeSyncsafe(header + 4);
+}
+
+// Walks the frames of the first ID3v2 tag. Only the frame headers are read here, the visitor reads the payload
+// of the readable frames it is interested in and returns false once it is done.
+void walkId3v2(FILE* file, const FrameVisitor& visitor) {
+    uint8_t header[ID3V2_HEADER_SIZE];
+    if (!readAt(file, 0, header, ID3V2_HEADER_SIZE) || id3v2TagSize(header, "ID3") == 0) return;
+
+    const uint8_t majorVersion = header[3];
+    if (majorVersion < 2 || majorVersion > 4) return;
+
+    const size_t frameHeaderSize = majorVersion == 2 ? 6 : 10;
+    const size_t end = ID3V2_HEADER_SIZE + decodeSyncsafe(header + 6);
+    size_t offset = ID3V2_HEADER_SIZE;
+
+    if (majorVersion > 2 && (header[5] & ID3V2_FLAG_EXTENDED_HEADER)) {
+        if (end - offset < 4 || !readAt(file, offset, header, 4)) return;
+
+        // Only the v2.4 size includes the size field, a size beyond the tag would wrap the offset on the ESP32
+        size_t extendedSize = majorVersion == 4 ? decodeSyncsafe(header) : decodeBE32(header);
+        if (extendedSize > (majorVersion == 4 ? end - offset : end - offset - 4)) return;
+
+        offset += majorVersion == 4 ? extendedSize : extendedSize + 4;
+    }
+
+    while (offset + frameHeaderSize <= end) {
+        if (!readAt(file, offset, header, frameHeaderSize) || header[0] == 0) break;
+
+        bool readable;
+        size_t frameSize = id3v2FrameSize(header, majorVersion, readable);
+
+        if (frameSize > end - offset - frameHeaderSize) break;
+
+        if (readable && !visitor(header, majorVersion, offset + frameHeaderSize, frameSize)) break;
+
+        offset += frameHeaderSize + frameSize;
+    }
+}
+
+void readId3v2(FILE* file, Tag::Metadata& metadata) {
+    uint8_t frame[TEXT_FRAME_READ_LIMIT];
+    uint32_t fieldsMissing = 3;
+
+    walkId3v2(file, [&](const uint8_t* id, uint8_t majorVersion, size_t offset, size_t frameSize) {
+        char* target = textFrameTarget(id, majorVersion, metadata);
+
+        if (target && target[0] == 0 && frameSize > 1) {
+            size_t len = std::min(frameSize, TEXT_FRAME_READ_LIMIT);
+
+            if (readAt(file, offset, frame, len)) {
+                decodeText(frame + 1, len - 1, frame[0], target);
+                if (target[0] != 0) fieldsMissing--;
+            }
+        }
+
+        return fieldsMissing > 0;
+    });
+}
+
+// element ID \0, start time, end time, start offset, end offset, embedded frames
+bool parseChapter(const uint8_t* data, size_t len, uint8_t majorVersion, Tag::Chapter& chapter) {
+    const uint8_t* idEnd = static_cast<const uint8_t*>(memchr(data, 0, len));
+    if (!idEnd || static_cast<size_t>(idEnd - data) + 17 > len) return false;
+
+    size_t offset = idEnd - data + 1;
+
+    chapter.start = decodeBE32(data + offset);
+    chapter.end = decodeBE32(data + offset + 4);
+    chapter.title[0] = 0;
+
+    offset += 16;
+
+    while (offset + 10 <= len && data[offset] != 0) {
+        bool readable;
+        size_t frameSize = id3v2FrameSize(data + offset, majorVersion, readable);
+
+        if (readable && memcmp(data + offset, "TIT2", 4) == 0 && frameSize > 1) {
+            size_t textLen = std::min(frameSize, len - offset - 10);
+            if (textLen > 1) decodeText(data + offset + 11, textLen - 1, data[offset + 10], chapter.title);
+
+            break;
+        }
+
+        if (frameSize > len - offset - 10) break;
+
+        offset += 10 + frameSize;
+    }
+
+    return true;
+}
+
+void readId3v1(FILE* file, size_t fileSize, Tag::Metadata& metadata) {
+    uint8_t tag[ID3V1_SIZE];
+    if (fileSize < ID3V1_SIZE || !readAt(file, fileSize - ID3V1_SIZE, tag, ID3V1_SIZE) || memcmp(tag, "TAG", 3) != 0)
+        return;
+
+    if (metadata.title[0] == 0) decodeText(tag + 3, 30, 0, metadata.title);
+    if (metadata.artist[0] == 0) decodeText(tag + 33, 30, 0, metadata.artist);
+    if (metadata.album[0] == 0) decodeText(tag + 63, 30, 0, metadata.album);
+}
+
+// KEY=value pairs of a Vorbis comment block, the values are UTF-8 and truncated to the field size
+void readVorbisComments(FILE* file, size_t offset, size_t end, Tag::Metadata& metadata) {
+    uint8_t buffer[VORBIS_COMMENT_READ_LIMIT];
+
+    // vendor string
+    if (offset + 4 > end || !readAt(file, offset, buffer, 4)) return;
+
+    size_t vendorLen = decodeLE32(buffer);
+    if (vendorLen > end - offset - 4) return;
+
+    offset += 4 + vendorLen;
+
+    if (offset + 4 > end || !readAt(file, offset, buffer, 4)) return;
+    uint32_t count = decodeLE32(buffer);
+    offset += 4;
+
+    for (uint32_t i = 0; i < count && offset + 4 <= end; i++) {
+        if (!readAt(file, offset, buffer, 4)) return;
+
+        size_t len = decodeLE32(buffer);
+        offset += 4;
+
+        if (len > end - offset) return;
+
+        size_t readLen = std::min(len, std::min(VORBIS_COMMENT_READ_LIMIT, end - offset));
+        if (!readAt(file, offset, buffer, readLen)) return;
+        offset += len;
+
+        const uint8_t* separator = static_cast<const uint8_t*>(memchr(buffer, '=', readLen));
+        if (!separator) continue;
+
+        size_t keyLen = separator - buffer;
+        const char* key = reinterpret_cast<const char*>(buffer);
+        char* target = nullptr;
+
+        if (keyLen == 5 && strncasecmp(key, "TITLE", 5) == 0) target = metadata.title;
+        if (keyLen == 6 && strncasecmp(key, "ARTIST", 6) == 0) target = metadata.artist;
+        if (keyLen == 5 && strncasecmp(key, "ALBUM", 5) == 0) target = metadata.album;
+
+        // The first of several values wins
+        if (target && target[0] == 0) decodeText(separator + 1, readLen - keyLen - 1, 3, target);
+    }
+}
+
+// Offset of the first frame between start and end that is followed by a matching frame header. The window
+// holds the beginning of that frame. Returns end if there is none.
+size_t findFirstFrame(FILE* file, size_t start, size_t end, FrameHeader& header, uint8_t* window, size_t& len) {
+    FrameHeader nextHeader;
+    size_t offset = start;
+
+    while (offset + 4 <= end && offset < start + SYNC_SCAN_LIMIT) {
+        len = std::min(SYNC_SCAN_WINDOW, end - offset);
+        if (!readAt(file, offset, window, len)) return end;
+
+        size_t i = 0;
+        while (i + 4 <= len && !decodeFrameHeader(window + i, header)) i++;
+
+        if (i + 4 > len) {
+            offset += len - 3;
+            continue;
+        }
+
+        if (i > 0) {
+            offset += i;
+            continue;
+        }
+
+        // Guard against false syncs by requiring a matching header at the start of the next frame
+        uint8_t next[4];
+        if (offset + header.length + 4 <= end &&
+            !(readAt(file, offset + header.length, next, 4) && decodeFrameHeader(next, nextHeader) &&
+              nextHeader.layer == header.layer && nextHeader.samplerate == header.samplerate)) {
+            offset++;
+            continue;
+        }
+
+        return offset;
+    }
+
+    return end;
+}
+
+}  // namespace
+
+uint32_t Tag::estimateDuration(FILE* file, size_t start, size_t end) {
+    uint8_t window[SYNC_SCAN_WINDOW];
+    size_t len;
+    FrameHeader header;
+    VbrHeader vbr;
+
+    size_t offset = findFirstFrame(file, start, end, header, window, len);
+    if (offset >= end) return 0;
+
+    if (readVbrHeader(window, len, header, vbr) && vbr.frames > 0)
+        return static_cast<uint64_t>(vbr.frames) * header.samplesPerFrame * 1000 / header.samplerate;
+
+    return static_cast<uint64_t>(end - offset) * 8000 / header.bitrate;
+}
+
+bool Tag::readSeekTable(FILE* file, size_t start, size_t end, SeekTable& table) {
+    uint8_t window[SYNC_SCAN_WINDOW];
+    size_t len;
+    FrameHeader header;
+    VbrHeader vbr;
+
+    size_t offset = findFirstFrame(file, start, end, header, window, len);
+    if (offset >= end) return false;
+
+    table = {.headerFrame = offset,
+             .firstAudioFrame = offset,
+             .end = end,
+             .samplesPerFrame = header.samplesPerFrame,
+             .frameCount = 0,
+             .frameBytes = static_cast<uint64_t>(header.samplesPerFrame) * header.bitrate,
+             .frameDivisor = 8 * header.samplerate,
+             .hasToc = false,
+             .tocBytes = 0,
+             .toc = {}};
+
+    if (!readVbrHeader(window, len, header, vbr)) return true;
+
+    table.firstAudioFrame = std::min(offset + header.length, end);
+    table.frameCount = vbr.frames;
+
+    if (vbr.frames > 0) {
+        table.frameBytes = end - table.firstAudioFrame;
+        table.frameDivisor = vbr.frames;
+    }
+
+    if (vbr.toc && vbr.frames > 0) {
+        table.hasToc = true;
+        table.tocBytes = vbr.bytes > 0 ? std::min(static_cast<size_t>(vbr.bytes), end - offset) : end - offset;
+        memcpy(table.toc, vbr.toc, SeekTable::TOC_SIZE);
+    }
+
+    return true;
+}
+
+size_t Tag::frameOffset(const SeekTable& table, uint32_t frame) {
+    uint32_t headerFrames = table.firstAudioFrame > table.headerFrame ? 1 : 0;
+
+    if (frame < headerFrames) return table.headerFrame;
+
+    uint32_t audioFrame = frame - headerFrames;
+    uint64_t offset;
+
+    if (table.hasToc) {
+        // Position in 1/1000 percent, interpolated between the TOC entries
+        uint64_t position = static_cast<uint64_t>(std::min(audioFrame, table.frameCount)) * 100000 / table.frameCount;
+        uint32_t i = std::min(static_cast<uint32_t>(position / 1000), static_cast<uint32_t>(SeekTable::TOC_SIZE - 1));
+        uint32_t a = table.toc[i];
+        uint32_t b = i + 1 < SeekTable::TOC_SIZE ? std::max(table.toc[i + 1], table.toc[i]) : 256;
+
+        offset = table.headerFrame +
+                 static_cast<uint64_t>(table.tocBytes) * (a * 1000 + (b - a) * (position - i * 1000)) / 256000;
+        offset = std::max(offset, static_cast<uint64_t>(table.firstAudioFrame));
+    } else {
+        offset = table.firstAudioFrame + audioFrame * table.frameBytes / table.frameDivisor;
+    }
+
+    return std::min(offset, static_cast<uint64_t>(table.end));
+}
+
+uint32_t Tag::frameAt(const SeekTable& table, size_t offset) {
+    uint32_t headerFrames = table.firstAudioFrame > table.headerFrame ? 1 : 0;
+
+    if (offset < table.firstAudioFrame) return 0;
+
+    if (!table.hasToc)
+        return headerFrames +
+               (offset - table.firstAudioFrame) * static_cast<uint64_t>(table.frameDivisor) / table.frameBytes;
+
+    // 1/1000 of a TOC step
+    uint64_t target = static_cast<uint64_t>(offset - table.headerFrame) * 256000 / table.tocBytes;
+    uint64_t position = 100000;
+
+    for (uint32_t i = 0; i < SeekTable::TOC_SIZE; i++) {
+        uint32_t a = table.toc[i] * 1000;
+        uint32_t b = (i + 1 < SeekTable::TOC_SIZE ? table.toc[i + 1] : 256) * 1000;
+
+        if (target < b && b > a) {
+            position = i * 1000 + (target > a ? (target - a) * 1000 / (b - a) : 0);
+            break;
+        }
+    }
+
+    return headerFrames + position * table.frameCount / 100000;
+}
+
+size_t Tag::leadingTagsEnd(FILE* file) {
+    uint8_t header[ID3V2_HEADER_SIZE];
+    size_t offset = 0;
+
+    // Files that went through several taggers may carry more than one tag
+    while (readAt(file, offset, header, ID3V2_HEADER_SIZE)) {
+        size_t tagSize = id3v2TagSize(header, "ID3");
+        if (tagSize == 0) break;
+
+        LOG_DEBUG(TAG, "skipping %u bytes of ID3v2 tag at %u", tagSize, offset);
+
+        offset += tagSize;
+    }
+
+    return offset;
+}
+
+size_t Tag::trailingTagsStart(FILE* file) {
+    if (fseek(file, 0, SEEK_END) != 0) return 0;
+
+    long fileSize = ftell(file);
+    if (fileSize < 0) return 0;
+
+    size_t end = fileSize;
+    uint8_t footer[APE_FOOTER_SIZE];
+
+    while (true) {
+        if (end >= ID3V1_SIZE && readAt(file, end - ID3V1_SIZE, footer, 3) && memcmp(footer, "TAG", 3) == 0) {
+            end -= ID3V1_SIZE;
+            continue;
+        }
+
+        if (end >= APE_FOOTER_SIZE && readAt(file, end - APE_FOOTER_SIZE, footer, APE_FOOTER_SIZE) &&
+            memcmp(footer, "APETAGEX", 8) == 0) {
+            // The size includes the footer but not the header
+            size_t tagSize = decodeLE32(footer + 12);
+            if (tagSize < APE_FOOTER_SIZE) break;
+
+            if (decodeLE32(footer + 20) & APE_FLAG_HAS_HEADER) tagSize += APE_FOOTER_SIZE;
+
+            if (tagSize > end) break;
+
+            end -= tagSize;
+            continue;
+        }
+
+        if (end >= ID3V2_HEADER_SIZE && readAt(file, end - ID3V2_HEADER_SIZE, footer, ID3V2_HEADER_SIZE)) {
+            size_t tagSize = id3v2TagSize(footer, "3DI");
+
+            if (tagSize > 0 && tagSize <= end) {
+                end -= tagSize;
+                continue;
+            }
+        }
+
+        break;
+    }
+
+    return end;
+}
+
+void Tag::readMetadata(FILE* file, Metadata& metadata) {
+    metadata.title[0] = metadata.artist[0] = metadata.album[0] = 0;
+    metadata.duration = 0;
+
+    size_t end = trailingTagsStart(file);
+    size_t start = std::min(leadingTagsEnd(file), end);
+
+    readId3v2(file, metadata);
+
+    if (metadata.title[0] == 0 || metadata.artist[0] == 0 || metadata.album[0] == 0) {
+        fseek(file, 0, SEEK_END);
+        long fileSize = ftell(file);
+
+        if (fileSize > 0) readId3v1(file, fileSize, metadata);
+    }
+
+    metadata.duration = estimateDuration(file, start, end);
+}
+
+void Tag::readChapters(FILE* file, const ChapterCallback& callback) {
+    uint8_t frame[CHAP_READ_LIMIT];
+    Chapter chapter;
+
+    walkId3v2(file, [&](const uint8_t* id, uint8_t majorVersion, size_t offset, size_t frameSize) {
+        // ID3v2.2 has no chapters
+        if (majorVersion < 3 || memcmp(id, "CHAP", 4) != 0) return true;
+
+        size_t len = std::min(frameSize, CHAP_READ_LIMIT);
+
+        if (readAt(file, offset, frame, len) && parseChapter(frame, len, majorVersion, chapter) &&
+            chapter.end > chapter.start)
+            callback(chapter);
+
+        return true;
+    });
+}
+
+void Tag::readFlacMetadata(FILE* file, Metadata& metadata) {
+    metadata.title[0] = metadata.artist[0] = metadata.album[0] = 0;
+    metadata.duration = 0;
+
+    uint8_t header[FLAC_STREAMINFO_SIZE];
+    if (!readAt(file, 0, header, 4) || memcmp(header, "fLaC", 4) != 0) return;
+
+    size_t offset = 4;
+    bool last = false;
+
+    while (!last && readAt(file, offset, header, 4)) {
+        last = header[0] & 0x80;
+        uint8_t type = header[0] & 0x7f;
+        size_t length = decodeBE24(header + 1);
+
+        offset += 4;
+
+        if (type == FLAC_BLOCK_STREAMINFO && length >= FLAC_STREAMINFO_SIZE &&
+            readAt(file, offset, header, FLAC_STREAMINFO_SIZE)) {
+            uint32_t sampleRate = (header[10] << 12) | (header[11] << 4) | (header[12] >> 4);
+            uint64_t totalSamples = (static_cast<uint64_t>(header[13] & 0x0f) << 32) | decodeBE32(header + 14);
+
+            if (sampleRate > 0) metadata.duration = totalSamples * 1000 / sampleRate;
+        } else if (type == FLAC_BLOCK_VORBIS_COMMENT) {
+            readVorbisComments(file, offset, offset + length, metadata);
+        }
+
+        offset += length;
+    }
+}
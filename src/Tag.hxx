@@ -0,0 +1,89 @@
+#ifndef TAG_HXX
+#define TAG_HXX
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+
+namespace Tag {
+
+struct Metadata {
+    static constexpr size_t FIELD_SIZE = 128;
+
+    char title[FIELD_SIZE];
+    char artist[FIELD_SIZE];
+    char album[FIELD_SIZE];
+
+    // milliseconds
+    uint32_t duration;
+};
+
+struct Chapter {
+    // milliseconds
+    uint32_t start;
+    uint32_t end;
+
+    char title[Metadata::FIELD_SIZE];
+};
+
+using ChapterCallback = std::function<void(const Chapter&)>;
+
+/**
+ * Maps between frames and file offsets of an MPEG stream in constant time. VBR files are mapped
+ * through the table of contents of their Xing header, all others through the (average) frame size.
+ * Frames are counted from the first frame of the stream, which libmad decodes to silence if it is
+ * a Xing / VBRI frame.
+ */
+struct SeekTable {
+    static constexpr size_t TOC_SIZE = 100;
+
+    size_t headerFrame;
+    size_t firstAudioFrame;
+    size_t end;
+
+    uint32_t samplesPerFrame;
+
+    // Audio frames, 0 if unknown
+    uint32_t frameCount;
+
+    // Without a TOC audio frame k starts at firstAudioFrame + k * frameBytes / frameDivisor
+    uint64_t frameBytes;
+    uint32_t frameDivisor;
+
+    // TOC entries are 1/256 of tocBytes counted from the header frame
+    bool hasToc;
+    size_t tocBytes;
+    uint8_t toc[TOC_SIZE];
+};
+
+// Offset of the first byte after all ID3v2 tags at the start of the file
+size_t leadingTagsEnd(FILE* file);
+
+// Offset of the first byte of ID3v1 / APE / appended ID3v2 tags at the end of the file
+size_t trailingTagsStart(FILE* file);
+
+// Duration in milliseconds of the MPEG stream between start and end, 0 if there is no valid frame
+uint32_t estimateDuration(FILE* file, size_t start, size_t end);
+
+// Reads the first frame of the MPEG stream between start and end, false if there is no valid frame
+bool readSeekTable(FILE* file, size_t start, size_t end, SeekTable& table);
+
+// Approximate offset of the start of a frame, the caller has to resync to the frame header
+size_t frameOffset(const SeekTable& table, uint32_t frame);
+
+// Inverse of frameOffset
+uint32_t frameAt(const SeekTable& table, size_t offset);
+
+// Title, artist and album from ID3v2 (falling back to ID3v1) and the duration derived from
+// the Xing / VBRI header or the bitrate of the first frame. Fields that are missing are empty.
+void readMetadata(FILE* file, Metadata& metadata);
+
+// Calls back for each ID3v2 CHAP frame in the order of the tag, with the title from its embedded TIT2 frame
+void readChapters(FILE* file, const ChapterCallback& callback);
+
+// Title, artist and album from the Vorbis comment and the duration from STREAMINFO of a FLAC file
+void readFlacMetadata(FILE* file, Metadata& metadata);
+
+}  // namespace Tag
+
+#endif  // TAG_HXX
@@ -0,0 +1,150 @@
+#include "Telemetry.hxx"
+
+#include <atomic>
+
+namespace {
+
+// Only the owning task writes, so a relaxed load and store is enough and no read-modify-write is needed
+void increment(std::atomic<uint32_t>& counter, uint32_t amount = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+void updateMaximum(std::atomic<uint32_t>& maximum, uint32_t value) {
+    if (value > maximum.load(std::memory_order_relaxed)) maximum.store(value, std::memory_order_relaxed);
+}
+
+struct Counters {
+    std::atomic<uint32_t> chunks;
+    std::atomic<uint32_t> queueFill[Telemetry::QUEUE_FILL_BUCKETS];
+    std::atomic<uint32_t> renderTime[Telemetry::RENDER_TIME_BUCKETS];
+    std::atomic<uint32_t> maxRenderTime;
+    std::atomic<uint32_t> lateChunks;
+
+    std::atomic<uint32_t> bufferDepth;
+    std::atomic<uint32_t> bufferTarget;
+    std::atomic<uint32_t> maxBufferTarget;
+    std::atomic<uint32_t> bufferUnderruns;
+
+    std::atomic<uint32_t> underruns;
+    std::atomic<uint32_t> underrunFrames;
+
+    std::atomic<uint32_t> decoderErrors;
+    std::atomic<uint32_t> trackDecoderErrors;
+    std::atomic<uint32_t> tracksWithErrors;
+
+    std::atomic<uint32_t> trackSwitches;
+    std::atomic<uint32_t> lastTrackSwitchTime;
+    std::atomic<uint32_t> maxTrackSwitchTime;
+
+    std::atomic<uint32_t> commands;
+    std::atomic<uint32_t> lastCommandLatency;
+    std::atomic<uint32_t> maxCommandLatency;
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LONG_LOCK_FREE == 2, "telemetry counters would take a lock");
+
+// Zero initialized as a global
+Counters counters;
+
+const AudioGraph* graph = nullptr;
+
+size_t renderTimeBucket(uint32_t time) {
+    size_t bucket = 0;
+
+    while (bucket < Telemetry::RENDER_TIME_BUCKETS - 1 && time > Telemetry::RENDER_TIME_LIMITS[bucket]) bucket++;
+
+    return bucket;
+}
+
+}  // namespace
+
+void Telemetry::recordGraph(const AudioGraph& audioGraph) { graph = &audioGraph; }
+
+void Telemetry::recordChunk(uint32_t queueFill, uint32_t bufferDepth, uint32_t bufferTarget) {
+    increment(counters.chunks);
+    increment(counters.queueFill[queueFill < QUEUE_FILL_BUCKETS ? queueFill : QUEUE_FILL_BUCKETS - 1]);
+
+    counters.bufferDepth.store(bufferDepth, std::memory_order_relaxed);
+    counters.bufferTarget.store(bufferTarget, std::memory_order_relaxed);
+    updateMaximum(counters.maxBufferTarget, bufferTarget);
+}
+
+void Telemetry::recordBufferUnderrun() { increment(counters.bufferUnderruns); }
+
+void Telemetry::recordRenderTime(uint32_t renderTime) {
+    increment(counters.renderTime[renderTimeBucket(renderTime)]);
+
+    updateMaximum(counters.maxRenderTime, renderTime);
+
+    if (renderTime > CHUNK_DEADLINE) increment(counters.lateChunks);
+}
+
+void Telemetry::recordDecoderErrors(uint32_t trackErrors) {
+    uint32_t previous = counters.trackDecoderErrors.load(std::memory_order_relaxed);
+
+    if (trackErrors == previous) return;
+
+    // Fewer errors than before means that another track has been opened
+    if (trackErrors < previous) previous = 0;
+
+    if (previous == 0 && trackErrors > 0) increment(counters.tracksWithErrors);
+
+    increment(counters.decoderErrors, trackErrors - previous);
+    counters.trackDecoderErrors.store(trackErrors, std::memory_order_relaxed);
+}
+
+void Telemetry::recordTrackSwitch(uint32_t time) {
+    increment(counters.trackSwitches);
+
+    counters.lastTrackSwitchTime.store(time, std::memory_order_relaxed);
+    updateMaximum(counters.maxTrackSwitchTime, time);
+}
+
+void Telemetry::recordUnderrun(uint32_t frames) {
+    increment(counters.underruns);
+    increment(counters.underrunFrames, frames);
+}
+
+void Telemetry::recordCommandLatency(uint32_t latency) {
+    increment(counters.commands);
+
+    counters.lastCommandLatency.store(latency, std::memory_order_relaxed);
+    updateMaximum(counters.maxCommandLatency, latency);
+}
+
+Telemetry::Snapshot Telemetry::snapshot() {
+    Snapshot snapshot = {
+        .chunks = counters.chunks.load(std::memory_order_relaxed),
+        .queueFill = {},
+        .renderTime = {},
+        .maxRenderTime = counters.maxRenderTime.load(std::memory_order_relaxed),
+        .lateChunks = counters.lateChunks.load(std::memory_order_relaxed),
+        .bufferDepth = counters.bufferDepth.load(std::memory_order_relaxed),
+        .bufferTarget = counters.bufferTarget.load(std::memory_order_relaxed),
+        .maxBufferTarget = counters.maxBufferTarget.load(std::memory_order_relaxed),
+        .bufferUnderruns = counters.bufferUnderruns.load(std::memory_order_relaxed),
+        .underruns = counters.underruns.load(std::memory_order_relaxed),
+        .underrunFrames = counters.underrunFrames.load(std::memory_order_relaxed),
+        .decoderErrors = counters.decoderErrors.load(std::memory_order_relaxed),
+        .trackDecoderErrors = counters.trackDecoderErrors.load(std::memory_order_relaxed),
+        .tracksWithErrors = counters.tracksWithErrors.load(std::memory_order_relaxed),
+        .trackSwitches = counters.trackSwitches.load(std::memory_order_relaxed),
+        .lastTrackSwitchTime = counters.lastTrackSwitchTime.load(std::memory_order_relaxed),
+        .maxTrackSwitchTime = counters.maxTrackSwitchTime.load(std::memory_order_relaxed),
+        .commands = counters.commands.load(std::memory_order_relaxed),
+        .lastCommandLatency = counters.lastCommandLatency.load(std::memory_order_relaxed),
+        .maxCommandLatency = counters.maxCommandLatency.load(std::memory_order_relaxed),
+        .nodeCount = graph ? graph->getNodeCount() : 0,
+        .nodes = {},
+    };
+
+    for (size_t i = 0; i < QUEUE_FILL_BUCKETS; i++)
+        snapshot.queueFill[i] = counters.queueFill[i].load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i < RENDER_TIME_BUCKETS; i++)
+        snapshot.renderTime[i] = counters.renderTime[i].load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i < snapshot.nodeCount; i++) snapshot.nodes[i] = graph->getNodeStats(i);
+
+    return snapshot;
+}
@@ -0,0 +1,94 @@
+#ifndef TELEMETRY_HXX
+#define TELEMETRY_HXX
+
+#include <cstddef>
+#include <cstdint>
+
+#include "AudioGraph.hxx"
+#include "config.h"
+
+/**
+ * Counters and histograms of the audio pipeline since boot. Every field has a single writer, the audio task, the
+ * I2S task or whoever holds the player, and is a lock free atomic, so recording never blocks playback. A snapshot
+ * is consistent per field but not across fields.
+ */
+namespace Telemetry {
+
+// Microseconds of playback in one chunk, the decoder has to decode each chunk within this time on average
+constexpr uint32_t CHUNK_DEADLINE = static_cast<uint64_t>(PLAYBACK_CHUNK_SIZE / 4) * 1000000 / SAMPLE_RATE;
+
+// Upper bounds of the render time buckets in microseconds, the last bucket has none
+constexpr uint32_t RENDER_TIME_LIMITS[] = {1000, 2000, 3000, 4000, 5000, CHUNK_DEADLINE, 10000, 20000, 50000};
+constexpr size_t RENDER_TIME_BUCKETS = sizeof(RENDER_TIME_LIMITS) / sizeof(RENDER_TIME_LIMITS[0]) + 1;
+
+// Chunks waiting in the audio queue, 0 to PLAYBACK_QUEUE_SIZE
+constexpr size_t QUEUE_FILL_BUCKETS = PLAYBACK_QUEUE_SIZE + 1;
+
+struct Snapshot {
+    uint32_t chunks;
+
+    // Queue fill before each chunk was queued, an empty queue means the DMA buffers were all that was left
+    uint32_t queueFill[QUEUE_FILL_BUCKETS];
+
+    // Time to decode one chunk in microseconds
+    uint32_t renderTime[RENDER_TIME_BUCKETS];
+    uint32_t maxRenderTime;
+    uint32_t lateChunks;
+
+    // Blocks of decoded music in the jitter buffer when the last chunk was queued, and the depth it aims for
+    uint32_t bufferDepth;
+    uint32_t bufferTarget;
+    uint32_t maxBufferTarget;
+
+    // The jitter buffer ran dry while music was playing, so a chunk was queued without all of its music
+    uint32_t bufferUnderruns;
+
+    // The DMA ran dry and played silence
+    uint32_t underruns;
+    uint32_t underrunFrames;
+
+    // Corrupt frames that the decoders skipped
+    uint32_t decoderErrors;
+    uint32_t trackDecoderErrors;
+    uint32_t tracksWithErrors;
+
+    // Microseconds from a command or the end of a track until the next track is ready to decode
+    uint32_t trackSwitches;
+    uint32_t lastTrackSwitchTime;
+    uint32_t maxTrackSwitchTime;
+
+    // Microseconds from a command until the first chunk after it can be heard
+    uint32_t commands;
+    uint32_t lastCommandLatency;
+    uint32_t maxCommandLatency;
+
+    // CPU cycles per chunk of each node of the audio graph
+    uint32_t nodeCount;
+    AudioGraph::NodeStats nodes[AudioGraph::MAX_NODES];
+};
+
+// Before the audio task starts, the graph accounts its nodes itself
+void recordGraph(const AudioGraph& graph);
+
+// Audio task
+void recordChunk(uint32_t queueFill, uint32_t bufferDepth, uint32_t bufferTarget);
+
+void recordBufferUnderrun();
+
+// Player, decoding happens in the decoder task and right after commands in the audio task
+void recordRenderTime(uint32_t renderTime);
+
+// The errors of the current track, which start again at 0 whenever a track is opened
+void recordDecoderErrors(uint32_t trackErrors);
+
+void recordTrackSwitch(uint32_t time);
+
+// I2S task
+void recordUnderrun(uint32_t frames);
+
+void recordCommandLatency(uint32_t latency);
+
+Snapshot snapshot();
+}  // namespace Telemetry
+
+#endif  // TELEMETRY_HXX
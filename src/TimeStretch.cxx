@@ -0,0 +1,205 @@
+#include "TimeStretch.hxx"
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "Log.hxx"
+
+#define TAG "stretch"
+
+namespace {
+
+// Mono, 12 bits
+inline int16_t downmix(const int16_t* frame) { return (static_cast<int32_t>(frame[0]) + frame[1]) >> 5; }
+
+// corr * |corr| / energy compares like the normalized cross-correlation without a square root. The inner
+// loop is a plain dot product over contiguous arrays that the compiler can unroll.
+int64_t score(const int16_t* reference, const int16_t* candidate, uint32_t count) {
+    int32_t correlation = 0;
+    int32_t energy = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        correlation += reference[i] * candidate[i];
+        energy += candidate[i] * candidate[i];
+    }
+
+    return static_cast<int64_t>(correlation) * (correlation < 0 ? -correlation : correlation) / (energy + 1);
+}
+
+}  // namespace
+
+TimeStretch::TimeStretch() {}
+
+TimeStretch::~TimeStretch() {
+    if (input) free(input);
+    if (output) free(output);
+}
+
+void TimeStretch::initialize() {
+    if (input) return;
+
+    input = (int16_t*)ps_malloc(4 * INPUT_CAPACITY);
+    output = (int16_t*)ps_malloc(4 * INPUT_CAPACITY);
+
+    if (!input || !output) {
+        LOG_WARN(TAG, "failed to allocate time stretch buffers");
+
+        if (input) free(input);
+        if (output) free(output);
+        input = output = nullptr;
+    }
+
+    reset();
+}
+
+void TimeStretch::setSpeed(uint32_t percent) {
+    percent = std::min(std::max(percent, static_cast<uint32_t>(MIN_SPEED)), static_cast<uint32_t>(MAX_SPEED));
+
+    if (percent == speed) return;
+
+    speed = percent;
+    skip = (static_cast<uint64_t>(SEGMENT - OVERLAP) << 16) * speed / 100;
+
+    reset();
+
+    LOG_INFO(TAG, "playback speed %u%%", speed);
+}
+
+void TimeStretch::reset() {
+    inputLength = outputLength = outputPosition = 0;
+    skipFraction = 0;
+
+    memset(tail, 0, sizeof(tail));
+}
+
+uint32_t TimeStretch::process(int16_t* buffer, uint32_t count, const Source& source) {
+    uint32_t produced = 0;
+
+    while (produced < count) {
+        if (outputPosition == outputLength && !refill(source)) break;
+
+        uint32_t n = std::min(count - produced, outputLength - outputPosition);
+
+        memcpy(buffer + 2 * produced, output + 2 * outputPosition, 4 * n);
+
+        outputPosition += n;
+        produced += n;
+    }
+
+    return produced;
+}
+
+uint32_t TimeStretch::requiredInput() const {
+    return std::max((skipFraction + skip) >> 16, static_cast<uint32_t>(SEGMENT - OVERLAP)) + OVERLAP + SEEK_WINDOW;
+}
+
+bool TimeStretch::refill(const Source& source) {
+    uint32_t required = requiredInput();
+
+    while (inputLength < required) {
+        uint32_t decoded = source(input + 2 * inputLength, INPUT_CAPACITY - inputLength);
+        if (decoded == 0) break;
+
+        inputLength += decoded;
+    }
+
+    if (inputLength >= required) {
+        stretchSegment();
+        return true;
+    }
+
+    if (inputLength == 0) return false;
+
+    flush();
+    return true;
+}
+
+uint32_t TimeStretch::findBestOffset() {
+    constexpr uint32_t referenceLength = OVERLAP / DECIMATION;
+    constexpr uint32_t candidateLength = (SEEK_WINDOW + OVERLAP) / DECIMATION;
+
+    for (uint32_t i = 0; i < referenceLength; i++) reference[i] = downmix(tail + 2 * DECIMATION * i);
+    for (uint32_t i = 0; i < candidateLength; i++) candidates[i] = downmix(input + 2 * DECIMATION * i);
+
+    uint32_t coarse = 0;
+    int64_t bestScore = INT64_MIN;
+
+    for (uint32_t i = 0; i < SEEK_WINDOW / DECIMATION; i++) {
+        int64_t s = score(reference, candidates + i, referenceLength);
+
+        if (s > bestScore) {
+            bestScore = s;
+            coarse = i * DECIMATION;
+        }
+    }
+
+    // Refine at full resolution around the coarse match
+    uint32_t first = coarse >= DECIMATION - 1 ? coarse - (DECIMATION - 1) : 0;
+    uint32_t last = std::min(coarse + DECIMATION - 1, SEEK_WINDOW - 1);
+
+    for (uint32_t i = 0; i < OVERLAP; i++) reference[i] = downmix(tail + 2 * i);
+    for (uint32_t i = 0; i < OVERLAP + last - first; i++) refinement[i] = downmix(input + 2 * (first + i));
+
+    uint32_t best = coarse;
+    bestScore = INT64_MIN;
+
+    for (uint32_t offset = first; offset <= last; offset++) {
+        int64_t s = score(reference, refinement + (offset - first), OVERLAP);
+
+        if (s > bestScore) {
+            bestScore = s;
+            best = offset;
+        }
+    }
+
+    return best;
+}
+
+void TimeStretch::stretchSegment() {
+    const int16_t* segment = input + 2 * findBestOffset();
+
+    // Linear crossfade, the weights sum up to a power of two
+    for (uint32_t i = 0; i < OVERLAP; i++) {
+        output[2 * i] = (segment[2 * i] * static_cast<int32_t>(i) + tail[2 * i] * static_cast<int32_t>(OVERLAP - i)) >>
+                        OVERLAP_SHIFT;
+        output[2 * i + 1] =
+            (segment[2 * i + 1] * static_cast<int32_t>(i) + tail[2 * i + 1] * static_cast<int32_t>(OVERLAP - i)) >>
+            OVERLAP_SHIFT;
+    }
+
+    memcpy(output + 2 * OVERLAP, segment + 2 * OVERLAP, 4 * (SEGMENT - 2 * OVERLAP));
+    memcpy(tail, segment + 2 * (SEGMENT - OVERLAP), 4 * OVERLAP);
+
+    outputPosition = 0;
+    outputLength = SEGMENT - OVERLAP;
+
+    skipFraction += skip;
+    consume(skipFraction >> 16);
+    skipFraction &= 0xffff;
+}
+
+// The end of the stream is too short for another segment and is played at normal speed
+void TimeStretch::flush() {
+    uint32_t fade = inputLength >= OVERLAP ? OVERLAP : 0;
+
+    for (uint32_t i = 0; i < 2 * fade; i++)
+        output[i] = (input[i] * static_cast<int32_t>(i / 2) + tail[i] * static_cast<int32_t>(OVERLAP - i / 2)) >>
+                    OVERLAP_SHIFT;
+
+    memcpy(output + 2 * fade, input + 2 * fade, 4 * (inputLength - fade));
+
+    outputPosition = 0;
+    outputLength = inputLength;
+
+    memset(tail, 0, sizeof(tail));
+    consume(inputLength);
+}
+
+void TimeStretch::consume(uint32_t count) {
+    count = std::min(count, inputLength);
+    inputLength -= count;
+
+    memmove(input, input + 2 * count, 4 * inputLength);
+}
@@ -0,0 +1,101 @@
+#ifndef TIME_STRETCH_HXX
+#define TIME_STRETCH_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/**
+ * Changes the playback speed without changing the pitch (WSOLA). The input is cut into segments
+ * that are crossfaded into each other, and each segment is aligned to the tail of the previous one
+ * within a small window by maximizing the normalized cross-correlation. Everything is fixed point:
+ * the search runs coarse on a decimated mono copy and is refined at full resolution around the best
+ * match, so the cost per segment is bounded and independent of the signal.
+ */
+class TimeStretch {
+   public:
+    // Returns less than count samples only once the stream has ended
+    using Source = std::function<uint32_t(int16_t* buffer, uint32_t count)>;
+
+    // Segments of 40 ms that overlap by 6 ms, aligned within a window of 15 ms (samples at 44.1 kHz)
+    static constexpr uint32_t SEGMENT = 1792;
+    static constexpr uint32_t OVERLAP_SHIFT = 8;
+    static constexpr uint32_t OVERLAP = 1 << OVERLAP_SHIFT;
+    static constexpr uint32_t SEEK_WINDOW = 640;
+
+    // The coarse search looks at every DECIMATION th offset and sample
+    static constexpr uint32_t DECIMATION = 4;
+
+    static constexpr uint32_t INPUT_CAPACITY = 4096;
+
+    // percent
+    static constexpr uint32_t MIN_SPEED = 80;
+    static constexpr uint32_t MAX_SPEED = 150;
+
+   public:
+    TimeStretch();
+
+    ~TimeStretch();
+
+    void initialize();
+
+    // percent, 100 bypasses the stage. Changing the speed drops everything that is buffered.
+    void setSpeed(uint32_t percent);
+    uint32_t getSpeed() const { return speed; }
+
+    bool isActive() const { return speed != 100 && input; }
+
+    // Nothing is buffered, so the end of the source has been played
+    bool isDrained() const { return inputLength == 0 && outputPosition == outputLength; }
+
+    uint32_t process(int16_t* buffer, uint32_t count, const Source& source);
+
+    // Drops the buffered samples, e.g. after a seek. The next segment fades in.
+    void reset();
+
+   private:
+    bool refill(const Source& source);
+
+    uint32_t requiredInput() const;
+
+    uint32_t findBestOffset();
+
+    void stretchSegment();
+
+    void flush();
+
+    void consume(uint32_t count);
+
+   private:
+    uint32_t speed{100};
+
+    // Nominal input advance per segment in 1/65536 samples
+    uint32_t skip{0};
+    uint32_t skipFraction{0};
+
+    // PSRAM, interleaved stereo
+    int16_t* input{nullptr};
+    int16_t* output{nullptr};
+    uint32_t inputLength{0};
+    uint32_t outputLength{0};
+    uint32_t outputPosition{0};
+
+    // The tail of the last segment that is crossfaded into the next one
+    int16_t tail[2 * OVERLAP];
+
+    // Mono copies for the correlation search, reduced to 12 bits so the sums fit 32 bits
+    int16_t reference[OVERLAP];
+    int16_t candidates[(SEEK_WINDOW + OVERLAP) / DECIMATION];
+    int16_t refinement[OVERLAP + 2 * DECIMATION];
+
+   private:
+    TimeStretch(const TimeStretch&) = delete;
+
+    TimeStretch(TimeStretch&&) = delete;
+
+    TimeStretch& operator=(const TimeStretch&) = delete;
+
+    TimeStretch& operator=(TimeStretch&&) = delete;
+};
+
+#endif  // TIME_STRETCH_HXX
@@ -0,0 +1,208 @@
+#include "Transcoder.hxx"
+
+// clang-format off
+#include <freertos/FreeRTOS.h>
+// clang-format on
+
+#include <Arduino.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "Audio.hxx"
+#include "Config.hxx"
+#include "Decoder.hxx"
+#include "DirectoryPlayer.hxx"
+#include "DirectoryReader.hxx"
+#include "Log.hxx"
+#include "MadDecoder.hxx"
+#include "Power.hxx"
+#include "WavDecoder.hxx"
+#include "Watchdog.hxx"
+#include "config.h"
+
+#define TAG "transcoder"
+
+namespace {
+
+Config* config;
+
+std::atomic<bool> stopNow;
+SemaphoreHandle_t stoppedSemaphore;
+
+MadDecoder* decoder{nullptr};
+int16_t* buffer{nullptr};
+
+std::vector<std::string> failedTracks;
+
+bool fileExists(const std::string& path) {
+    struct stat fstat;
+    return stat(path.c_str(), &fstat) == 0;
+}
+
+// Transcoding keeps the box from sleeping, which only costs nothing while it is charging
+bool onExternalPower() { return Power::getBatteryState().state != Power::BatteryState::discharging; }
+
+bool isIdle() { return !Audio::isPlaying() && onExternalPower(); }
+
+// Returns after TRANSCODER_IDLE_DELAY without playback on external power, or false if we are shutting down
+bool waitForIdle() {
+    uint32_t idle = 0;
+
+    while (idle < TRANSCODER_IDLE_DELAY) {
+        if (stopNow) return false;
+
+        delay(TRANSCODER_POLL_INTERVAL);
+
+        idle = isIdle() ? idle + TRANSCODER_POLL_INTERVAL : 0;
+    }
+
+    return !stopNow;
+}
+
+bool isFailed(const std::string& path) {
+    for (auto& failed : failedTracks)
+        if (failed == path) return true;
+
+    return false;
+}
+
+// Only albums that already have an index are considered: we must not race the audio task building it.
+// The current track is skipped as its saved position is a byte offset into the MP3. Files that are split
+// into virtual tracks are usually hours long audiobooks whose PCM would not even fit into a FAT file.
+bool findJob(std::string& source, std::string& target) {
+    DirectoryReader reader;
+
+    std::string currentAlbum = Audio::currentAlbum();
+    uint32_t currentTrack = Audio::currentTrack();
+
+    for (auto& album : config->transcodeAlbums()) {
+        std::string directory = Audio::directoryForAlbum(album.c_str());
+
+        if (!fileExists(directory + "/index") || !reader.open(directory.c_str())) continue;
+
+        for (uint32_t i = 0; i < reader.getLength(); i++) {
+            const DirectoryReader::TrackInfo* info = reader.getTrackInfo(i);
+            const char* track = info->name;
+
+            if ((album == currentAlbum && i == currentTrack) || info->start > 0 || info->end > 0 ||
+                !(Decoder::hasExtension(track, "mp3") || Decoder::hasExtension(track, "mp2")))
+                continue;
+
+            source = directory + "/" + track;
+            target = DirectoryPlayer::transcodedPath(source);
+
+            if (!isFailed(source) && !fileExists(target)) return true;
+        }
+    }
+
+    return false;
+}
+
+bool transcode(const std::string& source, const std::string& target) {
+    std::string partial = target + ".tmp";
+
+    if (!decoder->open(source.c_str())) return false;
+
+    FILE* out = fopen(partial.c_str(), "w");
+    if (!out) {
+        decoder->close();
+        return false;
+    }
+
+    LOG_INFO(TAG, "transcoding %s", source.c_str());
+
+    uint32_t sampleCount = 0;
+    bool success = WavDecoder::writeHeader(out, 0);
+
+    while (success) {
+        // Playback and the battery always have priority, we just keep our files open and continue later
+        if (!isIdle() && !waitForIdle()) success = false;
+        if (stopNow) success = false;
+        if (!success) break;
+
+        // Only on external power, on battery the inactivity timeout must send the box to sleep
+        Watchdog::notify();
+
+        uint32_t decoded = decoder->decode(buffer, TRANSCODER_CHUNK_SIZE);
+        if (decoded == 0) break;
+
+        success = fwrite(buffer, 4, decoded, out) == decoded;
+        sampleCount += decoded;
+    }
+
+    decoder->close();
+
+    success = success && WavDecoder::writeHeader(out, sampleCount);
+    success = (fclose(out) == 0) && success;
+    success = success && rename(partial.c_str(), target.c_str()) == 0;
+
+    if (!success) {
+        remove(partial.c_str());
+
+        LOG_WARN(TAG, "transcoding %s failed", source.c_str());
+    } else {
+        LOG_INFO(TAG, "transcoded %u samples to %s", sampleCount, target.c_str());
+    }
+
+    return success;
+}
+
+void _transcoderTask() {
+    std::string source, target;
+
+    while (waitForIdle()) {
+        if (!findJob(source, target)) {
+            delay(TRANSCODER_RESCAN_INTERVAL);
+            continue;
+        }
+
+        if (!transcode(source, target) && !stopNow) failedTracks.push_back(source);
+    }
+}
+
+void transcoderTask(void*) {
+    decoder = new (ps_malloc(sizeof(MadDecoder))) MadDecoder();
+    buffer = (int16_t*)malloc(4 * TRANSCODER_CHUNK_SIZE);
+
+    _transcoderTask();
+
+    decoder->~MadDecoder();
+    free(decoder);
+    free(buffer);
+
+    xSemaphoreGive(stoppedSemaphore);
+
+    vTaskDelete(NULL);
+}
+
+}  // namespace
+
+void Transcoder::initialize(Config& _config) {
+    config = &_config;
+    stoppedSemaphore = xSemaphoreCreateBinary();
+}
+
+void Transcoder::start() {
+    if (config->transcodeAlbums().empty()) return;
+
+    stopNow = false;
+
+    TaskHandle_t transcoderTaskHandle;
+    xTaskCreatePinnedToCore(transcoderTask, "transcoder", STACK_SIZE_TRANSCODER, NULL, TASK_PRIORITY_TRANSCODER,
+                            &transcoderTaskHandle, SERVICE_CORE);
+}
+
+void Transcoder::stop() {
+    if (config->transcodeAlbums().empty() || stopNow) return;
+
+    stopNow = true;
+
+    // Make sure that partial output is removed before the SD goes away
+    xSemaphoreTake(stoppedSemaphore, TRANSCODER_STOP_TIMEOUT / portTICK_PERIOD_MS);
+}
@@ -0,0 +1,16 @@
+#ifndef TRANSCODER_HXX
+#define TRANSCODER_HXX
+
+class Config;
+
+namespace Transcoder {
+
+void initialize(Config& config);
+
+void start();
+
+void stop();
+
+}  // namespace Transcoder
+
+#endif  // TRANSCODER_HXX
@@ -0,0 +1,186 @@
+#include "WavDecoder.hxx"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Log.hxx"
+#include "config.h"
+
+#define TAG "wav"
+
+namespace {
+
+constexpr uint16_t FORMAT_PCM = 1;
+constexpr uint16_t BITS_PER_SAMPLE = 16;
+constexpr size_t CHUNK_HEADER_SIZE = 8;
+constexpr size_t FMT_CHUNK_SIZE = 16;
+
+uint32_t decodeLE32(const uint8_t* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+uint16_t decodeLE16(const uint8_t* data) { return data[0] | (data[1] << 8); }
+
+void encodeLE32(uint8_t* data, uint32_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+void encodeLE16(uint8_t* data, uint16_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+bool readFully(FILE* file, uint8_t* buffer, size_t len) { return fread(buffer, 1, len, file) == len; }
+
+}  // namespace
+
+WavDecoder::WavDecoder() {}
+
+WavDecoder::~WavDecoder() { close(); }
+
+bool WavDecoder::open(const char* path) {
+    close();
+
+    file = fopen(path, "r");
+    if (!file) return false;
+
+    if (!parseHeader()) {
+        LOG_WARN(TAG, "unsupported WAV file %s", path);
+
+        close();
+        return false;
+    }
+
+    rewind();
+
+    return true;
+}
+
+bool WavDecoder::parseHeader() {
+    uint8_t header[CHUNK_HEADER_SIZE + FMT_CHUNK_SIZE];
+
+    if (!readFully(file, header, 12) || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0)
+        return false;
+
+    size_t offset = 12;
+    bool hasFormat = false;
+
+    while (readFully(file, header, CHUNK_HEADER_SIZE)) {
+        uint32_t chunkSize = decodeLE32(header + 4);
+
+        if (memcmp(header, "fmt ", 4) == 0) {
+            if (chunkSize < FMT_CHUNK_SIZE || !readFully(file, header, FMT_CHUNK_SIZE)) return false;
+
+            channels = decodeLE16(header + 2);
+
+            if (decodeLE16(header) != FORMAT_PCM || (channels != 1 && channels != 2) ||
+                decodeLE32(header + 4) != SAMPLE_RATE || decodeLE16(header + 14) != BITS_PER_SAMPLE)
+                return false;
+
+            hasFormat = true;
+        } else if (memcmp(header, "data", 4) == 0) {
+            if (!hasFormat) return false;
+
+            dataStart = offset + CHUNK_HEADER_SIZE;
+
+            // Files whose writer died before patching the header claim more data than there is
+            fseek(file, 0, SEEK_END);
+            dataEnd = std::min(dataStart + chunkSize, static_cast<size_t>(ftell(file)));
+            dataEnd -= (dataEnd - dataStart) % (2 * channels);
+
+            return true;
+        }
+
+        // chunks are word aligned
+        offset += CHUNK_HEADER_SIZE + chunkSize + (chunkSize & 0x01);
+        if (fseek(file, offset, SEEK_SET) != 0) return false;
+    }
+
+    return false;
+}
+
+uint32_t WavDecoder::decode(int16_t* buffer, uint32_t count) {
+    if (isFinished()) return 0;
+
+    const size_t frameSize = 2 * channels;
+    size_t bytesToRead = std::min(static_cast<size_t>(count) * frameSize, dataEnd - position);
+    size_t bytesRead = 0;
+
+    while (bytesRead < bytesToRead) {
+        size_t r = fread(reinterpret_cast<uint8_t*>(buffer) + bytesRead, 1, bytesToRead - bytesRead, file);
+
+        if (r == 0) {
+            // truncated file
+            dataEnd = position + bytesRead;
+            break;
+        }
+
+        bytesRead += r;
+    }
+
+    uint32_t decodedSamples = bytesRead / frameSize;
+    position += decodedSamples * frameSize;
+
+    if (channels == 1)
+        for (int32_t i = decodedSamples - 1; i >= 0; i--) buffer[2 * i] = buffer[2 * i + 1] = buffer[i];
+
+    return decodedSamples;
+}
+
+void WavDecoder::close() {
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+
+    channels = 0;
+    dataStart = dataEnd = position = 0;
+}
+
+uint32_t WavDecoder::getPosition() const { return file ? (position - dataStart) / (2 * channels) : 0; }
+
+uint32_t WavDecoder::getDuration() {
+    return file ? static_cast<uint64_t>(dataEnd - dataStart) / (2 * channels) * 1000 / SAMPLE_RATE : 0;
+}
+
+void WavDecoder::rewind() { seekTo(dataStart); }
+
+size_t WavDecoder::getSeekPosition() { return position; }
+
+void WavDecoder::seekTo(uint32_t seekPosition) {
+    if (!file) return;
+
+    position = std::max(std::min(static_cast<size_t>(seekPosition), dataEnd), dataStart);
+    position -= (position - dataStart) % (2 * channels);
+
+    fseek(file, position, SEEK_SET);
+}
+
+void WavDecoder::seekToSample(uint32_t sample) {
+    if (!file) return;
+
+    seekTo(std::min(dataStart + static_cast<uint64_t>(sample) * 2 * channels, static_cast<uint64_t>(dataEnd)));
+}
+
+bool WavDecoder::writeHeader(FILE* file, uint32_t sampleCount) {
+    uint8_t header[44];
+    uint32_t dataSize = sampleCount * 4;
+
+    memcpy(header, "RIFF", 4);
+    encodeLE32(header + 4, 36 + dataSize);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    encodeLE32(header + 16, FMT_CHUNK_SIZE);
+    encodeLE16(header + 20, FORMAT_PCM);
+    encodeLE16(header + 22, 2);
+    encodeLE32(header + 24, SAMPLE_RATE);
+    encodeLE32(header + 28, SAMPLE_RATE * 4);
+    encodeLE16(header + 32, 4);
+    encodeLE16(header + 34, BITS_PER_SAMPLE);
+    memcpy(header + 36, "data", 4);
+    encodeLE32(header + 40, dataSize);
+
+    return fseek(file, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
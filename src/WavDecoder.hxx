@@ -0,0 +1,59 @@
+#ifndef WAV_DECODER_HXX
+#define WAV_DECODER_HXX
+
+#include <cstdint>
+#include <cstdio>
+
+#include "Decoder.hxx"
+
+class WavDecoder : public Decoder {
+   public:
+    WavDecoder();
+
+    ~WavDecoder() override;
+
+    bool open(const char* path) override;
+
+    uint32_t decode(int16_t* buffer, uint32_t count) override;
+
+    bool isFinished() const override { return !file || position >= dataEnd; };
+
+    void close() override;
+
+    uint32_t getPosition() const override;
+
+    uint32_t getDuration() override;
+
+    void rewind() override;
+
+    size_t getSeekPosition() override;
+    void seekTo(uint32_t position) override;
+
+    uint32_t getStreamPosition() override { return getPosition(); }
+    void seekToSample(uint32_t sample) override;
+
+    static bool writeHeader(FILE* file, uint32_t sampleCount);
+
+   private:
+    bool parseHeader();
+
+   private:
+    FILE* file{nullptr};
+
+    uint16_t channels{0};
+
+    size_t dataStart{0};
+    size_t dataEnd{0};
+    size_t position{0};
+
+   private:
+    WavDecoder(const WavDecoder&) = delete;
+
+    WavDecoder(WavDecoder&&) = delete;
+
+    WavDecoder& operator=(const WavDecoder&) = delete;
+
+    WavDecoder& operator=(WavDecoder&&) = delete;
+};
+
+#endif  // WAV_DECODER_HXX
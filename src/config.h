@@ -3,6 +3,11 @@
 
 #define PIN_SD_CS GPIO_NUM_5
 
+// Host builds point this at a directory on the host
+#ifndef SD_MOUNT_POINT
+#define SD_MOUNT_POINT "/sdcard"
+#endif
+
 #define PIN_I2S_BCK GPIO_NUM_26
 #define PIN_I2S_WC GPIO_NUM_22
 #define PIN_I2S_DATA GPIO_NUM_25
@@ -36,13 +41,39 @@
 #define PLAYBACK_CHUNK_SIZE 1024
 #define PLAYBACK_QUEUE_SIZE 8
 #define SAMPLE_RATE 44100
+#define AUDIO_STOP_TIMEOUT 1000
+
+// Decoded music ahead of the playback queue, the depth adapts between the two
+#define JITTER_BUFFER_MIN_DEPTH PLAYBACK_QUEUE_SIZE
+#define JITTER_BUFFER_MS 500
+
+// A deeper buffer is not saved with the shutdown snapshot, playback resumes from the audible position instead
+#define SNAPSHOT_MAX_BLOCKS 16
+
+#define BOOKMARK_CAPACITY 128
+#define BOOKMARK_JOURNAL_LIMIT 1024
+
+#define PCM_CACHE_BUDGET (1024 * 1024)
+#define PCM_CACHE_ENTRY_MS 1000
+#define PCM_CACHE_HEAD_START (PLAYBACK_QUEUE_SIZE * PLAYBACK_CHUNK_SIZE / 4)
+
+#define CUE_DIRECTORY SD_MOUNT_POINT "/cues"
+#define CUE_CLIP_LIMIT_MS 3000
+
+#define TRANSCODER_CHUNK_SIZE 1024
+#define TRANSCODER_IDLE_DELAY 10000
+#define TRANSCODER_POLL_INTERVAL 500
+#define TRANSCODER_RESCAN_INTERVAL 60000
+#define TRANSCODER_STOP_TIMEOUT 2000
 
 #define AUDIO_CORE 1
 #define SERVICE_CORE 0
 #define CPU_FREQUENCY 160
+#define CPU_FREQUENCY_TRANSCODED 80
 
 #define TASK_PRIORITY_I2S 10
 #define TASK_PRIORITY_AUDIO 9
+#define TASK_PRIORITY_DECODER 8
 
 #define TASK_PRIORITY_SHUTDOWN 10
 #define TASK_PRIORITY_GPIO 5
@@ -52,9 +83,11 @@
 #define TASK_PRIORITY_SERVER 1
 #define TASK_PRIORITY_WATCHDOG 1
 #define TASK_PRIORITY_LOG_TO_SD 1
+#define TASK_PRIORITY_TRANSCODER 1
 
 #define STACK_SIZE_I2S 0x0800
 #define STACK_SIZE_AUDIO 0x1000
+#define STACK_SIZE_DECODER 0x1000
 #define STACK_SIZE_RFID 0x1000
 #define STACK_SIZE_GPIO 0x0800
 #define STACK_SIZE_WATCHDOG 0x0800
@@ -64,6 +97,7 @@
 #define STACK_SIZE_NET 0x1000
 #define STACK_SIZE_SERVER 0x8000
 #define STACK_SIZE_SHUTDOWN 0x0800
+#define STACK_SIZE_TRANSCODER 0x1000
 
 #define DEBOUNCE_DELAY 50
 
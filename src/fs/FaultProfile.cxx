@@ -0,0 +1,185 @@
+#include "FaultProfile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+constexpr uint32_t SEED = 0x5d0cafe1;
+constexpr size_t LINE_SIZE = 4096;
+constexpr uint32_t LATENCIES_PER_LINE = 16;
+
+}  // namespace
+
+FaultProfile::FaultProfile() : random(SEED) {}
+
+bool FaultProfile::load(const char* path) {
+    FILE* file = fopen(path, "r");
+
+    if (!file) return false;
+
+    char line[LINE_SIZE];
+    bool success = true;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    latencies.clear();
+    bandwidth = stallInterval = stallDuration = 0;
+
+    while (success && fgets(line, sizeof(line), file)) {
+        char* comment = strchr(line, '#');
+        if (comment) *comment = 0;
+
+        char* keyword = strtok(line, " \t\r\n");
+        if (!keyword) continue;
+
+        std::vector<uint32_t> values;
+        for (char* value; (value = strtok(nullptr, " \t\r\n"));) values.push_back(strtoul(value, nullptr, 10));
+
+        if (strcmp(keyword, "bandwidth") == 0 && values.size() == 1) {
+            bandwidth = values[0];
+        } else if (strcmp(keyword, "stall") == 0 && values.size() == 2) {
+            applyStalls(values[0], values[1]);
+        } else if (strcmp(keyword, "latency") == 0) {
+            latencies.insert(latencies.end(), values.begin(), values.end());
+        } else {
+            success = false;
+        }
+    }
+
+    fclose(file);
+
+    return success;
+}
+
+bool FaultProfile::save(const char* path) const {
+    FILE* file = fopen(path, "w");
+
+    if (!file) return false;
+
+    fprintf(file, "# SD card timing for FaultyFS\n");
+    fprintf(file, "bandwidth %u\n", bandwidth);
+    fprintf(file, "stall %u %u\n", stallInterval, stallDuration);
+
+    for (size_t i = 0; i < latencies.size(); i++)
+        fprintf(file, "%s%u%s", i % LATENCIES_PER_LINE == 0 ? "latency " : "", latencies[i],
+                i % LATENCIES_PER_LINE == LATENCIES_PER_LINE - 1 || i == latencies.size() - 1 ? "\n" : " ");
+
+    return fclose(file) == 0;
+}
+
+void FaultProfile::record(const std::vector<Measurement>& measurements, uint32_t stallThreshold) {
+    std::vector<uint32_t> stalls;
+    uint64_t elapsed = 0;
+
+    // Least squares fit of latency = a + b * bytes over the regular reads
+    double n = 0, sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+
+    for (const Measurement& measurement : measurements) {
+        elapsed += measurement.latency;
+
+        if (measurement.latency > stallThreshold) {
+            stalls.push_back(measurement.latency);
+            continue;
+        }
+
+        n++;
+        sumX += measurement.bytes;
+        sumY += measurement.latency;
+        sumXX += static_cast<double>(measurement.bytes) * measurement.bytes;
+        sumXY += static_cast<double>(measurement.bytes) * measurement.latency;
+    }
+
+    double variance = n * sumXX - sumX * sumX;
+    double slope = variance > 0 ? (n * sumXY - sumX * sumY) / variance : 0;
+
+    setBandwidth(slope > 0 ? static_cast<uint32_t>(1e6 / slope) : 0);
+
+    std::vector<uint32_t> samples;
+
+    for (const Measurement& measurement : measurements) {
+        if (measurement.latency > stallThreshold) continue;
+
+        double transfer = slope > 0 ? slope * measurement.bytes : 0;
+        samples.push_back(measurement.latency > transfer ? static_cast<uint32_t>(measurement.latency - transfer) : 0);
+    }
+
+    // Evenly spaced quantiles keep the shape of the distribution, including its tail
+    std::sort(samples.begin(), samples.end());
+
+    std::vector<uint32_t> quantiles;
+
+    size_t count = std::min(samples.size(), static_cast<size_t>(MAX_LATENCIES));
+
+    for (size_t i = 0; i < count; i++)
+        quantiles.push_back(samples[count > 1 ? i * (samples.size() - 1) / (count - 1) : 0]);
+
+    setLatencies(quantiles);
+
+    if (stalls.empty()) {
+        setStalls(0, 0);
+    } else {
+        std::sort(stalls.begin(), stalls.end());
+        setStalls(elapsed / 1000 / stalls.size(), stalls[stalls.size() / 2] / 1000);
+    }
+}
+
+void FaultProfile::setBandwidth(uint32_t _bandwidth) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    bandwidth = _bandwidth;
+}
+
+void FaultProfile::setLatencies(const std::vector<uint32_t>& _latencies) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    latencies = _latencies;
+}
+
+void FaultProfile::setStalls(uint32_t interval, uint32_t duration) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    applyStalls(interval, duration);
+}
+
+void FaultProfile::applyStalls(uint32_t interval, uint32_t duration) {
+    stallInterval = interval;
+    stallDuration = std::min(duration, interval);
+}
+
+uint64_t FaultProfile::delayFor(size_t size, uint64_t now) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!started) {
+        started = true;
+        origin = now;
+    }
+
+    uint64_t start = std::max(now, busyUntil);
+
+    // Stalls occupy the first stallDuration ms of every stallInterval ms after the first read
+    if (stallInterval > 0) {
+        uint64_t interval = stallInterval * 1000ULL;
+        uint64_t phase = (start - origin) % interval;
+
+        if (start - origin >= interval && phase < stallDuration * 1000ULL) start += stallDuration * 1000ULL - phase;
+    }
+
+    uint64_t latency = latencies.empty() ? 0 : latencies[nextRandom() % latencies.size()];
+    uint64_t transfer = bandwidth > 0 ? size * 1000000ULL / bandwidth : 0;
+
+    busyUntil = start + latency + transfer;
+
+    return busyUntil - now;
+}
+
+// xorshift32, the same sequence in every run
+uint32_t FaultProfile::nextRandom() {
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+
+    return random;
+}
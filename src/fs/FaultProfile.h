@@ -0,0 +1,86 @@
+#ifndef FAULT_PROFILE_H
+#define FAULT_PROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * Timing model of an SD card for FaultyFS. Every read waits for a latency drawn from a recorded
+ * distribution plus its transfer time at the bandwidth of the card, and reads that hit one of the
+ * periodic stalls wait for its end. The card serves one read at a time, so concurrent readers
+ * queue behind each other.
+ */
+class FaultProfile {
+   public:
+    struct Measurement {
+        uint32_t bytes;
+
+        // microseconds
+        uint32_t latency;
+    };
+
+    static constexpr uint32_t MAX_LATENCIES = 256;
+
+    // microseconds
+    static constexpr uint32_t DEFAULT_STALL_THRESHOLD = 50000;
+
+   public:
+    FaultProfile();
+
+    // Text file with one "bandwidth <bytes/s>", "stall <interval ms> <duration ms>" or "latency <us> ..." per line
+    bool load(const char* path);
+    bool save(const char* path) const;
+
+    // Derives the model from sequential reads timed on a real card, reads above stallThreshold are stalls
+    void record(const std::vector<Measurement>& measurements, uint32_t stallThreshold = DEFAULT_STALL_THRESHOLD);
+
+    // bytes per second, 0 if unlimited
+    void setBandwidth(uint32_t bandwidth);
+    uint32_t getBandwidth() const { return bandwidth; }
+
+    // microseconds per read, 0 if empty
+    void setLatencies(const std::vector<uint32_t>& latencies);
+    const std::vector<uint32_t>& getLatencies() const { return latencies; }
+
+    // milliseconds, no stalls if interval is 0
+    void setStalls(uint32_t interval, uint32_t duration);
+    uint32_t getStallInterval() const { return stallInterval; }
+    uint32_t getStallDuration() const { return stallDuration; }
+
+    // Microseconds until a read of size bytes that is issued now completes, now in microseconds of any monotonic clock
+    uint64_t delayFor(size_t size, uint64_t now);
+
+   private:
+    uint32_t nextRandom();
+
+    // With the mutex held, a stall never lasts longer than its interval
+    void applyStalls(uint32_t interval, uint32_t duration);
+
+   private:
+    uint32_t bandwidth{0};
+    std::vector<uint32_t> latencies;
+    uint32_t stallInterval{0};
+    uint32_t stallDuration{0};
+
+    uint32_t random;
+
+    // The first read starts the stall period, the card is busy until the last read completes
+    bool started{false};
+    uint64_t origin{0};
+    uint64_t busyUntil{0};
+
+    std::mutex mutex;
+
+   private:
+    FaultProfile(const FaultProfile&) = delete;
+
+    FaultProfile(FaultProfile&&) = delete;
+
+    FaultProfile& operator=(const FaultProfile&) = delete;
+
+    FaultProfile& operator=(FaultProfile&&) = delete;
+};
+
+#endif  // FAULT_PROFILE_H
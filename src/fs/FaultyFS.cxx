@@ -0,0 +1,30 @@
+#include "FaultyFS.h"
+
+#include <memory>
+
+#include "FaultyFile.h"
+
+using namespace fs;
+using std::make_shared;
+
+FaultyFS::FaultyFS(FSImplPtr fs, FaultProfile& profile) : fs(fs), profile(profile) {}
+
+FaultyFS::~FaultyFS() {}
+
+FileImplPtr FaultyFS::open(const char* path, const char* mode) {
+    FileImplPtr file = fs->open(path, mode);
+
+    if (!file || file->isDirectory()) return file;
+
+    return make_shared<FaultyFile>(file, profile);
+}
+
+bool FaultyFS::exists(const char* path) { return fs->exists(path); }
+
+bool FaultyFS::rename(const char* pathFrom, const char* pathTo) { return fs->rename(pathFrom, pathTo); }
+
+bool FaultyFS::remove(const char* path) { return fs->remove(path); }
+
+bool FaultyFS::mkdir(const char* path) { return fs->mkdir(path); }
+
+bool FaultyFS::rmdir(const char* path) { return fs->rmdir(path); }
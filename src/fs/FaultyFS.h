@@ -0,0 +1,33 @@
+#ifndef FAULTY_FS_H
+#define FAULTY_FS_H
+
+#include <FS.h>
+#include <FSImpl.h>
+
+#include "FaultProfile.h"
+
+// Wraps the files of another file system into FaultyFile, e.g. PosixFS on the host to play like a slow SD card
+class FaultyFS : public fs::FSImpl {
+   public:
+    FaultyFS(fs::FSImplPtr fs, FaultProfile& profile);
+
+    virtual ~FaultyFS();
+
+    virtual fs::FileImplPtr open(const char* path, const char* mode) override;
+
+    virtual bool exists(const char* path) override;
+
+    virtual bool rename(const char* pathFrom, const char* pathTo) override;
+
+    virtual bool remove(const char* path) override;
+
+    virtual bool mkdir(const char* path) override;
+
+    virtual bool rmdir(const char* path) override;
+
+   private:
+    fs::FSImplPtr fs;
+    FaultProfile& profile;
+};
+
+#endif  // FAULTY_FS_H
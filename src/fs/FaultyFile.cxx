@@ -0,0 +1,44 @@
+#include "FaultyFile.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace fs;
+using std::chrono::microseconds;
+
+FaultyFile::FaultyFile(FileImplPtr file, FaultProfile& profile) : file(file), profile(profile) {}
+
+FaultyFile::~FaultyFile() { close(); }
+
+size_t FaultyFile::read(uint8_t* buf, size_t size) {
+    uint64_t now =
+        std::chrono::duration_cast<microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    std::this_thread::sleep_for(microseconds(profile.delayFor(size, now)));
+
+    return file->read(buf, size);
+}
+
+void FaultyFile::flush() { file->flush(); }
+
+size_t FaultyFile::write(const uint8_t* buf, size_t size) { return file->write(buf, size); }
+
+bool FaultyFile::seek(uint32_t pos, SeekMode mode) { return file->seek(pos, mode); }
+
+size_t FaultyFile::position() const { return file->position(); }
+
+size_t FaultyFile::size() const { return file->size(); }
+
+void FaultyFile::close() { file->close(); }
+
+time_t FaultyFile::getLastWrite() { return file->getLastWrite(); }
+
+const char* FaultyFile::name() const { return file->name(); }
+
+boolean FaultyFile::isDirectory(void) { return file->isDirectory(); }
+
+FileImplPtr FaultyFile::openNextFile(const char* mode) { return file->openNextFile(mode); }
+
+void FaultyFile::rewindDirectory(void) { file->rewindDirectory(); }
+
+FaultyFile::operator bool() { return file->operator bool(); }
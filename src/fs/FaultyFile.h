@@ -0,0 +1,55 @@
+#ifndef FaultyFile_h
+#define FaultyFile_h
+
+#include <FS.h>
+#include <FSImpl.h>
+
+#include "FaultProfile.h"
+
+// Delays the reads of another file like the SD card of the profile, everything else is passed through
+class FaultyFile : public fs::FileImpl {
+   public:
+    FaultyFile(fs::FileImplPtr file, FaultProfile& profile);
+
+    virtual ~FaultyFile() override;
+
+    virtual size_t read(uint8_t* buf, size_t size) override;
+
+    virtual void flush() override;
+
+    virtual size_t write(const uint8_t* buf, size_t size) override;
+
+    virtual bool seek(uint32_t pos, SeekMode mode) override;
+
+    virtual size_t position() const override;
+
+    virtual size_t size() const override;
+
+    virtual void close() override;
+
+    virtual time_t getLastWrite() override;
+
+    virtual const char* name() const override;
+
+    virtual boolean isDirectory(void) override;
+
+    virtual fs::FileImplPtr openNextFile(const char* mode) override;
+
+    virtual void rewindDirectory(void) override;
+
+    virtual operator bool() override;
+
+   private:
+    fs::FileImplPtr file;
+    FaultProfile& profile;
+
+   private:
+    FaultyFile() = delete;
+    FaultyFile(const FaultyFile&) = delete;
+    FaultyFile(FaultyFile&&) = delete;
+
+    FaultyFile& operator=(const FaultyFile&) = delete;
+    FaultyFile& operator=(FaultyFile&&) = delete;
+};
+
+#endif  // FaultyFile_h
@@ -17,6 +17,7 @@
 #include "Log.hxx"
 #include "Power.hxx"
 #include "Rfid.hxx"
+#include "Transcoder.hxx"
 #include "Watchdog.hxx"
 #include "config.h"
 #include "net/Net.hxx"
@@ -45,7 +46,7 @@ bool setupSd() {
         .format_if_mount_failed = false, .max_files = 5, .allocation_unit_size = 16 * 1024};
 
     sdmmc_card_t* card;
-    esp_err_t ret = esp_vfs_fat_sdmmc_mount("/sdcard", &host, &slot_config, &mount_config, &card);
+    esp_err_t ret = esp_vfs_fat_sdmmc_mount(SD_MOUNT_POINT, &host, &slot_config, &mount_config, &card);
 
     if (ret != ESP_OK) {
         LOG_ERROR(TAG, "Failed to initialize SD");
@@ -143,12 +144,13 @@ void setup() {
         return;
     }
 
-    Audio::initialize();
+    Audio::initialize(config);
     Rfid::initialize(spiHSPI, hspiMutex, config);
     Watchdog::initialize();
     Led::initialize();
     Net::initialize();
     HTTPServer::initialize();
+    Transcoder::initialize(config);
 
     if (!config.load()) {
         LOG_WARN(TAG, "WARNING: failed to load configuration");
@@ -161,6 +163,7 @@ void setup() {
     Watchdog::start();
 
     Rfid::start();
+    Transcoder::start();
 
     Log::enableSD();
 
@@ -22,6 +22,7 @@
 #include "Log.hxx"
 #include "Net.hxx"
 #include "Power.hxx"
+#include "Telemetry.hxx"
 #include "config.h"
 
 using std::string;
@@ -63,7 +64,9 @@ httpd_handle_t httpd_handle = nullptr;
 TaskHandle_t serverTaskHandle = nullptr;
 SemaphoreHandle_t statusMessageMutex;
 
-char serializedStatusMessage[1024] = "";
+constexpr size_t STATUS_MESSAGE_SIZE = 3072;
+
+char serializedStatusMessage[STATUS_MESSAGE_SIZE] = "";
 
 std::atomic<bool> isRunning;
 
@@ -291,16 +294,24 @@ void registerStaticFiles() {
 }
 
 void updateStatusMessage() {
-    StaticJsonDocument<1024> json;
+    StaticJsonDocument<STATUS_MESSAGE_SIZE> json;
     JsonObject audio = json.createNestedObject("audio");
     JsonObject power = json.createNestedObject("power");
     JsonObject heap = json.createNestedObject("heap");
+    JsonObject telemetry = json.createNestedObject("telemetry");
     Power::BatteryState batteryState = Power::getBatteryState();
-
-    audio["isPlaying"] = Audio::isPlaying();
-    audio["currentAlbum"] = Audio::currentAlbum();
-    audio["currentTrack"] = Audio::currentTrack();
-    audio["volume"] = Audio::currentVolume();
+    Audio::PlaybackState playback = Audio::playbackState();
+    Audio::TrackInfo trackInfo = Audio::currentTrackInfo();
+    Telemetry::Snapshot snapshot = Telemetry::snapshot();
+
+    audio["isPlaying"] = !playback.paused;
+    audio["currentAlbum"] = Audio::albumName(playback.album);
+    audio["currentTrack"] = playback.track;
+    audio["title"] = trackInfo.title;
+    audio["artist"] = trackInfo.artist;
+    audio["albumTitle"] = trackInfo.album;
+    audio["duration"] = trackInfo.duration;
+    audio["volume"] = playback.volume;
 
     power["voltage"] = batteryState.voltage;
     power["level"] = static_cast<uint8_t>(batteryState.level);
@@ -311,8 +322,46 @@ void updateStatusMessage() {
     heap["largestBlockDRAM"] = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL);
     heap["largestBlockPSRAM"] = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT | MALLOC_CAP_SPIRAM);
 
+    telemetry["chunks"] = snapshot.chunks;
+    telemetry["deadline"] = Telemetry::CHUNK_DEADLINE;
+    telemetry["lateChunks"] = snapshot.lateChunks;
+    telemetry["maxRenderTime"] = snapshot.maxRenderTime;
+    telemetry["bufferDepth"] = snapshot.bufferDepth;
+    telemetry["bufferTarget"] = snapshot.bufferTarget;
+    telemetry["maxBufferTarget"] = snapshot.maxBufferTarget;
+    telemetry["bufferUnderruns"] = snapshot.bufferUnderruns;
+    telemetry["underruns"] = snapshot.underruns;
+    telemetry["silence"] = static_cast<uint64_t>(snapshot.underrunFrames) * 1000 / SAMPLE_RATE;
+    telemetry["decoderErrors"] = snapshot.decoderErrors;
+    telemetry["trackDecoderErrors"] = snapshot.trackDecoderErrors;
+    telemetry["tracksWithErrors"] = snapshot.tracksWithErrors;
+    telemetry["trackSwitches"] = snapshot.trackSwitches;
+    telemetry["lastTrackSwitchTime"] = snapshot.lastTrackSwitchTime;
+    telemetry["maxTrackSwitchTime"] = snapshot.maxTrackSwitchTime;
+    telemetry["commands"] = snapshot.commands;
+    telemetry["lastCommandLatency"] = snapshot.lastCommandLatency;
+    telemetry["maxCommandLatency"] = snapshot.maxCommandLatency;
+
+    JsonArray queueFill = telemetry.createNestedArray("queueFill");
+    for (uint32_t count : snapshot.queueFill) queueFill.add(count);
+
+    JsonArray nodes = telemetry.createNestedArray("nodes");
+    for (uint32_t i = 0; i < snapshot.nodeCount; i++) {
+        JsonObject node = nodes.createNestedObject();
+
+        node["name"] = snapshot.nodes[i].name;
+        node["cycles"] = snapshot.nodes[i].cycles;
+        node["maxCycles"] = snapshot.nodes[i].maxCycles;
+    }
+
+    JsonArray renderTimeLimits = telemetry.createNestedArray("renderTimeLimits");
+    for (uint32_t limit : Telemetry::RENDER_TIME_LIMITS) renderTimeLimits.add(limit);
+
+    JsonArray renderTime = telemetry.createNestedArray("renderTime");
+    for (uint32_t count : snapshot.renderTime) renderTime.add(count);
+
     Lock lock(statusMessageMutex);
-    serializeJson(json, serializedStatusMessage, 1024);
+    serializeJson(json, serializedStatusMessage, STATUS_MESSAGE_SIZE);
 }
 
 void initSpiffs() {
@@ -388,6 +437,9 @@ void serverTask(void *) {
 void HTTPServer::initialize() {
     isRunning = false;
     statusMessageMutex = xSemaphoreCreateMutex();
+
+    // Playback changes are pushed, the periodic update is for the battery and the telemetry
+    Audio::setStateListener(sendUpdate);
 }
 
 void HTTPServer::start() {
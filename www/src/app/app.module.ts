@@ -2,6 +2,7 @@ import { AppComponent } from './app.component';
 import { BatteryLevelPipe } from './pipe/battery-level.pipe';
 import { BrowserAnimationsModule } from '@angular/platform-browser/animations';
 import { BrowserModule } from '@angular/platform-browser';
+import { DurationPipe } from './pipe/duration.pipe';
 import { HttpClientModule } from '@angular/common/http';
 import { MatButtonModule } from '@angular/material/button';
 import { MatCardModule } from '@angular/material/card';
@@ -9,6 +10,7 @@ import { MatDialogModule } from '@angular/material/dialog';
 import { MatIconModule } from '@angular/material/icon';
 import { MatProgressSpinnerModule } from '@angular/material/progress-spinner';
 import { MatToolbarModule } from '@angular/material/toolbar';
+import { MicrosecondsPipe } from './pipe/microseconds.pipe';
 import { NgModule } from '@angular/core';
 import { PhonytonyToolbarComponent } from './component/phonytony-toolbar/phonytony-toolbar.component';
 import { PowerStatePipe } from './pipe/power-state.pipe';
@@ -16,12 +18,15 @@ import { StatusCardBatteryComponent } from './component/status-card-battery/stat
 import { StatusCardLineComponent } from './component/status-card-line/status-card-line.component';
 import { StatusCardMemoryComponent } from './component/status-card-memory/status-card-memory.component';
 import { StatusCardPlaybackComponent } from './component/status-card-playback/status-card-playback.component';
+import { StatusCardTelemetryComponent } from './component/status-card-telemetry/status-card-telemetry.component';
 import { VoltagePipe } from './pipe/voltage.pipe';
 
 @NgModule({
     declarations: [
         AppComponent,
         BatteryLevelPipe,
+        DurationPipe,
+        MicrosecondsPipe,
         PowerStatePipe,
         VoltagePipe,
         PhonytonyToolbarComponent,
@@ -29,6 +34,7 @@ import { VoltagePipe } from './pipe/voltage.pipe';
         StatusCardPlaybackComponent,
         StatusCardBatteryComponent,
         StatusCardMemoryComponent,
+        StatusCardTelemetryComponent,
     ],
     imports: [
         BrowserModule,
@@ -0,0 +1,25 @@
+import { ComponentFixture, TestBed } from '@angular/core/testing';
+
+import { StatusCardTelemetryComponent } from './status-card-telemetry.component';
+
+describe('StatusCardTelemetryComponent', () => {
+  let component: StatusCardTelemetryComponent;
+  let fixture: ComponentFixture<StatusCardTelemetryComponent>;
+
+  beforeEach(async () => {
+    await TestBed.configureTestingModule({
+      declarations: [ StatusCardTelemetryComponent ]
+    })
+    .compileComponents();
+  });
+
+  beforeEach(() => {
+    fixture = TestBed.createComponent(StatusCardTelemetryComponent);
+    component = fixture.componentInstance;
+    fixture.detectChanges();
+  });
+
+  it('should create', () => {
+    expect(component).toBeTruthy();
+  });
+});
@@ -0,0 +1,33 @@
+import { Component } from '@angular/core';
+
+import { ManagementService } from 'src/app/service/management.service';
+
+@Component({
+    selector: 'app-status-card-telemetry',
+    templateUrl: './status-card-telemetry.component.html',
+    styleUrls: ['./status-card-telemetry.component.scss'],
+})
+export class StatusCardTelemetryComponent {
+    public messages$ = this.managementService.messages();
+
+    constructor(private managementService: ManagementService) {}
+
+    // Percent of the total per bucket
+    public histogram(counts?: number[]): number[] {
+        const total = (counts ?? []).reduce((sum, count) => sum + count, 0);
+
+        return (counts ?? []).map((count) => (total > 0 ? Math.round((100 * count) / total) : 0));
+    }
+
+    public kiloCycles(cycles: number): string {
+        return (cycles / 1000).toFixed(0) + 'k';
+    }
+
+    public renderTimeLabel(limits: number[] | undefined, bucket: number): string {
+        if (!limits) return '';
+
+        return bucket < limits.length
+            ? '≤ ' + (limits[bucket] / 1000).toFixed(1) + ' ms'
+            : '> ' + (limits[limits.length - 1] / 1000).toFixed(1) + ' ms';
+    }
+}
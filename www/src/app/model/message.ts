@@ -18,6 +18,10 @@ export interface Message {
         isPlaying: boolean;
         currentAlbum: string;
         currentTrack: number;
+        title: string;
+        artist: string;
+        albumTitle: string;
+        duration: number;
         volume: number;
     };
 
@@ -33,4 +37,37 @@ export interface Message {
         largestBlockDRAM: number;
         largestBlockPSRAM: number;
     };
+
+    telemetry: {
+        chunks: number;
+        // microseconds
+        deadline: number;
+        lateChunks: number;
+        maxRenderTime: number;
+        // Blocks of decoded music ahead of the audio queue, each one lasts as long as the deadline
+        bufferDepth: number;
+        bufferTarget: number;
+        maxBufferTarget: number;
+        bufferUnderruns: number;
+        underruns: number;
+        // milliseconds
+        silence: number;
+        decoderErrors: number;
+        trackDecoderErrors: number;
+        tracksWithErrors: number;
+        trackSwitches: number;
+        lastTrackSwitchTime: number;
+        maxTrackSwitchTime: number;
+        // From a button or web command until it can be heard, microseconds
+        commands: number;
+        lastCommandLatency: number;
+        maxCommandLatency: number;
+        // CPU cycles per chunk of the nodes of the audio graph
+        nodes: { name: string; cycles: number; maxCycles: number }[];
+        // Chunks per audio queue fill level, 0 up to the queue size
+        queueFill: number[];
+        // Upper bounds of the render time buckets, the last bucket has none
+        renderTimeLimits: number[];
+        renderTime: number[];
+    };
 }
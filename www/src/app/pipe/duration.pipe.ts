@@ -0,0 +1,12 @@
+import { Pipe, PipeTransform } from '@angular/core';
+
+@Pipe({ name: 'duration' })
+export class DurationPipe implements PipeTransform {
+    transform(value?: number): string {
+        if (!value) return '';
+
+        const seconds = Math.round(value / 1000);
+
+        return Math.floor(seconds / 60) + ':' + (seconds % 60).toString().padStart(2, '0');
+    }
+}
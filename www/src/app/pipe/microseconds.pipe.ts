@@ -0,0 +1,8 @@
+import { Pipe, PipeTransform } from '@angular/core';
+
+@Pipe({ name: 'microseconds' })
+export class MicrosecondsPipe implements PipeTransform {
+    transform(value?: number): string {
+        return value !== undefined ? (value / 1000).toFixed(1) + ' ms' : '';
+    }
+}